@@ -0,0 +1,115 @@
+#include "HeadlessContext.hpp"
+
+#include "Logging.hpp"
+
+#include <glad/glad.h>
+
+#ifdef HEADLESS_ENABLED
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#endif
+
+namespace App
+{
+HeadlessContext::HeadlessContext()
+    : m_display(nullptr)
+    , m_context(nullptr)
+    , m_init(false)
+{
+#ifdef HEADLESS_ENABLED
+  // Surfaceless platform first, falling back on default display if not exposed by the driver
+  EGLDisplay display = EGL_NO_DISPLAY;
+  auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (getPlatformDisplay)
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  if (display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major = 0, minor = 0;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+  {
+    LOG_ERROR("Cannot initialize EGL display");
+    return;
+  }
+  m_display = display;
+
+  LOG_INFO("EGL {}.{} initialized, vendor {}", major, minor, eglQueryString(display, EGL_VENDOR));
+
+  if (!eglBindAPI(EGL_OPENGL_API))
+  {
+    LOG_ERROR("EGL does not support desktop OpenGL");
+    return;
+  }
+
+  const EGLint configAttribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_DEPTH_SIZE, 24,
+    EGL_NONE
+  };
+
+  EGLConfig config;
+  EGLint nbConfigs = 0;
+  if (!eglChooseConfig(display, configAttribs, &config, 1, &nbConfigs) || nbConfigs == 0)
+  {
+    LOG_ERROR("No suitable EGL config found");
+    return;
+  }
+
+  // Same requirements than shaders, see GLSL.hpp
+  const EGLint contextAttribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+  if (context == EGL_NO_CONTEXT)
+  {
+    LOG_ERROR("Cannot create EGL context");
+    return;
+  }
+  m_context = context;
+
+  // No surface at all, rendering is done in framebuffer objects
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+  {
+    LOG_ERROR("Cannot make EGL context current without surface");
+    return;
+  }
+
+  if (gladLoadGLLoader((GLADloadproc)eglGetProcAddress) == 0)
+  {
+    LOG_ERROR("Failed to initialize OpenGL loader!");
+    return;
+  }
+
+  LOG_INFO("Headless OpenGL context created, renderer {}", (const char*)glGetString(GL_RENDERER));
+
+  m_init = true;
+#else
+  LOG_ERROR("Headless mode not available, build with HEADLESS_ENABLED");
+#endif
+}
+
+HeadlessContext::~HeadlessContext()
+{
+#ifdef HEADLESS_ENABLED
+  if (m_display)
+  {
+    eglMakeCurrent((EGLDisplay)m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (m_context)
+      eglDestroyContext((EGLDisplay)m_display, (EGLContext)m_context);
+    eglTerminate((EGLDisplay)m_display);
+  }
+#endif
+}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+namespace App
+{
+// OpenGL context without any window nor surface, through EGL (e.g. Mesa llvmpipe on a headless server)
+// Only available when built with HEADLESS_ENABLED
+class HeadlessContext
+{
+  public:
+  HeadlessContext();
+  ~HeadlessContext();
+
+  bool isInit() const { return m_init; }
+
+  private:
+  void* m_display;
+  void* m_context;
+  bool m_init;
+};
+}
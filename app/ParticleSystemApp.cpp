@@ -6,6 +6,9 @@
 #include "Parameters.hpp"
 #include "Utils.hpp"
 
+#include <algorithm>
+#include <chrono>
+
 #include <imgui.h>
 #include <imgui_impl_opengl3.h>
 #include <imgui_impl_sdl.h>
@@ -88,6 +91,13 @@ bool ParticleSystemApp::initWindow()
   return true;
 }
 
+bool ParticleSystemApp::initHeadlessContext()
+{
+  m_headlessContext = std::make_unique<HeadlessContext>();
+
+  return m_headlessContext->isInit();
+}
+
 bool ParticleSystemApp::closeWindow()
 {
   ImGui_ImplOpenGL3_Shutdown();
@@ -178,8 +188,7 @@ bool ParticleSystemApp::checkSDLStatus()
     }
     case SDL_KEYDOWN:
     {
-      bool isPaused = m_physicsEngine->onPause();
-      m_physicsEngine->pause(!isPaused);
+      pushCommand([](Physics::Model& model) { model.pause(!model.onPause()); });
       break;
     }
     }
@@ -187,21 +196,35 @@ bool ParticleSystemApp::checkSDLStatus()
   return stopRendering;
 }
 
-ParticleSystemApp::ParticleSystemApp()
-    : m_nameApp("RealTimeParticles " + Utils::GetVersions())
+ParticleSystemApp::ParticleSystemApp(AppOptions options)
+    : m_options(options)
+    , m_nameApp("RealTimeParticles " + Utils::GetVersions())
     , m_mousePrevPos(0, 0)
     , m_backGroundColor(0.0f, 0.0f, 0.0f, 1.00f)
     , m_buttonRightActivated(false)
     , m_buttonLeftActivated(false)
-    , m_windowSize(1280, 720)
-    , m_modelType(Physics::ModelType::FLUIDS)
+    , m_windowSize(options.isHeadless ? options.capture.size : Math::int2(1280, 720))
+    , m_modelType(options.modelType)
+    , m_isModelSwitchRequested(false)
     , m_targetFps(60)
     , m_currFps(60.0f)
+    , m_physicsUpdateTime(0.0f)
+    , m_nbSubsteps(1)
+    , m_isAutoSubstepsEnabled(false)
+    , m_isQualityControlEnabled(false)
     , m_init(false)
 {
   LOG_INFO("Starting RealTimeParticles");
 
-  if (!initWindow())
+  if (m_options.isHeadless)
+  {
+    if (!initHeadlessContext())
+    {
+      LOG_ERROR("Failed to initialize headless OpenGL context");
+      return;
+    }
+  }
+  else if (!initWindow())
   {
     LOG_ERROR("Failed to initialize application window");
     return;
@@ -213,24 +236,35 @@ ParticleSystemApp::ParticleSystemApp()
     return;
   }
 
-  if (!initGraphicsWidget())
+  if (!m_options.isHeadless && !initGraphicsWidget())
   {
     LOG_ERROR("Failed to initialize graphics widget");
     return;
   }
 
+  // Selected model waiting for its own programs only, other ones being ready by the time they are selected
+  if (!m_options.isHeadless)
+    prebuildPrograms();
+
   if (!initPhysicsEngine())
   {
     LOG_ERROR("Failed to initialize physics engine");
     return;
   }
 
-  if (!initPhysicsWidget())
+  if (!m_options.isHeadless && !initPhysicsWidget())
   {
     LOG_ERROR("Failed to initialize physics widget");
     return;
   }
 
+  // Headless capture keeps stepping and drawing in lockstep, no frame being skipped
+  if (!m_options.isHeadless && !initSimulationThread())
+  {
+    LOG_ERROR("Failed to initialize simulation thread");
+    return;
+  }
+
   LOG_INFO("RealTimeParticles initialization successful");
 
   m_init = true;
@@ -243,21 +277,30 @@ ParticleSystemApp::~ParticleSystemApp()
 
 bool ParticleSystemApp::initGraphicsEngine()
 {
+  // Same box and grid than the physics engine
+  const auto domainParams = Physics::DomainParams(m_modelType);
+
   Render::EngineParams params;
-  params.maxNbParticles = Utils::ALL_NB_PARTICLES.crbegin()->first;
-  params.boxSize = Geometry::BOX_SIZE_3D;
-  params.gridRes = Geometry::GRID_RES_3D;
+  params.maxNbParticles = domainParams.maxNbParticles;
+  params.boxSize = domainParams.boxSize;
+  params.gridRes = domainParams.gridRes;
   params.aspectRatio = (float)m_windowSize.x / m_windowSize.y;
   params.dimension = (m_graphicsEngine.get() != nullptr) ? m_graphicsEngine->dimension() : Geometry::Dimension::dim2D;
 
   if (m_modelType == Physics::ModelType::CLOUDS)
   {
-    params.boxSize.y *= 2;
-    params.gridRes.y *= 2;
+    params.colormap = Render::Colormap::GRAYSCALE;
+    params.isVolumeRenderingSupported = true;
+  }
+  else if (m_modelType == Physics::ModelType::FLUIDS)
+  {
+    params.colormap = Render::Colormap::FLUIDS;
+    params.isFluidSurfaceSupported = true;
   }
   else if (m_modelType == Physics::ModelType::BOIDS)
   {
     params.pointSize = 2;
+    params.colormap = Render::Colormap::BOIDS;
   }
 
   m_graphicsEngine = std::make_unique<Render::Engine>(params);
@@ -272,17 +315,32 @@ bool ParticleSystemApp::initGraphicsWidget()
   return (m_graphicsWidget.get() != nullptr);
 }
 
+void ParticleSystemApp::prebuildPrograms()
+{
+  for (const auto& [modelType, modelName] : Physics::ALL_MODELS)
+  {
+    // Programs shared by several models, e.g radix sort, are only built once
+    for (const auto& [programName, isBuilt] : Physics::PrebuildPrograms(modelType, Physics::DomainParams(modelType)))
+      m_programBuilds[programName] = isBuilt;
+  }
+}
+
 bool ParticleSystemApp::initPhysicsEngine()
 {
-  Physics::ModelParams params;
-  params.maxNbParticles = Utils::ALL_NB_PARTICLES.crbegin()->first;
-  params.boxSize = Geometry::BOX_SIZE_3D;
-  params.gridRes = Geometry::GRID_RES_3D;
+  Physics::ModelParams params = Physics::DomainParams(m_modelType);
   params.velocity = 1.0f;
-  params.particlePosVBO = (unsigned int)m_graphicsEngine->pointCloudCoordVBO();
-  params.particleColVBO = (unsigned int)m_graphicsEngine->pointCloudColorVBO();
-  params.cameraVBO = (unsigned int)m_graphicsEngine->cameraCoordVBO();
-  params.gridVBO = (unsigned int)m_graphicsEngine->gridDetectorVBO();
+  for (size_t slot = 0; slot < Render::Engine::NB_RENDER_SLOTS; ++slot)
+  {
+    Physics::ParticleRenderSlot renderSlot;
+    renderSlot.posVBO = (unsigned int)m_graphicsEngine->pointCloudCoordVBO(slot);
+    renderSlot.prevPosVBO = (unsigned int)m_graphicsEngine->pointCloudPrevCoordVBO(slot);
+    renderSlot.colVBO = (unsigned int)m_graphicsEngine->pointCloudColorVBO(slot);
+    renderSlot.quantizedPosVBO = (unsigned int)m_graphicsEngine->pointCloudQuantizedCoordVBO(slot);
+    renderSlot.indexVBO = (unsigned int)m_graphicsEngine->pointCloudIndexEBO(slot);
+    renderSlot.gridDetectorVBO = (unsigned int)m_graphicsEngine->gridDetectorVBO(slot);
+    renderSlot.densityVolumeVBO = (unsigned int)m_graphicsEngine->densityVolumePBO(slot);
+    params.particleRenderSlots.push_back(renderSlot);
+  }
   params.dimension = m_graphicsEngine->dimension();
 
   switch (m_modelType)
@@ -300,8 +358,6 @@ bool ParticleSystemApp::initPhysicsEngine()
   case Physics::CLOUDS:
   {
     params.pCase = Utils::PhysicsCase::CLOUDS_CUMULUS;
-    params.boxSize.y *= 2;
-    params.gridRes.y *= 2;
     break;
   }
   }
@@ -319,14 +375,199 @@ bool ParticleSystemApp::initPhysicsEngine()
 
 bool ParticleSystemApp::initPhysicsWidget()
 {
-  m_physicsWidget = std::make_unique<UI::PhysicsWidget>(m_physicsEngine);
+  m_physicsWidget = std::make_unique<UI::PhysicsWidget>(m_physicsEngine, [this](Physics::ModelCommand command) { pushCommand(std::move(command)); });
 
   return (m_physicsWidget.get() != nullptr);
 }
 
+bool ParticleSystemApp::initSimulationThread()
+{
+  static_assert(Render::Engine::NB_RENDER_SLOTS == 3, "Simulation thread exchanges render slots through a triple buffer");
+
+  m_simulationThread = std::make_unique<SimulationThread>(m_physicsEngine);
+  m_simulationThread->setTargetFps(m_targetFps);
+
+  // Nothing to draw until the first step is completed
+  m_graphicsEngine->setNbParticles(0);
+  m_graphicsEngine->setNbVisibleParticles(0);
+  m_graphicsEngine->setQuantizedPosPublished(false);
+  m_graphicsEngine->presentRenderSlot(m_simulationThread->drawnSlot());
+  m_drawnFrame = SimulationFrame();
+
+  m_simulationThread->start();
+
+  return (m_simulationThread.get() != nullptr);
+}
+
+bool ParticleSystemApp::switchPhysicalModel()
+{
+  m_isModelSwitchRequested = false;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  // No more OpenCL work in flight before recreating engines
+  m_simulationThread.reset();
+
+  if (!initGraphicsEngine())
+  {
+    LOG_ERROR("Failed to reset graphics engine");
+    return false;
+  }
+
+  if (!initGraphicsWidget())
+  {
+    LOG_ERROR("Failed to reset graphics widget");
+    return false;
+  }
+
+  if (!initPhysicsEngine())
+  {
+    LOG_ERROR("Failed to reset physics engine");
+    return false;
+  }
+
+  if (!initPhysicsWidget())
+  {
+    LOG_ERROR("Failed to reset physics widget");
+    return false;
+  }
+
+  if (!initSimulationThread())
+  {
+    LOG_ERROR("Failed to reset simulation thread");
+    return false;
+  }
+
+  // Much faster once the model has already been used, its programs and buffers being cached by the OpenCL context
+  const float switchTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+  LOG_INFO("Application correctly switched to {} in {:.0f} ms", Physics::ALL_MODELS.find(m_modelType)->second, switchTimeMs);
+
+  return true;
+}
+
+void ParticleSystemApp::pushCommand(Physics::ModelCommand command)
+{
+  if (m_simulationThread)
+    m_simulationThread->pushCommand(std::move(command));
+  else
+    command(*m_physicsEngine);
+}
+
+void ParticleSystemApp::syncSimulationThread()
+{
+  m_simulationThread->setTargetFps(m_targetFps);
+  m_simulationThread->enableAutoSubsteps(m_isAutoSubstepsEnabled);
+  m_simulationThread->enableQualityControl(m_isQualityControlEnabled);
+  m_simulationThread->setQualityBounds(m_qualityBounds);
+  if (!m_isAutoSubstepsEnabled && !m_isQualityControlEnabled)
+    m_simulationThread->setNbSubsteps(m_nbSubsteps);
+
+  RenderState renderState;
+  renderState.isFrustumCullingEnabled = m_graphicsEngine->isFrustumCullingEnabled();
+  renderState.isPosQuantizationEnabled = m_graphicsEngine->isPosQuantizationNeeded();
+  renderState.isVolumeRenderingEnabled = m_graphicsEngine->isVolumeRenderingEnabled();
+  renderState.isCameraSortEnabled = m_graphicsEngine->isCameraSortNeeded();
+  renderState.isInterpolationEnabled = m_graphicsEngine->isInterpolationEnabled();
+  renderState.cameraProjView = m_graphicsEngine->cameraProjViewMat();
+  renderState.cameraPos = m_graphicsEngine->cameraPos();
+  m_simulationThread->setRenderState(renderState);
+
+  m_currFps = m_simulationThread->currentFps();
+  m_physicsUpdateTime = m_simulationThread->stepTime();
+
+  if (m_simulationThread->hasNewFrame())
+  {
+    // Drawn slot handed back to OpenCL, OpenGL must be done with it
+    m_graphicsEngine->releaseRenderSlot(m_simulationThread->drawnSlot());
+
+    m_drawnFrame = m_simulationThread->swapFrame();
+
+    m_graphicsEngine->setNbParticles((int)m_drawnFrame.nbParticles);
+    m_graphicsEngine->setNbVisibleParticles((int)m_drawnFrame.nbVisibleParticles);
+    m_graphicsEngine->setQuantizedPosPublished(m_drawnFrame.isPosQuantized);
+    m_graphicsEngine->presentRenderSlot(m_drawnFrame.renderSlot);
+    m_graphicsEngine->setTargetVisibility(m_drawnFrame.isTargetVisible);
+    m_graphicsEngine->setTargetPos(m_drawnFrame.targetPos);
+  }
+
+  // Render frames between two physics steps moving particles smoothly instead of repeating the same state
+  m_graphicsEngine->setInterpolationFactor(SimulationThread::interpolationFactor(m_drawnFrame));
+}
+
+void ParticleSystemApp::updatePhysicsEngine()
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  m_physicsEngine->enableFrustumCulling(m_graphicsEngine->isFrustumCullingEnabled());
+  m_physicsEngine->enablePosQuantization(m_graphicsEngine->isPosQuantizationNeeded());
+  m_physicsEngine->enableVolumeRendering(m_graphicsEngine->isVolumeRenderingEnabled());
+  m_physicsEngine->enableCameraSort(m_graphicsEngine->isCameraSortNeeded());
+  m_physicsEngine->setCameraState(m_graphicsEngine->cameraProjViewMat(), m_graphicsEngine->cameraPos());
+  m_physicsEngine->setNbSubsteps(m_options.nbSubsteps);
+
+  const size_t renderSlot = m_graphicsEngine->acquireRenderSlot();
+  m_physicsEngine->setRenderSlot(renderSlot);
+  m_physicsEngine->update();
+  m_physicsEngine->finishRenderSlot();
+
+  const auto updateTime = std::chrono::steady_clock::now() - start;
+  m_physicsUpdateTime = std::chrono::duration<float, std::milli>(updateTime).count();
+
+  m_graphicsEngine->setNbParticles((int)m_physicsEngine->nbParticles());
+  m_graphicsEngine->setNbVisibleParticles((int)m_physicsEngine->nbVisibleParticles());
+  m_graphicsEngine->setQuantizedPosPublished(m_physicsEngine->isPosQuantizationEnabled());
+  m_graphicsEngine->presentRenderSlot(renderSlot);
+  m_graphicsEngine->setTargetVisibility(m_physicsEngine->isTargetVisible());
+  m_graphicsEngine->setTargetPos(m_physicsEngine->targetPos());
+
+  if (m_physicsEngine->cbeginDisplayablePhysicalQuantities() != m_physicsEngine->cendDisplayablePhysicalQuantities())
+    m_graphicsEngine->setColorRange(m_physicsEngine->currentDisplayedPhysicalQuantity().userRange);
+}
+
+void ParticleSystemApp::runHeadless()
+{
+  if (!m_physicsEngine->isInit())
+  {
+    LOG_ERROR("The application needs OpenCL 1.2 or more recent to run");
+    return;
+  }
+
+  m_frameCapture = std::make_unique<Render::FrameCapture>(m_options.capture);
+  if (!m_frameCapture->isInit())
+    return;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  // No target framerate, physics and rendering run as fast as possible
+  for (size_t frame = 0; frame < m_options.nbCapturedFrames; ++frame)
+  {
+    updatePhysicsEngine();
+
+    m_frameCapture->beginFrame();
+
+    glClearColor(m_backGroundColor.x, m_backGroundColor.y, m_backGroundColor.z, m_backGroundColor.w);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    m_graphicsEngine->draw();
+
+    m_frameCapture->endFrame();
+  }
+
+  m_frameCapture->finish();
+
+  const auto timeSpent = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  LOG_INFO("Headless run done, {} frames in {:.2f} s ({:.1f} fps)", m_options.nbCapturedFrames, timeSpent, m_options.nbCapturedFrames / timeSpent);
+
+  m_frameCapture.reset();
+}
+
 void ParticleSystemApp::run()
 {
-  auto start = std::chrono::steady_clock::now();
+  if (m_options.isHeadless)
+  {
+    runHeadless();
+    return;
+  }
 
   bool stopRendering = false;
   while (!stopRendering)
@@ -339,21 +580,32 @@ void ParticleSystemApp::run()
     ImGui_ImplSDL2_NewFrame(m_window);
     ImGui::NewFrame();
 
-    static bool noted = false;
-    if (!noted && m_physicsEngine->isUsingIGPU())
     {
-      noted = popUpMessage("Warning", "The application is currently running on your integrated GPU. It will perform better on your dedicated GPU (NVIDIA/AMD).");
-    }
+      // Model state read by widgets must not be modified meanwhile by the simulation thread
+      auto modelLock = m_simulationThread->lockModel();
 
-    if (!m_physicsEngine->isInit())
-    {
-      stopRendering = popUpMessage("Error", "The application needs OpenCL 1.2 or more recent to run.");
-    }
+      static bool noted = false;
+      if (!noted && m_physicsEngine->isUsingIGPU())
+      {
+        noted = popUpMessage("Warning", "The application is currently running on your integrated GPU. It will perform better on your dedicated GPU (NVIDIA/AMD).");
+      }
+
+      if (!m_physicsEngine->isInit())
+      {
+        stopRendering = popUpMessage("Error", "The application needs OpenCL 1.2 or more recent to run.");
+      }
 
-    displayMainWidget();
+      displayMainWidget();
 
-    m_graphicsWidget->display();
-    m_physicsWidget->display();
+      m_graphicsWidget->display();
+      m_physicsWidget->display();
+
+      if (m_physicsEngine->cbeginDisplayablePhysicalQuantities() != m_physicsEngine->cendDisplayablePhysicalQuantities())
+        m_graphicsEngine->setColorRange(m_physicsEngine->currentDisplayedPhysicalQuantity().userRange);
+    }
+
+    if (m_isModelSwitchRequested && !switchPhysicalModel())
+      stopRendering = true;
 
     ImGuiIO& io = ImGui::GetIO();
 
@@ -367,30 +619,22 @@ void ParticleSystemApp::run()
     glClearColor(m_backGroundColor.x, m_backGroundColor.y, m_backGroundColor.z, m_backGroundColor.w);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Slowing down physics engine if target fps is lower than current fps
-    auto now = std::chrono::steady_clock::now();
-    auto timeSpent = now - start;
-    if (timeSpent > std::chrono::milliseconds(1000 / m_targetFps))
-    {
-      m_currFps = 1000.0f / std::chrono::duration_cast<std::chrono::milliseconds>(timeSpent).count();
-
-      m_physicsEngine->update();
-
-      m_graphicsEngine->setNbParticles((int)m_physicsEngine->nbParticles());
-      m_graphicsEngine->setTargetVisibility(m_physicsEngine->isTargetVisible());
-      m_graphicsEngine->setTargetPos(m_physicsEngine->targetPos());
-
-      start = now;
-    }
+    // Latest step completed by the simulation thread, if any, otherwise drawing the previous one again
+    syncSimulationThread();
 
     m_graphicsEngine->draw();
 
     ImGui::Render();
 
+    m_graphicsEngine->beginPass(Render::PASS_UI);
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    m_graphicsEngine->endPass(Render::PASS_UI);
+
     SDL_GL_SwapWindow(m_window);
   }
 
+  m_simulationThread.reset();
+
   closeWindow();
 }
 
@@ -414,20 +658,21 @@ void ParticleSystemApp::displayMainWidget()
   std::string pauseRun = isOnPaused ? "  Start  " : "  Pause  ";
   if (ImGui::Button(pauseRun.c_str()))
   {
-    m_physicsEngine->pause(!isOnPaused);
+    pushCommand([isOnPaused](Physics::Model& model) { model.pause(!isOnPaused); });
   }
 
   ImGui::SameLine();
 
   if (ImGui::Button("  Reset  "))
   {
-    m_physicsEngine->reset();
+    pushCommand([](Physics::Model& model) { model.reset(); });
   }
 
   bool isSystemDim2D = (m_physicsEngine->dimension() == Geometry::Dimension::dim2D);
   if (ImGui::Checkbox("2D", &isSystemDim2D))
   {
-    m_physicsEngine->setDimension(isSystemDim2D ? Geometry::Dimension::dim2D : Geometry::Dimension::dim3D);
+    const auto dim = isSystemDim2D ? Geometry::Dimension::dim2D : Geometry::Dimension::dim3D;
+    pushCommand([dim](Physics::Model& model) { model.setDimension(dim); });
     m_graphicsEngine->setDimension(isSystemDim2D ? Geometry::Dimension::dim2D : Geometry::Dimension::dim3D);
   }
 
@@ -436,7 +681,8 @@ void ParticleSystemApp::displayMainWidget()
   bool isSystemDim3D = (m_physicsEngine->dimension() == Geometry::Dimension::dim3D);
   if (ImGui::Checkbox("3D", &isSystemDim3D))
   {
-    m_physicsEngine->setDimension(isSystemDim3D ? Geometry::Dimension::dim3D : Geometry::Dimension::dim2D);
+    const auto dim = isSystemDim3D ? Geometry::Dimension::dim3D : Geometry::Dimension::dim2D;
+    pushCommand([dim](Physics::Model& model) { model.setDimension(dim); });
     m_graphicsEngine->setDimension(isSystemDim3D ? Geometry::Dimension::dim3D : Geometry::Dimension::dim2D);
   }
 
@@ -468,14 +714,58 @@ void ParticleSystemApp::displayMainWidget()
 
   ImGui::SliderInt("Target FPS", &m_targetFps, 1, 60);
 
-  ImGui::Text(" %.3f ms/frame (%.1f FPS) ", 1000.0f / m_currFps, m_currFps);
+  // Guaranteed frame rate for live demos, substeps, vorticity, Jacobi iterations and particles lowered if needed
+  ImGui::Checkbox(" Adaptive Quality ", &m_isQualityControlEnabled);
+  if (m_isQualityControlEnabled)
+  {
+    ImGui::SameLine();
+    ImGui::Text(" level -%d ", m_simulationThread ? m_simulationThread->qualityDegradationLevel() : 0);
+
+    int substepsRange[2] = { m_qualityBounds.minNbSubsteps, m_qualityBounds.maxNbSubsteps };
+    if (ImGui::SliderInt2("Substeps range", substepsRange, 1, SimulationThread::MAX_NB_SUBSTEPS))
+    {
+      m_qualityBounds.minNbSubsteps = std::min(substepsRange[0], substepsRange[1]);
+      m_qualityBounds.maxNbSubsteps = std::max(substepsRange[0], substepsRange[1]);
+    }
+    ImGui::SliderInt("Min Jacobi Iterations", &m_qualityBounds.minNbJacobiIters, 1, 6);
+    ImGui::Checkbox(" Drop Vorticity ", &m_qualityBounds.isVorticityDroppable);
+    ImGui::SliderFloat("Min Particles", &m_qualityBounds.minParticleFraction, 0.1f, 1.0f, "%.2f");
+    ImGui::Text(" %d substeps per frame ", m_simulationThread ? m_simulationThread->nbSubsteps() : 1);
+  }
+  else
+  {
+    ImGui::Checkbox(" Auto Substeps ", &m_isAutoSubstepsEnabled);
+    if (m_isAutoSubstepsEnabled)
+    {
+      ImGui::SameLine();
+      ImGui::Text(" %d per frame ", m_simulationThread ? m_simulationThread->nbSubsteps() : 1);
+    }
+    else
+    {
+      ImGui::SliderInt("Substeps", &m_nbSubsteps, 1, SimulationThread::MAX_NB_SUBSTEPS);
+    }
+  }
+
+  ImGui::Text(" %.3f ms/frame (%.1f FPS) ", 1000.0f / std::max(m_currFps, 0.001f), m_currFps);
+  ImGui::Text(" UI %.1f FPS ", ImGui::GetIO().Framerate);
+
+  if (ImGui::TreeNode(" Frame Time Breakdown "))
+  {
+    ImGui::Text(" Physics update  CPU %.3f ms ", m_physicsUpdateTime);
+    for (int pass = 0; pass < Render::NB_RENDER_PASSES; ++pass)
+    {
+      const auto& timings = m_graphicsEngine->passTimings((Render::RenderPass)pass);
+      ImGui::Text(" %-14s  CPU %.3f ms  GPU %.3f ms ", Render::Engine::passName((Render::RenderPass)pass), timings.cpuTime, timings.gpuTime);
+    }
+    ImGui::TreePop();
+  }
 
 // Apple is not very OpenCL friendly
 #ifndef __APPLE__
   bool isProfiling = m_physicsEngine->isProfilingEnabled();
   if (ImGui::Checkbox(" GPU Solver Profiling ", &isProfiling))
   {
-    m_physicsEngine->enableProfiling(isProfiling);
+    pushCommand([isProfiling](Physics::Model& model) { model.enableProfiling(isProfiling); });
   }
 #endif
 
@@ -495,38 +785,20 @@ bool ParticleSystemApp::selectPhysicalModel()
     {
       if (ImGui::Selectable(model.second.c_str(), m_modelType == model.first))
       {
+        // Engines are recreated once widgets are drawn, simulation thread being stopped first
         m_modelType = model.first;
-
-        if (!initGraphicsEngine())
-        {
-          LOG_ERROR("Failed to reset graphics engine");
-          return false;
-        }
-
-        if (!initGraphicsWidget())
-        {
-          LOG_ERROR("Failed to reset graphics widget");
-          return false;
-        }
-
-        if (!initPhysicsEngine())
-        {
-          LOG_ERROR("Failed to reset physics engine");
-          return false;
-        }
-
-        if (!initPhysicsWidget())
-        {
-          LOG_ERROR("Failed to reset physics widget");
-          return false;
-        }
-
-        LOG_INFO("Application correctly switched to {}", Physics::ALL_MODELS.find(m_modelType)->second);
+        m_isModelSwitchRequested = true;
       }
     }
     ImGui::EndCombo();
   }
 
+  // Background builds progress, switching to a model whose programs are still building waits for them
+  const size_t nbBuiltPrograms = (size_t)std::count_if(m_programBuilds.cbegin(), m_programBuilds.cend(),
+      [](const auto& build) { return build.second.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+  if (nbBuiltPrograms < m_programBuilds.size())
+    ImGui::Text("Building programs %d/%d", (int)nbBuiltPrograms, (int)m_programBuilds.size());
+
   return true;
 }
 
@@ -573,8 +845,10 @@ void ParticleSystemApp::selectPhysicalCase()
       {
         selectedCaseType = caseType;
 
-        m_physicsEngine->setCase(selectedCaseType);
-        m_physicsEngine->reset();
+        pushCommand([caseType](Physics::Model& model) {
+          model.setCase(caseType);
+          model.reset();
+        });
       }
     }
     ImGui::EndCombo();
@@ -594,7 +868,8 @@ void ParticleSystemApp::selectPhysicalQuantity()
       {
         if (ImGui::Selectable(it->first.c_str(), selDisplayedQuantityName == it->first))
         {
-          m_physicsEngine->setCurrentDisplayedQuantity(it->first);
+          const std::string quantityName = it->first;
+          pushCommand([quantityName](Physics::Model& model) { model.setCurrentDisplayedQuantity(quantityName); });
 
           LOG_INFO("Visible physics quantity switched to {}", it->first);
         }
@@ -638,11 +913,69 @@ bool ParticleSystemApp::popUpMessage(const std::string& title, const std::string
 
 } // End namespace App
 
-int main(int, char**)
+namespace
+{
+// --headless [--model fluids|boids|clouds] [--frames N] [--substeps N] [--size WxH] [--fps N] [--output file.y4m|file.raw] [--sph-lut]
+App::AppOptions ParseOptions(int argc, char** argv)
+{
+  App::AppOptions options;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    const bool hasValue = (i + 1 < argc);
+
+    if (arg == "--headless")
+      options.isHeadless = true;
+    else if (arg == "--model" && hasValue)
+    {
+      const std::string model = argv[++i];
+      if (model == "boids")
+        options.modelType = Physics::ModelType::BOIDS;
+      else if (model == "clouds")
+        options.modelType = Physics::ModelType::CLOUDS;
+      else
+        options.modelType = Physics::ModelType::FLUIDS;
+    }
+    else if (arg == "--frames" && hasValue)
+      options.nbCapturedFrames = (size_t)std::stoul(argv[++i]);
+    else if (arg == "--size" && hasValue)
+    {
+      const std::string size = argv[++i];
+      const size_t sep = size.find('x');
+      if (sep != std::string::npos)
+        options.capture.size = Math::int2(std::stoi(size.substr(0, sep)), std::stoi(size.substr(sep + 1)));
+    }
+    else if (arg == "--substeps" && hasValue)
+      options.nbSubsteps = (size_t)std::stoul(argv[++i]);
+    else if (arg == "--fps" && hasValue)
+      options.capture.fps = std::stoi(argv[++i]);
+    else if (arg == "--output" && hasValue)
+    {
+      options.capture.filePath = argv[++i];
+      const bool isY4M = options.capture.filePath.size() > 4 && options.capture.filePath.substr(options.capture.filePath.size() - 4) == ".y4m";
+      options.capture.format = isY4M ? Render::CaptureFormat::Y4M : Render::CaptureFormat::RAW;
+    }
+    else if (arg == "--sph-lut")
+      options.isSphLutEnabled = true;
+    else
+      LOG_ERROR("Ignoring unknown argument {}", arg);
+  }
+
+  return options;
+}
+}
+
+int main(int argc, char** argv)
 {
   Utils::InitializeLogger();
 
-  App::ParticleSystemApp app;
+  const App::AppOptions options = ParseOptions(argc, argv);
+
+  // Selected before programs are built, in the background from app initialization
+  Physics::SelectSphKernelEval(options.isSphLutEnabled ? Physics::SphKernelEval::LOOKUP_TABLE : Physics::SphKernelEval::ANALYTIC);
+
+  App::ParticleSystemApp app(options);
 
   if (app.isInit())
   {
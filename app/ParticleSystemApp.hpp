@@ -2,30 +2,50 @@
 #pragma once
 
 #include "Engine.hpp"
+#include "FrameCapture.hpp"
 #include "GraphicsWidget.hpp"
+#include "HeadlessContext.hpp"
 #include "Math.hpp"
 #include "Model.hpp"
 #include "Parameters.hpp"
 #include "PhysicsWidget.hpp"
+#include "SimulationThread.hpp"
 #include <SDL.h>
 #include <imgui.h>
 
 namespace App
 {
+struct AppOptions
+{
+  Physics::ModelType modelType = Physics::ModelType::FLUIDS;
+  // No window nor UI, frames rendered offscreen and captured at full simulation speed
+  bool isHeadless = false;
+  size_t nbCapturedFrames = 600;
+  // Solver steps per captured frame
+  size_t nbSubsteps = 1;
+  Render::FrameCaptureParams capture;
+  // SPH kernels read from radial lookup tables instead of being evaluated analytically
+  bool isSphLutEnabled = false;
+};
+
 class ParticleSystemApp
 {
   public:
-  ParticleSystemApp();
+  ParticleSystemApp(AppOptions options = AppOptions());
   ~ParticleSystemApp();
   void run();
   bool isInit() const { return m_init; }
 
   private:
   bool initWindow();
+  bool initHeadlessContext();
   bool initGraphicsEngine();
+  void prebuildPrograms();
   bool initPhysicsEngine();
   bool initPhysicsWidget();
   bool initGraphicsWidget();
+  bool initSimulationThread();
+  bool switchPhysicalModel();
   bool closeWindow();
   bool checkSDLStatus();
   void checkMouseState();
@@ -34,11 +54,27 @@ class ParticleSystemApp
   bool selectPhysicalModel();
   void selectPhysicalCase();
   void selectPhysicalQuantity();
+  void updatePhysicsEngine();
+  void syncSimulationThread();
+  void pushCommand(Physics::ModelCommand command);
+  void runHeadless();
+
+  AppOptions m_options;
+
+  // Declared first to outlive graphics resources
+  std::unique_ptr<HeadlessContext> m_headlessContext;
+  std::unique_ptr<Render::FrameCapture> m_frameCapture;
 
   std::shared_ptr<Physics::Model> m_physicsEngine;
+  // Background builds of all models programs started with the application, per program name
+  std::map<std::string, std::shared_future<bool>> m_programBuilds;
   std::unique_ptr<Render::Engine> m_graphicsEngine;
   std::unique_ptr<UI::PhysicsWidget> m_physicsWidget;
   std::unique_ptr<UI::GraphicsWidget> m_graphicsWidget;
+  // Declared last to stop stepping before engines are destroyed
+  std::unique_ptr<SimulationThread> m_simulationThread;
+  // Frame currently drawn, interpolated up to the next one
+  SimulationFrame m_drawnFrame;
 
   SDL_Window* m_window;
   SDL_GLContext m_OGLContext;
@@ -47,13 +83,22 @@ class ParticleSystemApp
 
   // Type of physics model currently selected
   Physics::ModelType m_modelType;
+  // Engines switched outside of UI drawing, model mutex being held by then
+  bool m_isModelSwitchRequested;
 
   // FPS (Frame per second or framerate)
   // User-defined target framerate
   int m_targetFps;
-  // Real framerate
-  // can be lower than target depending on the physics simulation cost
+  // Real physics framerate
+  // can be lower than target depending on the physics simulation cost, UI framerate is not affected
   float m_currFps;
+  // CPU time spent in last physics update, in ms
+  float m_physicsUpdateTime;
+  // Solver steps per physics update, fixed or filling the target frame time
+  int m_nbSubsteps;
+  bool m_isAutoSubstepsEnabled;
+  bool m_isQualityControlEnabled;
+  QualityBounds m_qualityBounds;
 
   Math::int2 m_windowSize;
   Math::int2 m_mousePrevPos;
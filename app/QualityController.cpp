@@ -0,0 +1,207 @@
+#include "QualityController.hpp"
+
+#include "Logging.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+// Same parameters for Fluids and Clouds input json, absent from Boids one
+const std::string JACOBI_ITERS_PATH = "/Fluids/Nb Jacobi Iterations";
+const std::string VORTICITY_PATH = "/Fluids/Vorticity Confinement/Enable##Vorticity";
+
+// Hysteresis on the target step time, upgrading only with enough headroom to absorb the upgrade cost
+constexpr float DEGRADE_RATIO = 0.95f;
+constexpr float UPGRADE_RATIO = 0.65f;
+constexpr size_t DEGRADE_COOLDOWN = 20;
+constexpr size_t UPGRADE_COOLDOWN = 60;
+}
+
+namespace App
+{
+QualityController::QualityController()
+    : m_baseNbParticles(0)
+    , m_baseNbJacobiIters(0)
+    , m_baseIsVorticityEnabled(false)
+    , m_hasJacobiIters(false)
+    , m_hasVorticity(false)
+    , m_jacobiItersIndex(Physics::ParameterStore::INVALID_INDEX)
+    , m_vorticityIndex(Physics::ParameterStore::INVALID_INDEX)
+    , m_nbSubsteps(1)
+    , m_nbParticles(0)
+    , m_nbJacobiIters(0)
+    , m_isVorticityEnabled(false)
+    , m_stepTime(0.0f)
+    , m_nbStepsSinceChange(0)
+{
+}
+
+void QualityController::start(Physics::Model& model, int nbSubsteps)
+{
+  m_nbSubsteps = std::clamp(nbSubsteps, m_bounds.minNbSubsteps, m_bounds.maxNbSubsteps);
+  m_stepTime = 0.0f;
+  m_nbStepsSinceChange = 0;
+
+  captureBaseline(model);
+
+  LOG_INFO("Adaptive quality started");
+}
+
+void QualityController::stop(Physics::Model& model)
+{
+  if (isBaselineOutdated(model))
+    return;
+
+  if (m_nbParticles != m_baseNbParticles)
+    model.setNbParticles(m_baseNbParticles);
+  if (m_hasJacobiIters && m_nbJacobiIters != m_baseNbJacobiIters)
+    applyNbJacobiIters(model, m_baseNbJacobiIters);
+  if (m_hasVorticity && m_isVorticityEnabled != m_baseIsVorticityEnabled)
+    applyVorticity(model, m_baseIsVorticityEnabled);
+
+  LOG_INFO("Adaptive quality stopped, user settings restored");
+}
+
+void QualityController::captureBaseline(Physics::Model& model)
+{
+  const auto& parameters = model.parameters();
+
+  m_jacobiItersIndex = parameters.index(JACOBI_ITERS_PATH);
+  m_vorticityIndex = parameters.index(VORTICITY_PATH);
+  m_hasJacobiIters = (m_jacobiItersIndex != Physics::ParameterStore::INVALID_INDEX);
+  m_hasVorticity = (m_vorticityIndex != Physics::ParameterStore::INVALID_INDEX);
+
+  m_baseNbParticles = model.nbParticles();
+  m_baseNbJacobiIters = m_hasJacobiIters ? parameters.at(m_jacobiItersIndex).intValue : 0;
+  m_baseIsVorticityEnabled = m_hasVorticity ? parameters.at(m_vorticityIndex).boolValue : false;
+
+  m_nbParticles = m_baseNbParticles;
+  m_nbJacobiIters = m_baseNbJacobiIters;
+  m_isVorticityEnabled = m_baseIsVorticityEnabled;
+}
+
+bool QualityController::isBaselineOutdated(const Physics::Model& model) const
+{
+  // Case reset or parameter modified through UI since last knob move
+  if (model.nbParticles() != m_nbParticles)
+    return true;
+
+  const auto& parameters = model.parameters();
+  if (m_hasJacobiIters && parameters.at(m_jacobiItersIndex).intValue != m_nbJacobiIters)
+    return true;
+  if (m_hasVorticity && parameters.at(m_vorticityIndex).boolValue != m_isVorticityEnabled)
+    return true;
+
+  return false;
+}
+
+int QualityController::degradationLevel() const
+{
+  int level = m_bounds.maxNbSubsteps - m_nbSubsteps;
+  level += m_baseNbJacobiIters - m_nbJacobiIters;
+  level += (m_baseIsVorticityEnabled && !m_isVorticityEnabled) ? 1 : 0;
+  level += (m_nbParticles < m_baseNbParticles) ? 1 : 0;
+  return level;
+}
+
+void QualityController::update(Physics::Model& model, float stepTime, float targetStepTime)
+{
+  if (isBaselineOutdated(model))
+    captureBaseline(model);
+
+  m_stepTime = (m_stepTime > 0.0f) ? 0.9f * m_stepTime + 0.1f * stepTime : stepTime;
+  ++m_nbStepsSinceChange;
+
+  bool isChanged = false;
+  if (m_stepTime > DEGRADE_RATIO * targetStepTime && m_nbStepsSinceChange > DEGRADE_COOLDOWN)
+    isChanged = degrade(model);
+  else if (m_stepTime < UPGRADE_RATIO * targetStepTime && m_nbStepsSinceChange > UPGRADE_COOLDOWN)
+    isChanged = upgrade(model);
+
+  if (isChanged)
+  {
+    m_nbStepsSinceChange = 0;
+    LOG_DEBUG("Adaptive quality: {} substeps, {} Jacobi iterations, vorticity {}, {} particles",
+        m_nbSubsteps, m_nbJacobiIters, m_isVorticityEnabled, m_nbParticles);
+  }
+}
+
+bool QualityController::degrade(Physics::Model& model)
+{
+  if (m_nbSubsteps > m_bounds.minNbSubsteps)
+  {
+    --m_nbSubsteps;
+    return true;
+  }
+
+  if (m_hasVorticity && m_bounds.isVorticityDroppable && m_isVorticityEnabled)
+  {
+    applyVorticity(model, false);
+    return true;
+  }
+
+  if (m_hasJacobiIters && m_nbJacobiIters > std::max(m_bounds.minNbJacobiIters, 1))
+  {
+    applyNbJacobiIters(model, m_nbJacobiIters - 1);
+    return true;
+  }
+
+  // Last resort, particles beyond active count are frozen and hidden until restored, if the model allows it
+  const size_t minNbParticles = std::max<size_t>((size_t)(m_bounds.minParticleFraction * m_baseNbParticles), 1);
+  if (model.isNbParticlesAdjustable() && m_nbParticles > minNbParticles)
+  {
+    m_nbParticles = std::max(minNbParticles, m_nbParticles * 3 / 4);
+    model.setNbParticles(m_nbParticles);
+    return true;
+  }
+
+  return false;
+}
+
+bool QualityController::upgrade(Physics::Model& model)
+{
+  if (m_nbParticles < m_baseNbParticles)
+  {
+    m_nbParticles = std::min(m_baseNbParticles, m_nbParticles * 4 / 3 + 1);
+    model.setNbParticles(m_nbParticles);
+    return true;
+  }
+
+  if (m_hasJacobiIters && m_nbJacobiIters < m_baseNbJacobiIters)
+  {
+    applyNbJacobiIters(model, m_nbJacobiIters + 1);
+    return true;
+  }
+
+  if (m_hasVorticity && m_baseIsVorticityEnabled && !m_isVorticityEnabled)
+  {
+    applyVorticity(model, true);
+    return true;
+  }
+
+  if (m_nbSubsteps < m_bounds.maxNbSubsteps)
+  {
+    ++m_nbSubsteps;
+    return true;
+  }
+
+  return false;
+}
+
+void QualityController::applyNbJacobiIters(Physics::Model& model, int nbJacobiIters)
+{
+  model.parameters().setInt(m_jacobiItersIndex, nbJacobiIters);
+  model.applyParameterChanges();
+
+  m_nbJacobiIters = nbJacobiIters;
+}
+
+void QualityController::applyVorticity(Physics::Model& model, bool isEnabled)
+{
+  model.parameters().setBool(m_vorticityIndex, isEnabled);
+  model.applyParameterChanges();
+
+  m_isVorticityEnabled = isEnabled;
+}
+}
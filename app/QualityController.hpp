@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Model.hpp"
+
+#include <cstddef>
+
+namespace App
+{
+// Fidelity the controller is allowed to trade, upper bounds being the values set by the user
+struct QualityBounds
+{
+  int minNbSubsteps = 1;
+  int maxNbSubsteps = 4;
+  int minNbJacobiIters = 1;
+  bool isVorticityDroppable = true;
+  // Fraction of the particles of the case kept active at worst
+  float minParticleFraction = 0.25f;
+};
+
+// Holding a target step time by trading simulation fidelity, one knob at a time with hysteresis
+// Knobs are degraded from the least to the most visible one: substeps, vorticity confinement and xSPH viscosity,
+// Jacobi iterations, then active particles for models able to restore them, upgrades going the other way round
+// Must run on the thread stepping the model, holding the model mutex
+class QualityController
+{
+  public:
+  QualityController();
+
+  void setBounds(const QualityBounds& bounds) { m_bounds = bounds; }
+
+  // Taking current model settings as the best fidelity to come back to
+  void start(Physics::Model& model, int nbSubsteps);
+  // Restoring the fidelity set by the user
+  void stop(Physics::Model& model);
+
+  // Called after each step, moving one knob at most
+  void update(Physics::Model& model, float stepTime, float targetStepTime);
+
+  int nbSubsteps() const { return m_nbSubsteps; }
+  // Number of knob notches currently degraded
+  int degradationLevel() const;
+
+  private:
+  void captureBaseline(Physics::Model& model);
+  bool isBaselineOutdated(const Physics::Model& model) const;
+
+  bool degrade(Physics::Model& model);
+  bool upgrade(Physics::Model& model);
+
+  void applyNbJacobiIters(Physics::Model& model, int nbJacobiIters);
+  void applyVorticity(Physics::Model& model, bool isEnabled);
+
+  QualityBounds m_bounds;
+
+  // Best fidelity, set by the user or by the physics case
+  size_t m_baseNbParticles;
+  int m_baseNbJacobiIters;
+  bool m_baseIsVorticityEnabled;
+  bool m_hasJacobiIters;
+  bool m_hasVorticity;
+  // Within the model parameter store, same structure as long as the model is not switched
+  size_t m_jacobiItersIndex;
+  size_t m_vorticityIndex;
+
+  // Current fidelity
+  int m_nbSubsteps;
+  size_t m_nbParticles;
+  int m_nbJacobiIters;
+  bool m_isVorticityEnabled;
+
+  // Smoothed step time, in ms
+  float m_stepTime;
+  // Steps since last knob move, letting smoothed step time settle before moving another one
+  size_t m_nbStepsSinceChange;
+};
+}
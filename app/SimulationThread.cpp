@@ -0,0 +1,229 @@
+#include "SimulationThread.hpp"
+
+#include "Logging.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace App
+{
+SimulationThread::SimulationThread(std::shared_ptr<Physics::Model> model)
+    : m_model(model)
+    , m_isRunning(false)
+    , m_writtenSlot(0)
+    , m_latestSlot(1)
+    , m_drawnSlot(2)
+    , m_targetFps(60)
+    , m_currFps(0.0f)
+    , m_stepTime(0.0f)
+    , m_nbSubsteps(1)
+    , m_isAutoSubstepsEnabled(false)
+    , m_substepTime(0.0f)
+    , m_isQualityControlEnabled(false)
+    , m_isQualityControlRunning(false)
+    , m_qualityDegradationLevel(0)
+{
+  // Drawn slot must be valid before the first completed frame
+  m_frames[m_drawnSlot].renderSlot = m_drawnSlot;
+}
+
+SimulationThread::~SimulationThread()
+{
+  stop();
+}
+
+void SimulationThread::start()
+{
+  if (m_isRunning || !m_model)
+    return;
+
+  m_isRunning = true;
+  m_thread = std::thread(&SimulationThread::loop, this);
+
+  LOG_INFO("Simulation thread started");
+}
+
+void SimulationThread::stop()
+{
+  if (!m_isRunning)
+    return;
+
+  m_isRunning = false;
+  if (m_thread.joinable())
+    m_thread.join();
+
+  // Last commands still applied, e.g. a reset right before switching model
+  applyCommands();
+
+  LOG_INFO("Simulation thread stopped");
+}
+
+void SimulationThread::pushCommand(Physics::ModelCommand command)
+{
+  std::lock_guard<std::mutex> lock(m_commandMutex);
+  m_commands.push_back(std::move(command));
+}
+
+void SimulationThread::setRenderState(const RenderState& renderState)
+{
+  std::lock_guard<std::mutex> lock(m_commandMutex);
+  m_renderState = renderState;
+}
+
+void SimulationThread::setQualityBounds(const QualityBounds& bounds)
+{
+  std::lock_guard<std::mutex> lock(m_commandMutex);
+  m_qualityBounds = bounds;
+}
+
+void SimulationThread::applyCommands()
+{
+  std::deque<Physics::ModelCommand> commands;
+  {
+    std::lock_guard<std::mutex> lock(m_commandMutex);
+    commands.swap(m_commands);
+  }
+
+  if (commands.empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(m_modelMutex);
+  for (auto& command : commands)
+    command(*m_model);
+}
+
+SimulationFrame SimulationThread::swapFrame()
+{
+  const size_t latestSlot = m_latestSlot.exchange(m_drawnSlot, std::memory_order_acq_rel);
+  m_drawnSlot = latestSlot & SLOT_INDEX_MASK;
+
+  return m_frames[m_drawnSlot];
+}
+
+float SimulationThread::interpolationFactor(const SimulationFrame& frame)
+{
+  if (!frame.isInterpolated || frame.stepPeriod <= std::chrono::steady_clock::duration::zero())
+    return 1.0f;
+
+  // Drawing one step behind, previous positions at completion time and current ones a step period later
+  const auto elapsed = std::chrono::steady_clock::now() - frame.completionTime;
+  const float factor = std::chrono::duration<float>(elapsed).count() / std::chrono::duration<float>(frame.stepPeriod).count();
+
+  return std::clamp(factor, 0.0f, 1.0f);
+}
+
+void SimulationThread::adaptNbSubsteps()
+{
+  // Keeping some margin in the frame for rendering-only kernels and scheduling jitter
+  const float budget = 0.8f * 1000.0f / std::max((int)m_targetFps, 1);
+
+  // Rendering-only work is included, slightly overestimating substep cost
+  const float substepTime = m_stepTime / m_nbSubsteps;
+  m_substepTime = (m_substepTime > 0.0f) ? 0.9f * m_substepTime + 0.1f * substepTime : substepTime;
+
+  setNbSubsteps((int)(budget / std::max(m_substepTime, 0.001f)));
+}
+
+void SimulationThread::controlQuality()
+{
+  if (!m_isQualityControlEnabled && !m_isQualityControlRunning)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_commandMutex);
+    m_qualityController.setBounds(m_qualityBounds);
+  }
+
+  // Model settings read and modified like commands, UI may be reading them
+  std::lock_guard<std::mutex> lock(m_modelMutex);
+
+  if (m_isQualityControlEnabled != m_isQualityControlRunning)
+  {
+    m_isQualityControlRunning = m_isQualityControlEnabled;
+    if (m_isQualityControlRunning)
+      m_qualityController.start(*m_model, m_nbSubsteps);
+    else
+      m_qualityController.stop(*m_model);
+  }
+
+  if (!m_isQualityControlRunning)
+    return;
+
+  if (!m_model->onPause())
+    m_qualityController.update(*m_model, m_stepTime, 1000.0f / std::max((int)m_targetFps, 1));
+
+  m_nbSubsteps = m_qualityController.nbSubsteps();
+  m_qualityDegradationLevel = m_qualityController.degradationLevel();
+}
+
+void SimulationThread::loop()
+{
+  // Commands of other threads enqueued before starting are finished first
+  if (!Physics::CreateThreadQueue())
+    LOG_ERROR("Cannot create simulation thread queue, using the default one");
+
+  auto nextStep = std::chrono::steady_clock::now();
+  auto prevStep = nextStep;
+
+  while (m_isRunning)
+  {
+    applyCommands();
+
+    RenderState renderState;
+    {
+      std::lock_guard<std::mutex> lock(m_commandMutex);
+      renderState = m_renderState;
+    }
+
+    m_model->enableFrustumCulling(renderState.isFrustumCullingEnabled);
+    m_model->enablePosQuantization(renderState.isPosQuantizationEnabled);
+    m_model->enableVolumeRendering(renderState.isVolumeRenderingEnabled);
+    m_model->enableCameraSort(renderState.isCameraSortEnabled);
+    m_model->enableInterpolation(renderState.isInterpolationEnabled);
+    m_model->setCameraState(renderState.cameraProjView, renderState.cameraPos);
+    m_model->setRenderSlot(m_writtenSlot);
+    m_model->setNbSubsteps((size_t)m_nbSubsteps);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    m_model->update();
+    // Slot handed back to OpenGL before being published, queue itself not being finished by the update
+    m_model->finishRenderSlot();
+
+    const auto end = std::chrono::steady_clock::now();
+    m_stepTime = std::chrono::duration<float, std::milli>(end - start).count();
+    const auto stepPeriod = end - prevStep;
+    m_currFps = 1000.0f / std::max(std::chrono::duration<float, std::milli>(stepPeriod).count(), 0.001f);
+    prevStep = end;
+
+    controlQuality();
+
+    if (!m_isQualityControlRunning && m_isAutoSubstepsEnabled && !m_model->onPause())
+      adaptNbSubsteps();
+
+    auto& frame = m_frames[m_writtenSlot];
+    frame.renderSlot = m_writtenSlot;
+    frame.nbParticles = m_model->nbParticles();
+    frame.nbVisibleParticles = m_model->nbVisibleParticles();
+    frame.isPosQuantized = m_model->isPosQuantizationEnabled();
+    frame.isTargetVisible = m_model->isTargetVisible();
+    frame.targetPos = m_model->targetPos();
+    frame.isInterpolated = m_model->isInterpolationEnabled();
+    frame.completionTime = end;
+    frame.stepPeriod = stepPeriod;
+
+    // Publishing the completed slot, getting back the previous latest one, never drawn or already released
+    const size_t prevLatestSlot = m_latestSlot.exchange(m_writtenSlot | NEW_FRAME_BIT, std::memory_order_acq_rel);
+    m_writtenSlot = prevLatestSlot & SLOT_INDEX_MASK;
+
+    // Slowing down the simulation if target fps is lower than current one
+    nextStep += std::chrono::microseconds(1000000 / std::max((int)m_targetFps, 1));
+    if (nextStep < end)
+      nextStep = end;
+    std::this_thread::sleep_until(nextStep);
+  }
+
+  // Every command finished before the render thread issues new ones on the default queue
+  Physics::ReleaseThreadQueue();
+}
+}
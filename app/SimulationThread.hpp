@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Math.hpp"
+#include "Model.hpp"
+#include "QualityController.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace App
+{
+// Rendering options and camera state the next steps must follow, latest value wins
+struct RenderState
+{
+  bool isFrustumCullingEnabled = true;
+  bool isPosQuantizationEnabled = false;
+  bool isVolumeRenderingEnabled = false;
+  bool isCameraSortEnabled = true;
+  bool isInterpolationEnabled = false;
+  // Copied by value, OpenGL keeping its own camera state
+  Math::float4x4 cameraProjView;
+  Math::float3 cameraPos = { 0.0f, 0.0f, 0.0f };
+};
+
+// Step completed by the simulation thread, published along with the render slot it filled
+struct SimulationFrame
+{
+  size_t renderSlot = 0;
+  size_t nbParticles = 0;
+  size_t nbVisibleParticles = 0;
+  // Quantized positions filled in the render slot too
+  bool isPosQuantized = false;
+  bool isTargetVisible = false;
+  Math::float3 targetPos = { 0.0f, 0.0f, 0.0f };
+  // Previous positions published in the render slot too
+  bool isInterpolated = false;
+  // Time the step was completed and time elapsed since previous one, for render-side interpolation
+  std::chrono::steady_clock::time_point completionTime;
+  std::chrono::steady_clock::duration stepPeriod = std::chrono::steady_clock::duration::zero();
+};
+
+// Stepping the model on its own thread, the only one issuing OpenCL commands once started, on a queue of its own
+// Model state is only modified on this thread, by update() or by commands applied under the model mutex,
+// UI reading model state must hold this mutex (see lockModel), update() itself runs without it
+// Parameter store is the exception, written by UI under this mutex and applied later by a command
+// Render slots are exchanged with the render thread through a lock-free triple buffer
+class SimulationThread
+{
+  public:
+  explicit SimulationThread(std::shared_ptr<Physics::Model> model);
+  ~SimulationThread();
+
+  void start();
+  void stop();
+
+  void pushCommand(Physics::ModelCommand command);
+  void setRenderState(const RenderState& renderState);
+
+  std::unique_lock<std::mutex> lockModel() { return std::unique_lock<std::mutex>(m_modelMutex); }
+
+  // Throttling steps, the render thread keeping its own pace
+  void setTargetFps(int targetFps) { m_targetFps = targetFps; }
+  float currentFps() const { return m_currFps; }
+  float stepTime() const { return m_stepTime; }
+
+  // Solver steps per published frame, automatically chosen to fill the frame time budget if enabled
+  static constexpr int MAX_NB_SUBSTEPS = 16;
+  void setNbSubsteps(int nbSubsteps) { m_nbSubsteps = std::clamp(nbSubsteps, 1, MAX_NB_SUBSTEPS); }
+  int nbSubsteps() const { return m_nbSubsteps; }
+  void enableAutoSubsteps(bool enable) { m_isAutoSubstepsEnabled = enable; }
+
+  // Trading fidelity within bounds to hold the target frame time, taking over substeps from auto substeps
+  void enableQualityControl(bool enable) { m_isQualityControlEnabled = enable; }
+  void setQualityBounds(const QualityBounds& bounds);
+  int qualityDegradationLevel() const { return m_qualityDegradationLevel; }
+
+  // Render side, true if a new frame has been completed since last swap
+  bool hasNewFrame() const { return (m_latestSlot.load(std::memory_order_acquire) & NEW_FRAME_BIT) != 0; }
+  // Slot currently owned by the render thread
+  size_t drawnSlot() const { return m_drawnSlot; }
+  // Handing the drawn slot back, OpenGL must be done with it, and taking the latest completed frame
+  SimulationFrame swapFrame();
+  // Elapsed fraction of the next step since the frame completion, 1 if frame has no previous positions
+  static float interpolationFactor(const SimulationFrame& frame);
+
+  private:
+  void loop();
+  void applyCommands();
+  void adaptNbSubsteps();
+  void controlQuality();
+
+  static constexpr size_t SLOT_INDEX_MASK = 0x3;
+  static constexpr size_t NEW_FRAME_BIT = 0x4;
+
+  std::shared_ptr<Physics::Model> m_model;
+
+  std::thread m_thread;
+  std::atomic<bool> m_isRunning;
+
+  std::mutex m_modelMutex;
+
+  std::mutex m_commandMutex;
+  std::deque<Physics::ModelCommand> m_commands;
+  RenderState m_renderState;
+
+  // Triple buffer, slot written by simulation, latest completed slot shared through an atomic, slot drawn
+  size_t m_writtenSlot;
+  std::atomic<size_t> m_latestSlot;
+  size_t m_drawnSlot;
+  std::array<SimulationFrame, 3> m_frames;
+
+  std::atomic<int> m_targetFps;
+  std::atomic<float> m_currFps;
+  std::atomic<float> m_stepTime;
+
+  std::atomic<int> m_nbSubsteps;
+  std::atomic<bool> m_isAutoSubstepsEnabled;
+  // Smoothed cost of one solver step, in ms
+  float m_substepTime;
+
+  std::atomic<bool> m_isQualityControlEnabled;
+  bool m_isQualityControlRunning;
+  QualityBounds m_qualityBounds;
+  QualityController m_qualityController;
+  std::atomic<int> m_qualityDegradationLevel;
+};
+}
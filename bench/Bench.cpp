@@ -0,0 +1,35 @@
+#include "Bench.hpp"
+
+std::pair<Utils::PhysicsCase, Utils::PhysicsCase> Bench::CaseRange(Physics::ModelType modelType)
+{
+  switch (modelType)
+  {
+  case Physics::BOIDS:
+    return { Utils::PhysicsCase::BOIDS_BEGIN, Utils::PhysicsCase::BOIDS_END };
+  case Physics::FLUIDS:
+    return { Utils::PhysicsCase::FLUIDS_BEGIN, Utils::PhysicsCase::FLUIDS_END };
+  case Physics::CLOUDS:
+    return { Utils::PhysicsCase::CLOUDS_BEGIN, Utils::PhysicsCase::CLOUDS_END };
+  default:
+    return { Utils::PhysicsCase::CASE_INVALID, Utils::PhysicsCase::CASE_INVALID };
+  }
+}
+
+Physics::ModelParams Bench::BenchModelParams(Physics::ModelType modelType, Utils::PhysicsCase caseType, Geometry::Dimension dim)
+{
+  Physics::ModelParams params = Physics::DomainParams(modelType);
+  params.velocity = 1.0f;
+  params.dimension = dim;
+  params.pCase = caseType;
+
+  return params;
+}
+
+void Bench::DisableRendering(Physics::Model& model)
+{
+  model.enableFrustumCulling(false);
+  model.enablePosQuantization(false);
+  model.enableVolumeRendering(false);
+  model.enableCameraSort(false);
+  model.enableInterpolation(false);
+}
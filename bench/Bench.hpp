@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Geometry.hpp"
+#include "Model.hpp"
+#include "Parameters.hpp"
+
+#include <utility>
+
+namespace Bench
+{
+// Cases of a model lie strictly between its BEGIN and END markers
+std::pair<Utils::PhysicsCase, Utils::PhysicsCase> CaseRange(Physics::ModelType modelType);
+
+// Same box and grid than the application, without render slots so that nothing is published for rendering
+Physics::ModelParams BenchModelParams(Physics::ModelType modelType, Utils::PhysicsCase caseType, Geometry::Dimension dim);
+
+// Simulation only, no rendering-side work
+void DisableRendering(Physics::Model& model);
+}
@@ -0,0 +1,229 @@
+#include "ParameterSweep.hpp"
+#include "Bench.hpp"
+#include "Logging.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <vector>
+
+namespace
+{
+struct SweepSpec
+{
+  Physics::ModelType modelType = Physics::ModelType::FLUIDS;
+  Utils::PhysicsCase caseType = Utils::PhysicsCase::CASE_INVALID;
+  Geometry::Dimension dim = Geometry::Dimension::dim3D;
+  size_t nbWarmupSteps = 0;
+  size_t nbSteps = 200;
+  // Quality metrics averaged over states sampled every interval, last state included
+  size_t sampleInterval = 20;
+  std::vector<std::pair<std::string, std::vector<json>>> parameters;
+};
+
+bool ParseSpec(const json& specJson, SweepSpec& spec)
+{
+  const std::string modelName = specJson.value("model", "Fluids");
+  const auto itModel = std::find_if(Physics::ALL_MODELS.cbegin(), Physics::ALL_MODELS.cend(), [&](const auto& model)
+      { return model.second == modelName; });
+  if (itModel == Physics::ALL_MODELS.cend())
+  {
+    LOG_ERROR("Unknown model {} in sweep spec", modelName);
+    return false;
+  }
+  spec.modelType = itModel->first;
+
+  const auto [beginCase, endCase] = Bench::CaseRange(spec.modelType);
+  spec.caseType = specJson.contains("case") ? specJson["case"].get<Utils::PhysicsCase>() : static_cast<Utils::PhysicsCase>(beginCase + 1);
+  if (spec.caseType <= beginCase || spec.caseType >= endCase)
+  {
+    LOG_ERROR("Unknown case for model {} in sweep spec", modelName);
+    return false;
+  }
+
+  spec.dim = (specJson.value("dimension", "3D") == "2D") ? Geometry::Dimension::dim2D : Geometry::Dimension::dim3D;
+  spec.nbWarmupSteps = specJson.value("warmupSteps", spec.nbWarmupSteps);
+  spec.nbSteps = specJson.value("steps", spec.nbSteps);
+  spec.sampleInterval = std::max<size_t>(specJson.value("sampleInterval", spec.sampleInterval), 1);
+
+  const json parameters = specJson.value("parameters", json::object());
+  for (const auto& parameter : parameters.items())
+  {
+    const auto& values = parameter.value();
+    if (!values.is_array() || values.empty())
+    {
+      LOG_ERROR("Parameter {} of sweep spec must list at least one value", parameter.key());
+      return false;
+    }
+    spec.parameters.emplace_back(parameter.key(), std::vector<json>(values.begin(), values.end()));
+  }
+
+  return true;
+}
+
+// Values of a combination set over the model input json, only [value, min, max] current value is replaced
+json ApplyCombination(json inputJson, const SweepSpec& spec, const std::vector<size_t>& combination)
+{
+  for (size_t i = 0; i < spec.parameters.size(); ++i)
+  {
+    auto& node = inputJson.at(json::json_pointer(spec.parameters[i].first));
+    const auto& value = spec.parameters[i].second[combination[i]];
+    if (node.is_array())
+      node[0] = value;
+    else
+      node = value;
+  }
+  return inputJson;
+}
+
+// Moving to next combination, last parameter varying fastest, false once all have been done
+bool NextCombination(const SweepSpec& spec, std::vector<size_t>& combination)
+{
+  for (size_t i = spec.parameters.size(); i-- > 0;)
+  {
+    if (++combination[i] < spec.parameters[i].second.size())
+      return true;
+    combination[i] = 0;
+  }
+  return false;
+}
+
+std::string CsvField(const std::string& field)
+{
+  if (field.find_first_of(",\"\n") == std::string::npos)
+    return field;
+
+  std::string quoted = "\"";
+  for (const auto c : field)
+    quoted += (c == '"') ? std::string("\"\"") : std::string(1, c);
+  return quoted + "\"";
+}
+
+std::string CsvValue(const json& value)
+{
+  return CsvField(value.is_string() ? value.get<std::string>() : value.dump());
+}
+}
+
+bool Bench::RunParameterSweep(const std::string& specFilePath, const std::string& csvFilePath)
+{
+  SweepSpec spec;
+  try
+  {
+    std::ifstream specFile(specFilePath);
+    if (!specFile.is_open())
+    {
+      LOG_ERROR("Cannot open sweep spec {}", specFilePath);
+      return false;
+    }
+
+    if (!ParseSpec(json::parse(specFile), spec))
+      return false;
+  }
+  catch (const std::exception& e)
+  {
+    LOG_ERROR("Cannot parse sweep spec {}: {}", specFilePath, e.what());
+    return false;
+  }
+
+  std::ofstream csvFile(csvFilePath);
+  if (!csvFile.is_open())
+  {
+    LOG_ERROR("Cannot open sweep file {}", csvFilePath);
+    return false;
+  }
+
+  // Created once, programs and buffers being reused by all combinations
+  auto model = Physics::CreateModel(spec.modelType, BenchModelParams(spec.modelType, spec.caseType, spec.dim));
+  if (!model || !model->isInit() || model->deviceName().empty())
+  {
+    LOG_ERROR("Cannot create model {} for sweep", Physics::ALL_MODELS.at(spec.modelType));
+    return false;
+  }
+
+  DisableRendering(*model);
+
+  const json baseInputJson = model->getInputJson();
+  const std::string caseName = json(spec.caseType);
+  const std::string dimName = (spec.dim == Geometry::Dimension::dim2D) ? "2D" : "3D";
+
+  std::vector<std::string> metricNames;
+  bool isHeaderWritten = false;
+  std::vector<size_t> combination(spec.parameters.size(), 0);
+  size_t nbCombinations = 0;
+
+  do
+  {
+    std::map<std::string, double> metricSums;
+    size_t nbSamples = 0;
+    std::chrono::steady_clock::duration stepsTime = std::chrono::steady_clock::duration::zero();
+
+    try
+    {
+      // Parameters applied before reset, each combination starting from the same initial state
+      model->updateInputJson(ApplyCombination(baseInputJson, spec, combination));
+      model->reset();
+
+      for (size_t step = 0; step < spec.nbWarmupSteps; ++step)
+        model->update();
+
+      for (size_t step = 1; step <= spec.nbSteps; ++step)
+      {
+        // Each update waits for the device queue to be done before returning
+        const auto start = std::chrono::steady_clock::now();
+        model->update();
+        stepsTime += std::chrono::steady_clock::now() - start;
+
+        if (step % spec.sampleInterval == 0 || step == spec.nbSteps)
+        {
+          for (const auto& [name, value] : model->qualityMetrics())
+            metricSums[name] += value;
+          ++nbSamples;
+        }
+      }
+    }
+    catch (const std::exception& e)
+    {
+      LOG_ERROR("Skipping sweep combination {}: {}", nbCombinations, e.what());
+      ++nbCombinations;
+      continue;
+    }
+
+    // Header written with first completed combination, once metrics provided by the model are known
+    if (!isHeaderWritten)
+    {
+      for (const auto& metric : metricSums)
+        metricNames.push_back(metric.first);
+
+      csvFile << "model,case,dimension";
+      for (const auto& parameter : spec.parameters)
+        csvFile << "," << CsvField(parameter.first);
+      csvFile << ",nbParticles,stepsPerSecond,meanStepTimeMs";
+      for (const auto& name : metricNames)
+        csvFile << "," << name;
+      csvFile << "\n";
+      isHeaderWritten = true;
+    }
+
+    const double totalTimeMs = std::chrono::duration<double, std::milli>(stepsTime).count();
+
+    csvFile << Physics::ALL_MODELS.at(spec.modelType) << "," << CsvField(caseName) << "," << dimName;
+    for (size_t i = 0; i < spec.parameters.size(); ++i)
+      csvFile << "," << CsvValue(spec.parameters[i].second[combination[i]]);
+    csvFile << "," << model->nbParticles();
+    csvFile << "," << ((totalTimeMs > 0.0) ? 1000.0 * spec.nbSteps / totalTimeMs : 0.0);
+    csvFile << "," << ((spec.nbSteps > 0) ? totalTimeMs / spec.nbSteps : 0.0);
+    for (const auto& name : metricNames)
+      csvFile << "," << ((nbSamples > 0) ? metricSums[name] / nbSamples : 0.0);
+    csvFile << std::endl;
+
+    LOG_INFO("Sweep combination {} done in {} ms", nbCombinations, totalTimeMs);
+    ++nbCombinations;
+
+  } while (NextCombination(spec, combination));
+
+  LOG_INFO("Sweep of {} combinations written into {}", nbCombinations, csvFilePath);
+
+  return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+namespace Bench
+{
+// Runs every combination of the parameter values listed in a sweep spec on a single model instance,
+// programs and buffers being reused, and writes timings and quality metrics of each one as a CSV row
+//
+// {
+//   "model": "Fluids", "case": "Dam", "dimension": "3D",
+//   "warmupSteps": 0, "steps": 200, "sampleInterval": 20,
+//   "parameters": {
+//     "/Fluids/Nb Jacobi Iterations": [1, 2, 4],
+//     "/Fluids/Time Step": [0.005, 0.010]
+//   }
+// }
+//
+// Parameters are JSON pointers inside the model input json, value replacing the current one of [value, min, max] entries
+bool RunParameterSweep(const std::string& specFilePath, const std::string& csvFilePath);
+}
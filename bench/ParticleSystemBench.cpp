@@ -0,0 +1,173 @@
+#include "Bench.hpp"
+#include "Logging.hpp"
+#include "Model.hpp"
+#include "ParameterSweep.hpp"
+#include "Parameters.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct BenchOptions
+{
+  Physics::ComputeDevice device = Physics::ComputeDevice::CPU;
+  size_t nbWarmupSteps = 20;
+  size_t nbMeasuredSteps = 100;
+  // Profiling waits for each kernel, timed separately from throughput
+  size_t nbProfiledSteps = 10;
+  std::string filePath = "bench.json";
+  // Parameter sweep described in a spec file instead of the default benchmark
+  std::string sweepFilePath;
+  std::string csvFilePath = "sweep.csv";
+  // SPH kernels read from lookup tables, per-kernel times to be compared with an analytic run
+  bool isSphLutEnabled = false;
+  bool isVerbose = false;
+};
+
+json RunCase(Physics::ModelType modelType, Utils::PhysicsCase caseType, Geometry::Dimension dim, const BenchOptions& options)
+{
+  const std::string dimName = (dim == Geometry::Dimension::dim2D) ? "2D" : "3D";
+
+  json result;
+  result["model"] = Physics::ALL_MODELS.at(modelType);
+  result["case"] = json(caseType);
+  result["dimension"] = dimName;
+
+  auto model = Physics::CreateModel(modelType, Bench::BenchModelParams(modelType, caseType, dim));
+  // No OpenCL device of requested type, model steps would do nothing
+  if (!model || !model->isInit() || model->deviceName().empty())
+  {
+    LOG_ERROR("Cannot create model {} for case {} in {}", Physics::ALL_MODELS.at(modelType), result["case"].get<std::string>(), dimName);
+    result["error"] = "Model creation failed";
+    return result;
+  }
+
+  Bench::DisableRendering(*model);
+
+  for (size_t step = 0; step < options.nbWarmupSteps; ++step)
+    model->update();
+
+  // Each update waits for the device queue to be done before returning
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t step = 0; step < options.nbMeasuredSteps; ++step)
+    model->update();
+  const auto end = std::chrono::steady_clock::now();
+
+  const double totalTimeMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+  result["deviceName"] = model->deviceName();
+  result["nbParticles"] = model->nbParticles();
+  result["maxNbParticles"] = model->maxNbParticles();
+  result["nbMeasuredSteps"] = options.nbMeasuredSteps;
+  result["stepsPerSecond"] = (totalTimeMs > 0.0) ? 1000.0 * options.nbMeasuredSteps / totalTimeMs : 0.0;
+  result["meanStepTimeMs"] = (options.nbMeasuredSteps > 0) ? totalTimeMs / options.nbMeasuredSteps : 0.0;
+
+  model->resetKernelProfiles();
+  model->enableProfiling(true);
+  for (size_t step = 0; step < options.nbProfiledSteps; ++step)
+    model->update();
+  model->enableProfiling(false);
+
+  json kernels = json::object();
+  for (const auto& [kernelName, profile] : model->kernelProfiles())
+  {
+    kernels[kernelName] = {
+      { "nbRuns", profile.nbRuns },
+      { "totalTimeMs", profile.totalTimeMs },
+      { "meanTimePerStepMs", (options.nbProfiledSteps > 0) ? profile.totalTimeMs / options.nbProfiledSteps : 0.0 }
+    };
+  }
+  result["nbProfiledSteps"] = options.nbProfiledSteps;
+  result["kernels"] = kernels;
+
+  LOG_INFO("{} {} {}: {} particles, {:.1f} steps/s", result["model"].get<std::string>(), result["case"].get<std::string>(), dimName, model->nbParticles(), result["stepsPerSecond"].get<double>());
+
+  return result;
+}
+
+// [--device cpu|gpu] [--warmup N] [--steps N] [--profiled-steps N] [--output file.json] [--sweep spec.json [--csv file.csv]] [--sph-lut] [--verbose]
+BenchOptions ParseOptions(int argc, char** argv)
+{
+  BenchOptions options;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    const bool hasValue = (i + 1 < argc);
+
+    if (arg == "--device" && hasValue)
+    {
+      const std::string device = argv[++i];
+      options.device = (device == "gpu") ? Physics::ComputeDevice::GPU : Physics::ComputeDevice::CPU;
+    }
+    else if (arg == "--warmup" && hasValue)
+      options.nbWarmupSteps = (size_t)std::stoul(argv[++i]);
+    else if (arg == "--steps" && hasValue)
+      options.nbMeasuredSteps = (size_t)std::stoul(argv[++i]);
+    else if (arg == "--profiled-steps" && hasValue)
+      options.nbProfiledSteps = (size_t)std::stoul(argv[++i]);
+    else if (arg == "--output" && hasValue)
+      options.filePath = argv[++i];
+    else if (arg == "--sweep" && hasValue)
+      options.sweepFilePath = argv[++i];
+    else if (arg == "--csv" && hasValue)
+      options.csvFilePath = argv[++i];
+    else if (arg == "--sph-lut")
+      options.isSphLutEnabled = true;
+    else if (arg == "--verbose")
+      options.isVerbose = true;
+    else
+      LOG_ERROR("Ignoring unknown argument {}", arg);
+  }
+
+  return options;
+}
+}
+
+int main(int argc, char** argv)
+{
+  Utils::InitializeLogger();
+
+  const BenchOptions options = ParseOptions(argc, argv);
+
+  // Profiling logs every kernel run otherwise
+  if (!options.isVerbose)
+    spdlog::set_level(spdlog::level::warn);
+
+  Physics::SelectComputeDevice(options.device);
+  Physics::SelectSphKernelEval(options.isSphLutEnabled ? Physics::SphKernelEval::LOOKUP_TABLE : Physics::SphKernelEval::ANALYTIC);
+
+  if (!options.sweepFilePath.empty())
+    return Bench::RunParameterSweep(options.sweepFilePath, options.csvFilePath) ? 0 : 1;
+
+  json report;
+  report["device"] = (options.device == Physics::ComputeDevice::GPU) ? "gpu" : "cpu";
+  report["sphKernels"] = options.isSphLutEnabled ? "lookupTable" : "analytic";
+  report["nbWarmupSteps"] = options.nbWarmupSteps;
+  report["results"] = json::array();
+
+  for (const auto& [modelType, modelName] : Physics::ALL_MODELS)
+  {
+    const auto [beginCase, endCase] = Bench::CaseRange(modelType);
+
+    for (int iCaseType = beginCase + 1; iCaseType < endCase; iCaseType++)
+    {
+      for (const auto dim : { Geometry::Dimension::dim2D, Geometry::Dimension::dim3D })
+        report["results"].push_back(RunCase(modelType, static_cast<Utils::PhysicsCase>(iCaseType), dim, options));
+    }
+  }
+
+  std::ofstream file(options.filePath);
+  if (!file.is_open())
+  {
+    LOG_ERROR("Cannot open bench file {}", options.filePath);
+    return 1;
+  }
+
+  file << report.dump(2) << std::endl;
+
+  return 0;
+}
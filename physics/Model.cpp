@@ -7,6 +7,90 @@
 
 #include "Logging.hpp"
 
+void Physics::SelectComputeDevice(Physics::ComputeDevice device)
+{
+  switch (device)
+  {
+  case Physics::ComputeDevice::GPU:
+    Physics::CL::Context::RequestComputeOnly(CL_DEVICE_TYPE_GPU);
+    break;
+  case Physics::ComputeDevice::CPU:
+    Physics::CL::Context::RequestComputeOnly(CL_DEVICE_TYPE_CPU);
+    break;
+  default:
+    break;
+  }
+}
+
+bool Physics::CreateThreadQueue()
+{
+  return Physics::CL::Context::Get().createThreadQueue();
+}
+
+bool Physics::ReleaseThreadQueue()
+{
+  return Physics::CL::Context::Get().releaseThreadQueue();
+}
+
+namespace
+{
+Physics::SphKernelEval s_sphKernelEval = Physics::SphKernelEval::ANALYTIC;
+}
+
+void Physics::SelectSphKernelEval(Physics::SphKernelEval eval)
+{
+  s_sphKernelEval = eval;
+}
+
+Physics::SphKernelEval Physics::SelectedSphKernelEval()
+{
+  return s_sphKernelEval;
+}
+
+Physics::ModelParams Physics::DomainParams(Physics::ModelType type)
+{
+  Physics::ModelParams params;
+  params.maxNbParticles = Utils::ALL_NB_PARTICLES.crbegin()->first;
+  params.boxSize = Geometry::BOX_SIZE_3D;
+  params.gridRes = Geometry::GRID_RES_3D;
+
+  if (type == Physics::ModelType::CLOUDS)
+  {
+    params.boxSize.y *= 2;
+    params.gridRes.y *= 2;
+  }
+
+  return params;
+}
+
+std::map<std::string, std::shared_future<bool>> Physics::PrebuildPrograms(Physics::ModelType type, const Physics::ModelParams& params)
+{
+  std::vector<Physics::CL::programSpecs> allSpecs = { Physics::RadixSort::ProgramSpecs() };
+
+  switch ((int)type)
+  {
+  case Physics::ModelType::BOIDS:
+    allSpecs.push_back(Physics::CL::Boids::ProgramSpecs(params.boxSize, params.gridRes));
+    break;
+  case Physics::ModelType::FLUIDS:
+    allSpecs.push_back(Physics::CL::Fluids::ProgramSpecs(params.boxSize, params.gridRes));
+    break;
+  case Physics::ModelType::CLOUDS:
+    allSpecs.push_back(Physics::CL::Clouds::ProgramSpecs(params.boxSize, params.gridRes));
+    break;
+  default:
+    break;
+  }
+
+  Physics::CL::Context& clContext = Physics::CL::Context::Get();
+
+  std::map<std::string, std::shared_future<bool>> builds;
+  for (const auto& specs : allSpecs)
+    builds[specs.name] = clContext.buildProgramAsync(specs);
+
+  return builds;
+}
+
 std::unique_ptr<Physics::Model> Physics::CreateModel(Physics::ModelType type, Physics::ModelParams params)
 {
   switch ((int)type)
@@ -2,13 +2,19 @@
 
 #include "Geometry.hpp"
 #include "Math.hpp"
+#include "ParameterStore.hpp"
 #include "Parameters.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace Physics
 {
@@ -57,6 +63,18 @@ struct PhysicalQuantity
   std::pair<float, float> userRange;
 };
 
+// Particles buffers shared with the graphics engine for one frame, models writing into them round-robin
+struct ParticleRenderSlot
+{
+  unsigned int posVBO = 0;
+  unsigned int prevPosVBO = 0;
+  unsigned int colVBO = 0;
+  unsigned int quantizedPosVBO = 0;
+  unsigned int indexVBO = 0;
+  unsigned int gridDetectorVBO = 0;
+  unsigned int densityVolumeVBO = 0;
+};
+
 struct ModelParams
 {
   size_t currNbParticles = 0;
@@ -64,18 +82,60 @@ struct ModelParams
   Geometry::BoxSize3D boxSize = { 0, 0, 0 };
   Geometry::BoxSize3D gridRes = { 0, 0, 0 };
   float velocity = 0.0f;
-  unsigned int particlePosVBO = 0;
-  unsigned int particleColVBO = 0;
-  unsigned int cameraVBO = 0;
-  unsigned int gridVBO = 0;
+  std::vector<ParticleRenderSlot> particleRenderSlots;
   Geometry::Dimension dimension = Geometry::Dimension::dim3D;
   Utils::PhysicsCase pCase = Utils::PhysicsCase::CASE_INVALID;
 };
 
+// Device running the models, GPU displaying the application by default to share buffers with OpenGL
+// Other ones have no graphics interop, rendering buffers being filled but never drawn, e.g for benchmarking
+enum class ComputeDevice
+{
+  INTEROP_GPU,
+  GPU,
+  CPU
+};
+
+// Must be selected before creating the first model
+void SelectComputeDevice(ComputeDevice device);
+
+// Commands issued by the calling thread sent to a device queue of its own until released, e.g. by the simulation thread
+bool CreateThreadQueue();
+bool ReleaseThreadQueue();
+
+// SPH kernels of fluids-based models evaluated analytically or read from radial lookup tables generated at build time
+enum class SphKernelEval
+{
+  ANALYTIC,
+  LOOKUP_TABLE
+};
+
+// Must be selected before building model programs
+void SelectSphKernelEval(SphKernelEval eval);
+SphKernelEval SelectedSphKernelEval();
+
+// Device time spent in a kernel while profiling is enabled
+struct KernelProfile
+{
+  double totalTimeMs = 0.0;
+  size_t nbRuns = 0;
+};
+
+// Particles count and simulation box of a model, the only parameters its programs depend on
+// Shared by the application and the benchmarks, Clouds using a box twice as high
+ModelParams DomainParams(ModelType type);
+
 // Models Factory
 class Model;
 std::unique_ptr<Model> CreateModel(ModelType type, ModelParams params);
 
+// Building programs of a model in background tasks, its creation then only waiting for the ones not ready yet
+// Only box size and grid resolution of params are used, futures being true once built, per program name
+std::map<std::string, std::shared_future<bool>> PrebuildPrograms(ModelType type, const ModelParams& params);
+
+// Deferred modification of a model, applied by the thread stepping it
+using ModelCommand = std::function<void(Model&)>;
+
 // Abstract class defining physical model foundations to implement
 // Currently all models are OpenCL-based but that could change
 class Model
@@ -87,24 +147,81 @@ class Model
       , m_boxSize(params.boxSize)
       , m_gridRes(params.gridRes)
       , m_nbCells(params.gridRes.x * params.gridRes.y * params.gridRes.z)
-      , m_particlePosVBO(params.particlePosVBO)
-      , m_particleColVBO(params.particleColVBO)
-      , m_cameraVBO(params.cameraVBO)
-      , m_gridVBO(params.gridVBO)
+      , m_particleRenderSlots(params.particleRenderSlots)
+      , m_renderSlot(0)
+      , m_cameraState {}
       , m_dimension(params.dimension)
       , m_case(params.pCase)
       , m_boundary(Boundary::BouncingWall)
       , m_init(false)
       , m_pause(false)
+      , m_isFrustumCullingEnabled(true)
+      , m_isPosQuantizationEnabled(false)
+      , m_isVolumeRenderingEnabled(false)
+      , m_isCameraSortEnabled(true)
+      , m_nbSubsteps(1)
+      , m_isInterpolationEnabled(false)
+      , m_nbVisibleParticles(params.currNbParticles)
       , m_currentDisplayedQuantityName("")
-      , m_inputJson(js) {};
+      , m_inputJson(js)
+      , m_parameters(js) {};
 
   virtual ~Model() {};
 
   size_t maxNbParticles() const { return m_maxNbParticles; }
 
-  void setNbParticles(size_t nbSelParticles) { m_currNbParticles = nbSelParticles; }
+  // Changing active particles count without reset, particles beyond it being frozen and hidden until restored
+  void setNbParticles(size_t nbSelParticles)
+  {
+    const size_t prevNbParticles = m_currNbParticles;
+    m_currNbParticles = std::min(nbSelParticles, m_maxNbParticles);
+
+    if (m_currNbParticles != prevNbParticles)
+      onNbParticlesChanged(prevNbParticles);
+  }
   size_t nbParticles() const { return m_currNbParticles; }
+  // Whether restored particles can come back without disturbing the simulation, see setNbParticles()
+  virtual bool isNbParticlesAdjustable() const { return false; }
+
+  // Frustum culling, compacting indices of particles visible by the camera for rendering
+  void enableFrustumCulling(bool enable) { m_isFrustumCullingEnabled = enable; }
+  bool isFrustumCullingEnabled() const { return m_isFrustumCullingEnabled; }
+  size_t nbVisibleParticles() const { return m_isFrustumCullingEnabled ? m_nbVisibleParticles : m_currNbParticles; }
+
+  // Filling render-side copy of positions quantized on 3x16 bits within the box
+  void enablePosQuantization(bool enable) { m_isPosQuantizationEnabled = enable; }
+  bool isPosQuantizationEnabled() const { return m_isPosQuantizationEnabled; }
+
+  // Splatting particles into a density volume ray-marched by the graphics engine, only for models filling it
+  void enableVolumeRendering(bool enable) { m_isVolumeRenderingEnabled = enable; }
+  bool isVolumeRenderingEnabled() const { return m_isVolumeRenderingEnabled; }
+
+  // Sorting particles along camera axis for blended point sprites, useless for depth-tested rendering
+  void enableCameraSort(bool enable) { m_isCameraSortEnabled = enable; }
+  bool isCameraSortEnabled() const { return m_isCameraSortEnabled; }
+
+  // Solver steps run per update with the same time step, rendering-only work being done once after the last one
+  void setNbSubsteps(size_t nbSubsteps) { m_nbSubsteps = std::max<size_t>(nbSubsteps, 1); }
+  size_t nbSubsteps() const { return m_nbSubsteps; }
+
+  // Publishing positions before the update along with new ones, for the graphics engine to interpolate between them
+  void enableInterpolation(bool enable) { m_isInterpolationEnabled = enable; }
+  bool isInterpolationEnabled() const { return m_isInterpolationEnabled; }
+
+  // Render slot written by the next update, granted by the graphics engine once it is done drawing it
+  void setRenderSlot(size_t slot) { m_renderSlot = slot; }
+  size_t renderSlot() const { return m_renderSlot; }
+
+  // Camera state of the last frame drawn, copied to the device by the next update for sorting and culling
+  void setCameraState(const Math::float4x4& projView, const Math::float3& cameraPos)
+  {
+    // Same memory layout than the FrameState block, row-vector convention
+    std::memcpy(m_cameraState.data(), &projView[0][0], 16 * sizeof(float));
+    m_cameraState[16] = cameraPos.x;
+    m_cameraState[17] = cameraPos.y;
+    m_cameraState[18] = cameraPos.z;
+    m_cameraState[19] = 1.0f;
+  }
 
   void setDimension(Geometry::Dimension dim)
   {
@@ -121,6 +238,8 @@ class Model
 
   virtual void update() = 0;
   virtual void reset() = 0;
+  // Waiting for the render slot filled by the last update to be handed back to OpenGL, before presenting it
+  virtual void finishRenderSlot() {};
 
   bool isInit() const { return m_init; }
 
@@ -150,6 +269,12 @@ class Model
   virtual bool isProfilingEnabled() const { return false; };
   virtual void enableProfiling(bool enable) {};
   virtual bool isUsingIGPU() const { return false; };
+  virtual std::string deviceName() const { return ""; };
+  // Accumulated since last reset, while profiling is enabled
+  virtual std::map<std::string, KernelProfile> kernelProfiles() const { return {}; };
+  virtual void resetKernelProfiles() {};
+  // Simulation quality of current state, read back from device, e.g relative density error or kinetic energy
+  virtual std::map<std::string, double> qualityMetrics() { return {}; };
 
   json getInputJson() const
   {
@@ -159,6 +284,7 @@ class Model
   void resetInputJson(const json& newJson)
   {
     m_inputJson = newJson;
+    m_parameters = ParameterStore(m_inputJson);
   }
 
   void updateInputJson(const json& newJson)
@@ -168,20 +294,68 @@ class Model
       return;
 
     m_inputJson.merge_patch(newJson);
+    m_parameters = ParameterStore(m_inputJson);
+    updateModelWithInputJson(m_inputJson);
+  }
+
+  // Typed view of the input json, written by UI, dirty parameters being applied by applyParameterChanges()
+  ParameterStore& parameters() { return m_parameters; }
+  const ParameterStore& parameters() const { return m_parameters; }
+
+  // Transferring modified parameters to the model, nothing done if none, to be called before update()
+  void applyParameterChanges()
+  {
+    if (!m_parameters.isDirty())
+      return;
+
+    m_parameters.writeDirtyValues(m_inputJson);
     updateModelWithInputJson(m_inputJson);
   }
 
+  // Must clear dirty parameters once transferred
   virtual void updateModelWithInputJson(json& inputJson) = 0;
 
   void setCase(Utils::PhysicsCase caseType) { m_case = caseType; }
   const Utils::PhysicsCase getCase() const { return m_case; }
 
   protected:
+  // Taking particles beyond the active count out of the simulation, respawning the restored ones if needed
+  virtual void onNbParticlesChanged(size_t prevNbParticles) {};
+
+  // Device copy of the camera state, projView matrix then camera position, see FRAME_STATE_* in define.cl
+  static constexpr size_t FRAME_STATE_SIZE = 5 * 4 * sizeof(float);
+
+  // OpenCL names of the GL buffers of a render slot, r_pos0, r_col0...
+  // Nothing published without render slots, e.g while benchmarking
+  bool hasRenderSlots() const { return !m_particleRenderSlots.empty(); }
+
+  static std::string renderSlotBufferName(const std::string& name, size_t slot) { return name + std::to_string(slot); }
+  std::vector<std::string> renderSlotBufferNames() const
+  {
+    return { renderSlotBufferName("r_pos", m_renderSlot), renderSlotBufferName("r_prevPos", m_renderSlot), renderSlotBufferName("r_col", m_renderSlot),
+      renderSlotBufferName("r_quantizedPos", m_renderSlot), renderSlotBufferName("r_visibleIndex", m_renderSlot), renderSlotBufferName("r_partDetector", m_renderSlot) };
+  }
+  // Float4 buffers permutated by sorts, previous positions following particles when interpolation is enabled
+  std::vector<std::string> withPrevPos(std::vector<std::string> bufferNames) const
+  {
+    if (m_isInterpolationEnabled)
+      bufferNames.push_back("p_prevPos");
+    return bufferNames;
+  }
+
   bool m_init;
   bool m_pause;
+  bool m_isFrustumCullingEnabled;
+  bool m_isPosQuantizationEnabled;
+  bool m_isVolumeRenderingEnabled;
+  bool m_isCameraSortEnabled;
+
+  size_t m_nbSubsteps;
+  bool m_isInterpolationEnabled;
 
   size_t m_maxNbParticles;
   size_t m_currNbParticles;
+  size_t m_nbVisibleParticles;
 
   Geometry::BoxSize3D m_boxSize;
 
@@ -195,16 +369,19 @@ class Model
   Boundary m_boundary;
 
   // Gate to graphics
-  unsigned int m_particlePosVBO;
-  unsigned int m_particleColVBO;
-  unsigned int m_cameraVBO;
-  unsigned int m_gridVBO;
+  std::vector<ParticleRenderSlot> m_particleRenderSlots;
+  size_t m_renderSlot;
+  std::array<float, FRAME_STATE_SIZE / sizeof(float)> m_cameraState;
 
   // Name of the PhysicalQuantity currently sent to color buffer and rendered by fragment shader
   std::string m_currentDisplayedQuantityName;
   // All PhysicalQuantities that can be rendered
   std::map<const std::string, PhysicalQuantity> m_allDisplayableQuantities;
 
+  // Parameters modified since last transfer are dirty, all of them after a json reset
+  // so that derived classes can restrict their kernel updates to modified ones
+  ParameterStore m_parameters;
+
   private:
   // Container for model parameters available in UI
   // Set as private to force a data transfer cascade within physics model
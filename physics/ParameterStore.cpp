@@ -0,0 +1,204 @@
+#include "ParameterStore.hpp"
+#include "Logging.hpp"
+
+#include <algorithm>
+
+using namespace Physics;
+
+namespace
+{
+// JSON pointer reference token, RFC 6901
+std::string EscapeToken(const std::string& token)
+{
+  std::string escaped;
+  for (const char c : token)
+  {
+    if (c == '~')
+      escaped += "~0";
+    else if (c == '/')
+      escaped += "~1";
+    else
+      escaped += c;
+  }
+  return escaped;
+}
+
+bool IsUnderPath(const std::string& path, const std::string& pathPrefix)
+{
+  if (path.compare(0, pathPrefix.size(), pathPrefix) != 0)
+    return false;
+
+  return path.size() == pathPrefix.size() || path[pathPrefix.size()] == '/';
+}
+}
+
+ParameterStore::ParameterStore(const json& js)
+{
+  addParameters(js, "", 0);
+}
+
+void ParameterStore::addParameters(const json& js, const std::string& parentPath, size_t depth)
+{
+  if (!js.is_object())
+    return;
+
+  for (const auto& [name, val] : js.items())
+  {
+    Parameter param;
+    param.name = name;
+    param.path = parentPath + "/" + EscapeToken(name);
+    param.depth = depth;
+    param.isDirty = true;
+
+    if (val.is_object())
+    {
+      param.type = ParameterType::GROUP;
+      param.isDirty = false;
+      m_parameters.push_back(param);
+      addParameters(val, param.path, depth + 1);
+      continue;
+    }
+    else if (val.is_boolean())
+    {
+      param.type = ParameterType::BOOL;
+      param.boolValue = val.get<bool>();
+    }
+    else if (val.is_array() && val.size() == 3 && val[0].is_number_integer())
+    {
+      param.type = ParameterType::INT;
+      param.intValue = val[0].get<int>();
+      param.intMin = val[1].get<int>();
+      param.intMax = val[2].get<int>();
+    }
+    else if (val.is_array() && val.size() == 3 && val[0].is_number_float())
+    {
+      param.type = ParameterType::FLOAT;
+      param.floatValue = val[0].get<float>();
+      param.floatMin = val[1].get<float>();
+      param.floatMax = val[2].get<float>();
+    }
+    else
+    {
+      LOG_ERROR("{} type is not supported by parameter store", name);
+      continue;
+    }
+
+    m_parameters.push_back(param);
+    ++m_nbDirty;
+  }
+}
+
+size_t ParameterStore::index(const std::string& path) const
+{
+  auto it = std::find_if(m_parameters.cbegin(), m_parameters.cend(), [&path](const Parameter& param) { return param.path == path; });
+
+  return (it != m_parameters.cend()) ? (size_t)(it - m_parameters.cbegin()) : INVALID_INDEX;
+}
+
+void ParameterStore::setBool(size_t index, bool value)
+{
+  auto& param = m_parameters.at(index);
+  if (param.type != ParameterType::BOOL || param.boolValue == value)
+    return;
+
+  param.boolValue = value;
+  if (!param.isDirty)
+  {
+    param.isDirty = true;
+    ++m_nbDirty;
+  }
+}
+
+void ParameterStore::setInt(size_t index, int value)
+{
+  auto& param = m_parameters.at(index);
+  if (param.type != ParameterType::INT)
+    return;
+
+  value = std::clamp(value, param.intMin, param.intMax);
+  if (param.intValue == value)
+    return;
+
+  param.intValue = value;
+  if (!param.isDirty)
+  {
+    param.isDirty = true;
+    ++m_nbDirty;
+  }
+}
+
+void ParameterStore::setFloat(size_t index, float value)
+{
+  auto& param = m_parameters.at(index);
+  if (param.type != ParameterType::FLOAT)
+    return;
+
+  value = std::clamp(value, param.floatMin, param.floatMax);
+  if (param.floatValue == value)
+    return;
+
+  param.floatValue = value;
+  if (!param.isDirty)
+  {
+    param.isDirty = true;
+    ++m_nbDirty;
+  }
+}
+
+bool ParameterStore::isDirty(const std::string& pathPrefix, const std::vector<std::string>& ignoredPaths) const
+{
+  if (m_nbDirty == 0)
+    return false;
+
+  if (pathPrefix.empty() && ignoredPaths.empty())
+    return true;
+
+  for (const auto& param : m_parameters)
+  {
+    if (!param.isDirty || !IsUnderPath(param.path, pathPrefix))
+      continue;
+
+    const bool isIgnored = std::any_of(ignoredPaths.cbegin(), ignoredPaths.cend(), [&param](const std::string& path) { return IsUnderPath(param.path, path); });
+    if (!isIgnored)
+      return true;
+  }
+
+  return false;
+}
+
+void ParameterStore::clearDirty()
+{
+  for (auto& param : m_parameters)
+    param.isDirty = false;
+
+  m_nbDirty = 0;
+}
+
+void ParameterStore::writeDirtyValues(json& js) const
+{
+  if (m_nbDirty == 0)
+    return;
+
+  for (const auto& param : m_parameters)
+  {
+    if (!param.isDirty)
+      continue;
+
+    auto& val = js[json::json_pointer(param.path)];
+
+    switch (param.type)
+    {
+    case ParameterType::BOOL:
+      val = param.boolValue;
+      break;
+    case ParameterType::INT:
+      val[0] = param.intValue;
+      break;
+    case ParameterType::FLOAT:
+      val[0] = param.floatValue;
+      break;
+    default:
+      break;
+    }
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Parameters.hpp"
+
+#include <string>
+#include <vector>
+
+namespace Physics
+{
+enum class ParameterType
+{
+  // Json object, only there to group its children in UI
+  GROUP,
+  BOOL,
+  INT,
+  FLOAT
+};
+
+// Model input json entry, [value, min, max] arrays and bools flattened into typed fields
+struct Parameter
+{
+  std::string name;
+  // JSON pointer to the entry within the input json
+  std::string path;
+  ParameterType type = ParameterType::GROUP;
+  // Nesting level within the input json, 0 for top-level entries
+  size_t depth = 0;
+
+  bool boolValue = false;
+  int intValue = 0, intMin = 0, intMax = 0;
+  float floatValue = 0.0f, floatMin = 0.0f, floatMax = 0.0f;
+
+  // Modified since last transfer to the model
+  bool isDirty = false;
+};
+
+// Typed registry of model parameters generated from the input json, in json order
+// Written directly by the UI, each modified parameter being flagged as dirty
+// so that models only update what depends on it, the json being left out of the frame loop
+class ParameterStore
+{
+  public:
+  ParameterStore() = default;
+  // All parameters start dirty, nothing being transferred to the model yet
+  explicit ParameterStore(const json& js);
+
+  const std::vector<Parameter>& parameters() const { return m_parameters; }
+
+  // Index of the parameter at given JSON pointer, INVALID_INDEX if none
+  static constexpr size_t INVALID_INDEX = (size_t)-1;
+  size_t index(const std::string& path) const;
+
+  const Parameter& at(size_t index) const { return m_parameters.at(index); }
+
+  // Clamped within [min, max] and flagged as dirty if different from current value
+  void setBool(size_t index, bool value);
+  void setInt(size_t index, int value);
+  void setFloat(size_t index, float value);
+
+  // True if any parameter under the given JSON pointer has been modified, ignored paths and their children excluded
+  bool isDirty(const std::string& pathPrefix = "", const std::vector<std::string>& ignoredPaths = {}) const;
+  void clearDirty();
+
+  // Writing dirty values back into the json they come from
+  void writeDirtyValues(json& js) const;
+
+  private:
+  void addParameters(const json& js, const std::string& parentPath, size_t depth);
+
+  std::vector<Parameter> m_parameters;
+  size_t m_nbDirty = 0;
+};
+}
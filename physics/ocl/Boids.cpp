@@ -13,10 +13,16 @@ using namespace Physics::CL;
 
 #define PROGRAM_BOIDS "boids"
 
+constexpr size_t MAX_NB_PARTS_IN_CELL = 3000;
+
 // utils.cl
 #define KERNEL_INFINITE_POS "infPosVerts"
 #define KERNEL_RESET_CAMERA_DIST "resetCameraDist"
 #define KERNEL_FILL_CAMERA_DIST "fillCameraDist"
+#define KERNEL_COUNT_VISIBLE_PARTS "countVisibleParts"
+#define KERNEL_SCAN_VISIBLE_PARTS "scanVisibleParts"
+#define KERNEL_COMPACT_VISIBLE_PARTS "compactVisibleParts"
+#define KERNEL_FILL_RENDER_SLOT "fillRenderSlot"
 
 // grid.cl
 #define KERNEL_RESET_PART_DETECTOR "resetGridDetector"
@@ -73,9 +79,9 @@ static const json initBoidsJson // clang-format off
 }; // clang-format on
 
 Boids::Boids(ModelParams params)
-    : OclModel<BoidsRuleKernelInputs, TargetKernelInputs>(params, BoidsRuleKernelInputs {}, TargetKernelInputs {}, json(initBoidsJson))
+    : OclModel<BoidsRuleKernelInputs, TargetKernelInputs>(ALL_MODELS.at(ModelType::BOIDS), params, BoidsRuleKernelInputs {}, TargetKernelInputs {}, json(initBoidsJson))
     , m_simplifiedMode(true)
-    , m_maxNbPartsInCell(3000)
+    , m_maxNbPartsInCell(MAX_NB_PARTS_IN_CELL)
     , m_radixSort(params.maxNbParticles)
     , m_target(params.boxSize.x)
 {
@@ -93,28 +99,35 @@ Boids::Boids(ModelParams params)
 // Must be defined on implementation side to have RadixSort complete
 Boids::~Boids() {};
 
+programSpecs Boids::ProgramSpecs(const Geometry::BoxSize3D& boxSize, const Geometry::BoxSize3D& gridRes)
+{
+  assert(boxSize.x / gridRes.x == boxSize.y / gridRes.y);
+  assert(boxSize.z / gridRes.z == boxSize.y / gridRes.y);
+
+  std::ostringstream clBuildOptions;
+  clBuildOptions << "-DEFFECT_RADIUS_SQUARED=" << Utils::FloatToStr(1.0f * boxSize.x * boxSize.x / (gridRes.x * gridRes.x));
+  clBuildOptions << " -DABS_WALL_X=" << Utils::FloatToStr(boxSize.x / 2.0f);
+  clBuildOptions << " -DABS_WALL_Y=" << Utils::FloatToStr(boxSize.y / 2.0f);
+  clBuildOptions << " -DABS_WALL_Z=" << Utils::FloatToStr(boxSize.z / 2.0f);
+  clBuildOptions << " -DGRID_RES_X=" << gridRes.x;
+  clBuildOptions << " -DGRID_RES_Y=" << gridRes.y;
+  clBuildOptions << " -DGRID_RES_Z=" << gridRes.z;
+  clBuildOptions << " -DGRID_CELL_SIZE_XYZ=" << Utils::FloatToStr((float)boxSize.x / gridRes.x);
+  clBuildOptions << " -DGRID_NUM_CELLS=" << gridRes.x * gridRes.y * gridRes.z;
+  clBuildOptions << " -DNUM_MAX_PARTS_IN_CELL=" << MAX_NB_PARTS_IN_CELL;
+
+  // file.cl order matters, define.cl must be first
+  return { PROGRAM_BOIDS, { "define.cl", "boids.cl", "utils.cl", "grid.cl" }, clBuildOptions.str() };
+}
+
 bool Boids::createProgram() const
 {
   CL::Context& clContext = CL::Context::Get();
 
-  assert(m_boxSize.x / m_gridRes.x == m_boxSize.y / m_gridRes.y);
-  assert(m_boxSize.z / m_gridRes.z == m_boxSize.y / m_gridRes.y);
+  const auto specs = ProgramSpecs(m_boxSize, m_gridRes);
 
-  std::ostringstream clBuildOptions;
-  clBuildOptions << "-DEFFECT_RADIUS_SQUARED=" << Utils::FloatToStr(1.0f * m_boxSize.x * m_boxSize.x / (m_gridRes.x * m_gridRes.x));
-  clBuildOptions << " -DABS_WALL_X=" << Utils::FloatToStr(m_boxSize.x / 2.0f);
-  clBuildOptions << " -DABS_WALL_Y=" << Utils::FloatToStr(m_boxSize.y / 2.0f);
-  clBuildOptions << " -DABS_WALL_Z=" << Utils::FloatToStr(m_boxSize.z / 2.0f);
-  clBuildOptions << " -DGRID_RES_X=" << m_gridRes.x;
-  clBuildOptions << " -DGRID_RES_Y=" << m_gridRes.y;
-  clBuildOptions << " -DGRID_RES_Z=" << m_gridRes.z;
-  clBuildOptions << " -DGRID_CELL_SIZE_XYZ=" << Utils::FloatToStr((float)m_boxSize.x / m_gridRes.x);
-  clBuildOptions << " -DGRID_NUM_CELLS=" << m_nbCells;
-  clBuildOptions << " -DNUM_MAX_PARTS_IN_CELL=" << m_maxNbPartsInCell;
-
-  LOG_INFO(clBuildOptions.str());
-  // file.cl order matters, define.cl must be first
-  clContext.createProgram(PROGRAM_BOIDS, std::vector<std::string>({ "define.cl", "boids.cl", "utils.cl", "grid.cl" }), clBuildOptions.str());
+  LOG_INFO(specs.buildOptions);
+  clContext.createProgram(specs);
 
   return true;
 }
@@ -123,15 +136,30 @@ bool Boids::createBuffers() const
 {
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.createGLBuffer("u_cameraPos", m_cameraVBO, CL_MEM_READ_ONLY);
-  clContext.createGLBuffer("p_pos", m_particlePosVBO, CL_MEM_READ_WRITE);
-  clContext.createGLBuffer("p_col", m_particleColVBO, CL_MEM_READ_WRITE);
-  clContext.createGLBuffer("c_partDetector", m_gridVBO, CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_frameState", FRAME_STATE_SIZE, CL_MEM_READ_ONLY);
+
+  // Particles state published for rendering, one set of GL buffers per render slot
+  for (size_t slot = 0; slot < m_particleRenderSlots.size(); ++slot)
+  {
+    const auto& renderSlot = m_particleRenderSlots[slot];
+    clContext.createGLBuffer(renderSlotBufferName("r_pos", slot), renderSlot.posVBO, CL_MEM_WRITE_ONLY, 4 * m_maxNbParticles * sizeof(cl_float));
+    clContext.createGLBuffer(renderSlotBufferName("r_prevPos", slot), renderSlot.prevPosVBO, CL_MEM_WRITE_ONLY, 4 * m_maxNbParticles * sizeof(cl_float));
+    clContext.createGLBuffer(renderSlotBufferName("r_col", slot), renderSlot.colVBO, CL_MEM_WRITE_ONLY, m_maxNbParticles * sizeof(cl_float));
+    clContext.createGLBuffer(renderSlotBufferName("r_quantizedPos", slot), renderSlot.quantizedPosVBO, CL_MEM_WRITE_ONLY, 4 * m_maxNbParticles * sizeof(cl_ushort));
+    clContext.createGLBuffer(renderSlotBufferName("r_visibleIndex", slot), renderSlot.indexVBO, CL_MEM_WRITE_ONLY, m_maxNbParticles * sizeof(cl_uint));
+    clContext.createGLBuffer(renderSlotBufferName("r_partDetector", slot), renderSlot.gridDetectorVBO, CL_MEM_WRITE_ONLY, m_nbCells * sizeof(cl_uchar));
+  }
+
+  clContext.createBuffer("p_pos", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
+  clContext.createBuffer("p_prevPos", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
+  clContext.createBuffer("p_col", m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
 
   clContext.createBuffer("p_vel", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_acc", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_cellID", m_maxNbParticles * sizeof(unsigned int), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_cameraDist", m_maxNbParticles * sizeof(unsigned int), CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_nbVisibleParts", sizeof(unsigned int), CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_groupNbVisibleParts", nbCullingGroups(m_maxNbParticles) * sizeof(unsigned int), CL_MEM_READ_WRITE);
 
   clContext.createBuffer("c_startEndPartID", 2 * m_nbCells * sizeof(unsigned int), CL_MEM_READ_WRITE);
 
@@ -147,10 +175,14 @@ bool Boids::createKernels() const
   clContext.createKernel(PROGRAM_BOIDS, KERNEL_FILL_COLOR, { "p_col" });
 
   // For rendering purpose only
-  clContext.createKernel(PROGRAM_BOIDS, KERNEL_RESET_PART_DETECTOR, { "c_partDetector" });
-  clContext.createKernel(PROGRAM_BOIDS, KERNEL_FILL_PART_DETECTOR, { "p_pos", "c_partDetector" });
+  clContext.createKernel(PROGRAM_BOIDS, KERNEL_RESET_PART_DETECTOR, { "" });
+  clContext.createKernel(PROGRAM_BOIDS, KERNEL_FILL_PART_DETECTOR, { "p_pos", "" });
   clContext.createKernel(PROGRAM_BOIDS, KERNEL_RESET_CAMERA_DIST, { "p_cameraDist" });
-  clContext.createKernel(PROGRAM_BOIDS, KERNEL_FILL_CAMERA_DIST, { "p_pos", "u_cameraPos", "p_cameraDist" });
+  clContext.createKernel(PROGRAM_BOIDS, KERNEL_FILL_CAMERA_DIST, { "p_pos", "u_frameState", "p_cameraDist" });
+  clContext.createKernel(PROGRAM_BOIDS, KERNEL_COUNT_VISIBLE_PARTS, { "p_pos", RadixSort::PermutationBufferName(), "", "u_frameState", "", "u_groupNbVisibleParts" });
+  clContext.createKernel(PROGRAM_BOIDS, KERNEL_SCAN_VISIBLE_PARTS, { "", "u_groupNbVisibleParts", "u_nbVisibleParts" });
+  clContext.createKernel(PROGRAM_BOIDS, KERNEL_COMPACT_VISIBLE_PARTS, { "p_pos", RadixSort::PermutationBufferName(), "", "u_frameState", "", "u_groupNbVisibleParts", "" });
+  clContext.createKernel(PROGRAM_BOIDS, KERNEL_FILL_RENDER_SLOT, { RadixSort::PermutationBufferName(), "", "p_pos", "p_prevPos", "p_col", "", "", "", "", "", "" });
 
   // Boids Physics
   clContext.createKernel(PROGRAM_BOIDS, KERNEL_UPDATE_VEL, { "p_acc", "", "", "p_vel" });
@@ -213,12 +245,15 @@ void Boids::transferKernelInputsToGPU()
 {
   CL::Context& clContext = CL::Context::Get();
 
-  const auto& boidsRuleKernelInputs = getKernelInput<BoidsRuleKernelInputs>(0);
-  clContext.setKernelArg(KERNEL_UPDATE_VEL, 2, sizeof(float), &boidsRuleKernelInputs.velocityScale);
-  clContext.setKernelArg(KERNEL_BOIDS_RULES_GRID_2D, 3, sizeof(BoidsRuleKernelInputs), &boidsRuleKernelInputs);
-  clContext.setKernelArg(KERNEL_BOIDS_RULES_GRID_3D, 3, sizeof(BoidsRuleKernelInputs), &boidsRuleKernelInputs);
+  if (m_parameters.isDirty("/Boids", { "/Boids/Target" }))
+  {
+    const auto& boidsRuleKernelInputs = getKernelInput<BoidsRuleKernelInputs>(0);
+    clContext.setKernelArg(KERNEL_UPDATE_VEL, 2, sizeof(float), &boidsRuleKernelInputs.velocityScale);
+    clContext.setKernelArg(KERNEL_BOIDS_RULES_GRID_2D, 3, sizeof(BoidsRuleKernelInputs), &boidsRuleKernelInputs);
+    clContext.setKernelArg(KERNEL_BOIDS_RULES_GRID_3D, 3, sizeof(BoidsRuleKernelInputs), &boidsRuleKernelInputs);
+  }
 
-  if (isTargetActivated())
+  if (isTargetActivated() && m_parameters.isDirty("/Boids/Target"))
   {
     const auto& targetKernelInputs = getKernelInput<TargetKernelInputs>(1);
     clContext.setKernelArg(KERNEL_ADD_TARGET_RULE, 2, sizeof(TargetKernelInputs), &targetKernelInputs);
@@ -262,16 +297,16 @@ void Boids::reset()
 
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.acquireGLBuffers({ "p_pos", "p_col", "c_partDetector" });
-
   clContext.runKernel(KERNEL_FILL_COLOR, m_maxNbParticles);
-  clContext.runKernel(KERNEL_RESET_PART_DETECTOR, m_nbCells);
-  clContext.runKernel(KERNEL_FILL_PART_DETECTOR, m_currNbParticles);
 
   clContext.runKernel(KERNEL_RESET_CELL_ID, m_maxNbParticles);
   clContext.runKernel(KERNEL_RESET_CAMERA_DIST, m_maxNbParticles);
+}
 
-  clContext.releaseGLBuffers({ "p_pos", "p_col", "c_partDetector" });
+void Boids::onNbParticlesChanged(size_t prevNbParticles)
+{
+  // Restored boids flying again from where they were frozen, no density to disturb
+  excludeInactiveParticles(KERNEL_RESET_CELL_ID, KERNEL_RESET_CAMERA_DIST);
 }
 
 void Boids::initBoidsParticles()
@@ -284,8 +319,6 @@ void Boids::initBoidsParticles()
 
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.acquireGLBuffers({ "p_pos" });
-
   std::vector<Math::float3> gridVerts;
 
   if (m_dimension == Geometry::Dimension::dim2D)
@@ -316,8 +349,6 @@ void Boids::initBoidsParticles()
   clContext.loadBufferFromHost("p_pos", 0, 4 * sizeof(float) * pos.size(), pos.data());
   // Using same buffer to initialize vel, giving interesting patterns
   clContext.loadBufferFromHost("p_vel", 0, 4 * sizeof(float) * pos.size(), pos.data());
-
-  clContext.releaseGLBuffers({ "p_pos" });
 }
 
 void Boids::update()
@@ -327,14 +358,17 @@ void Boids::update()
 
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.acquireGLBuffers({ "p_pos", "p_col", "c_partDetector", "u_cameraPos" });
+  // Rendering purpose, positions before this update kept for interpolation, following particles through sorts
+  if (m_isInterpolationEnabled)
+    clContext.copyBuffer("p_pos", "p_prevPos");
 
-  if (!m_pause)
+  // Fixed time step, several solver steps per update if time budget allows it
+  for (size_t substep = 0; !m_pause && substep < m_nbSubsteps; ++substep)
   {
     float timeStep = 0.1f;
     clContext.runKernel(KERNEL_FILL_CELL_ID, m_currNbParticles);
 
-    m_radixSort.sort("p_cellID", { "p_pos", "p_col", "p_vel", "p_acc" });
+    m_radixSort.sort("p_cellID", withPrevPos({ "p_pos", "p_vel", "p_acc" }));
 
     clContext.runKernel(KERNEL_RESET_START_END_CELL, m_nbCells);
     clContext.runKernel(KERNEL_FILL_START_CELL, m_currNbParticles);
@@ -371,14 +405,37 @@ void Boids::update()
       clContext.runKernel(KERNEL_UPDATE_POS_BOUNCING, m_currNbParticles);
       break;
     }
+  }
 
-    clContext.runKernel(KERNEL_RESET_PART_DETECTOR, m_nbCells);
-    clContext.runKernel(KERNEL_FILL_PART_DETECTOR, m_currNbParticles);
+  // Nothing published without render slots, update then waiting for the device queue like a plain compute step
+  if (!hasRenderSlots())
+  {
+    clContext.finishTasks();
+    return;
   }
 
+  // Render slot granted by the graphics engine, not drawn anymore
+  const auto sharedGLBuffers = renderSlotBufferNames();
+
+  clContext.acquireGLBuffers(sharedGLBuffers);
+
+  // Rendering purpose, only once per update, paused or not
+  fillPartDetector(KERNEL_RESET_PART_DETECTOR, KERNEL_FILL_PART_DETECTOR);
+
+  // Camera state of the last frame drawn by the graphics engine
+  loadCameraState();
+
+  // Only computing the permutation, simulation buffers being read in camera order while filling the render slot
   clContext.runKernel(KERNEL_FILL_CAMERA_DIST, m_currNbParticles);
 
-  m_radixSort.sort("p_cameraDist", { "p_pos", "p_col", "p_vel", "p_acc" });
+  m_radixSort.sort("p_cameraDist");
+
+  // Rendering purpose, publishing particles into the render slot, positions on 3x16 bits instead of 4x32 bits if quantized
+  fillRenderSlot(KERNEL_FILL_RENDER_SLOT, "p_col", true);
+
+  // Rendering purpose, only particles inside camera frustum are drawn
+  if (m_isFrustumCullingEnabled)
+    runFrustumCulling(KERNEL_COUNT_VISIBLE_PARTS, KERNEL_SCAN_VISIBLE_PARTS, KERNEL_COMPACT_VISIBLE_PARTS, true);
 
-  clContext.releaseGLBuffers({ "p_pos", "p_col", "c_partDetector", "u_cameraPos" });
+  clContext.releaseGLBuffers(sharedGLBuffers);
 }
\ No newline at end of file
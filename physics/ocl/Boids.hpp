@@ -41,6 +41,13 @@ class Boids : public OclModel<BoidsRuleKernelInputs, TargetKernelInputs>
   bool isTargetActivated() const override { return m_target.isActivated(); }
   bool isTargetVisible() const override { return m_target.isVisible(); }
 
+  std::map<std::string, double> qualityMetrics() override { return particleMetrics(); }
+
+  bool isNbParticlesAdjustable() const override { return true; }
+
+  // Only depending on the box, to be built before the model is created
+  static programSpecs ProgramSpecs(const Geometry::BoxSize3D& boxSize, const Geometry::BoxSize3D& gridRes);
+
   private:
   void initBoidsParticles();
   bool createProgram() const;
@@ -52,6 +59,8 @@ class Boids : public OclModel<BoidsRuleKernelInputs, TargetKernelInputs>
   void transferJsonInputsToModel(json& inputJson) override;
   void transferKernelInputsToGPU() override;
 
+  void onNbParticlesChanged(size_t prevNbParticles) override;
+
   bool m_activeAlignment;
   bool m_activeCohesion;
   bool m_activeSeparation;
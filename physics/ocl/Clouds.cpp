@@ -7,6 +7,8 @@
 
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <iostream>
@@ -20,11 +22,18 @@ using namespace Physics::CL;
 
 #define PROGRAM_CLOUDS "Clouds"
 
+constexpr size_t MAX_NB_PARTS_IN_CELL = 100;
+
 // utils.cl
 #define KERNEL_INFINITE_POS "infPosVerts"
 #define KERNEL_RESET_CAMERA_DIST "resetCameraDist"
 #define KERNEL_FILL_CAMERA_DIST "fillCameraDist"
-#define KERNEL_FILL_COLOR "fillColorFloat"
+#define KERNEL_COUNT_VISIBLE_PARTS "countVisibleParts"
+#define KERNEL_SCAN_VISIBLE_PARTS "scanVisibleParts"
+#define KERNEL_COMPACT_VISIBLE_PARTS "compactVisibleParts"
+#define KERNEL_FILL_RENDER_SLOT "fillRenderSlot"
+#define KERNEL_RESET_MAX_SQ_VEL "resetMaxSqVel"
+#define KERNEL_MAX_SQ_VEL "computeMaxSqVel"
 
 // grid.cl
 #define KERNEL_RESET_PART_DETECTOR "resetGridDetector"
@@ -57,6 +66,7 @@ using namespace Physics::CL;
 #define KERNEL_COMPUTE_VORTICITY "cld_computeVorticity"
 #define KERNEL_VORTICITY_CONFINEMENT "cld_applyVorticityConfinement"
 #define KERNEL_XSPH_VISCOSITY "cld_applyXsphViscosityCorrection"
+#define KERNEL_VORTICITY_CONFINEMENT_XSPH "cld_applyVorticityConfinementAndXsphViscosity"
 
 //
 #define KERNEL_LAPLACIAN_TEMP "cld_computeLaplacianTemp"
@@ -64,6 +74,11 @@ using namespace Physics::CL;
 #define KERNEL_CONSTRAINT_CORRECTION_TEMP "cld_computeConstraintCorrectionTemp"
 #define KERNEL_CORRECT_TEMP "cld_correctTemperature"
 
+// Volume rendering
+#define KERNEL_RESET_DENSITY_VOLUME "cld_resetDensityVolume"
+#define KERNEL_SPLAT_DENSITY_VOLUME "cld_splatDensityVolume"
+#define KERNEL_FILL_DENSITY_VOLUME "cld_fillDensityVolume"
+
 static const json initCloudsJson // clang-format off
 { 
   {"Fluids", {
@@ -83,7 +98,16 @@ static const json initCloudsJson // clang-format off
           { 
             { "Enable##Vorticity", true },
             { "Coefficient##Vorticity", {0.0004f, 0.0f, 0.001f}},
-            { "xSPH Viscosity Coefficient", {0.0001f, 0.0f, 0.001f}}
+            { "xSPH Viscosity Coefficient", {0.0001f, 0.0f, 0.001f}},
+            { "Fused Confinement Kernel", false }
+          }
+      },
+      { "Adaptive Time Step",
+          { 
+            { "Enable##AdaptiveTimeStep", false },
+            { "CFL Number", {0.4f, 0.05f, 1.0f}},
+            { "Max Time Step", {0.020f, 0.001f, 0.050f}},
+            { "Max Nb Steps", {8, 1, 16}}
           }
       }
     }
@@ -102,13 +126,15 @@ static const json initCloudsJson // clang-format off
 }; // clang-format on
 
 Clouds::Clouds(ModelParams params)
-    : OclModel<FluidKernelInputs, CloudKernelInputs>(params, FluidKernelInputs {}, CloudKernelInputs {}, json(initCloudsJson))
+    : OclModel<FluidKernelInputs, CloudKernelInputs>(ALL_MODELS.at(ModelType::CLOUDS), params, FluidKernelInputs {}, CloudKernelInputs {}, json(initCloudsJson))
     , m_simplifiedMode(true)
-    , m_maxNbPartsInCell(100)
+    , m_maxNbPartsInCell(MAX_NB_PARTS_IN_CELL)
     , m_radixSort(params.maxNbParticles)
     , m_fluidKernelInputs(&getKernelInput<FluidKernelInputs>(0))
     , m_cloudKernelInputs(&getKernelInput<CloudKernelInputs>(1))
     , m_nbJacobiIters(1)
+    , m_isConfinementKernelFused(false)
+    , m_timeStep(0.010f)
 {
   createProgram();
 
@@ -124,37 +150,45 @@ Clouds::Clouds(ModelParams params)
 // Must be on implementation side as FluidKernelInputs must be complete
 Clouds::~Clouds() {};
 
-bool Clouds::createProgram() const
+programSpecs Clouds::ProgramSpecs(const Geometry::BoxSize3D& boxSize, const Geometry::BoxSize3D& gridRes)
 {
-  assert(m_boxSize.x / m_gridRes.x == m_boxSize.y / m_gridRes.y);
-  assert(m_boxSize.z / m_gridRes.z == m_boxSize.y / m_gridRes.y);
+  assert(boxSize.x / gridRes.x == boxSize.y / gridRes.y);
+  assert(boxSize.z / gridRes.z == boxSize.y / gridRes.y);
 
-  float effectRadius = ((float)m_boxSize.x) / m_gridRes.x;
+  float effectRadius = ((float)boxSize.x) / gridRes.x;
 
   std::ostringstream clBuildOptions;
   clBuildOptions << "-DEFFECT_RADIUS=" << Utils::FloatToStr(effectRadius);
-  clBuildOptions << " -DABS_WALL_X=" << Utils::FloatToStr(m_boxSize.x / 2.0f);
-  clBuildOptions << " -DABS_WALL_Y=" << Utils::FloatToStr(m_boxSize.y / 2.0f);
-  clBuildOptions << " -DABS_WALL_Z=" << Utils::FloatToStr(m_boxSize.z / 2.0f);
-  clBuildOptions << " -DGRID_RES_X=" << m_gridRes.x;
-  clBuildOptions << " -DGRID_RES_Y=" << m_gridRes.y;
-  clBuildOptions << " -DGRID_RES_Z=" << m_gridRes.z;
-  clBuildOptions << " -DGRID_CELL_SIZE_XYZ=" << Utils::FloatToStr((float)m_boxSize.x / m_gridRes.x);
-  clBuildOptions << " -DGRID_NUM_CELLS=" << m_nbCells;
-  clBuildOptions << " -DNUM_MAX_PARTS_IN_CELL=" << m_maxNbPartsInCell;
+  clBuildOptions << " -DABS_WALL_X=" << Utils::FloatToStr(boxSize.x / 2.0f);
+  clBuildOptions << " -DABS_WALL_Y=" << Utils::FloatToStr(boxSize.y / 2.0f);
+  clBuildOptions << " -DABS_WALL_Z=" << Utils::FloatToStr(boxSize.z / 2.0f);
+  clBuildOptions << " -DGRID_RES_X=" << gridRes.x;
+  clBuildOptions << " -DGRID_RES_Y=" << gridRes.y;
+  clBuildOptions << " -DGRID_RES_Z=" << gridRes.z;
+  clBuildOptions << " -DGRID_CELL_SIZE_XYZ=" << Utils::FloatToStr((float)boxSize.x / gridRes.x);
+  clBuildOptions << " -DGRID_NUM_CELLS=" << gridRes.x * gridRes.y * gridRes.z;
+  clBuildOptions << " -DNUM_MAX_PARTS_IN_CELL=" << MAX_NB_PARTS_IN_CELL;
   clBuildOptions << " -DPOLY6_COEFF=" << Utils::FloatToStr(315.0f / (64.0f * Math::PI_F * std::pow(effectRadius, 9.f)));
   clBuildOptions << " -DSPIKY_COEFF=" << Utils::FloatToStr(15.0f / (Math::PI_F * std::pow(effectRadius, 6.f)));
+  if (SelectedSphKernelEval() == SphKernelEval::LOOKUP_TABLE)
+    clBuildOptions << " -DSPH_LUT";
   clBuildOptions << " -DMAX_VEL=" << Utils::FloatToStr(30.0f);
 
-  LOG_INFO(clBuildOptions.str());
-
-  CL::Context& clContext = CL::Context::Get();
-
   // file.cl order matters
   // 1/ define.cl must be first as it defines variables used by other kernels
   // 2/ fluids.cl contains Position Based Fluids algorithms needed for the fluids part of the cloud sim
   // 3/ clouds.cl contains Clouds-specific physics and constraint on temperature field, it needs PBF framework
-  clContext.createProgram(PROGRAM_CLOUDS, std::vector<std::string>({ "define.cl", "sph.cl", "clouds.cl", "grid.cl", "utils.cl" }), clBuildOptions.str());
+  return { PROGRAM_CLOUDS, { "define.cl", "sph.cl", "clouds.cl", "grid.cl", "utils.cl" }, clBuildOptions.str() };
+}
+
+bool Clouds::createProgram() const
+{
+  CL::Context& clContext = CL::Context::Get();
+
+  const auto specs = ProgramSpecs(m_boxSize, m_gridRes);
+
+  LOG_INFO(specs.buildOptions);
+  clContext.createProgram(specs);
 
   return true;
 }
@@ -163,10 +197,23 @@ bool Clouds::createBuffers()
 {
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.createGLBuffer("u_cameraPos", m_cameraVBO, CL_MEM_READ_ONLY);
-  clContext.createGLBuffer("p_pos", m_particlePosVBO, CL_MEM_READ_WRITE);
-  clContext.createGLBuffer("p_col", m_particleColVBO, CL_MEM_READ_WRITE);
-  clContext.createGLBuffer("c_partDetector", m_gridVBO, CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_frameState", FRAME_STATE_SIZE, CL_MEM_READ_ONLY);
+
+  // Particles state published for rendering, one set of GL buffers per render slot
+  for (size_t slot = 0; slot < m_particleRenderSlots.size(); ++slot)
+  {
+    const auto& renderSlot = m_particleRenderSlots[slot];
+    clContext.createGLBuffer(renderSlotBufferName("r_pos", slot), renderSlot.posVBO, CL_MEM_WRITE_ONLY, 4 * m_maxNbParticles * sizeof(cl_float));
+    clContext.createGLBuffer(renderSlotBufferName("r_prevPos", slot), renderSlot.prevPosVBO, CL_MEM_WRITE_ONLY, 4 * m_maxNbParticles * sizeof(cl_float));
+    clContext.createGLBuffer(renderSlotBufferName("r_col", slot), renderSlot.colVBO, CL_MEM_WRITE_ONLY, m_maxNbParticles * sizeof(cl_float));
+    clContext.createGLBuffer(renderSlotBufferName("r_quantizedPos", slot), renderSlot.quantizedPosVBO, CL_MEM_WRITE_ONLY, 4 * m_maxNbParticles * sizeof(cl_ushort));
+    clContext.createGLBuffer(renderSlotBufferName("r_visibleIndex", slot), renderSlot.indexVBO, CL_MEM_WRITE_ONLY, m_maxNbParticles * sizeof(cl_uint));
+    clContext.createGLBuffer(renderSlotBufferName("r_partDetector", slot), renderSlot.gridDetectorVBO, CL_MEM_WRITE_ONLY, m_nbCells * sizeof(cl_uchar));
+    clContext.createGLBuffer(renderSlotBufferName("r_densityVolume", slot), renderSlot.densityVolumeVBO, CL_MEM_WRITE_ONLY, m_nbCells * sizeof(cl_float));
+  }
+
+  clContext.createBuffer("p_pos", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
+  clContext.createBuffer("p_prevPos", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
 
   clContext.createBuffer("p_partID", m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
 
@@ -177,10 +224,13 @@ bool Clouds::createBuffers()
   clContext.createBuffer("p_corrPos", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_constFactorFld", m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_vel", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
-  clContext.createBuffer("p_velInViscosity", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
+  clContext.createBuffer("p_velOut", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_vort", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_cellID", m_maxNbParticles * sizeof(unsigned int), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_cameraDist", m_maxNbParticles * sizeof(unsigned int), CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_nbVisibleParts", sizeof(unsigned int), CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_groupNbVisibleParts", nbCullingGroups(m_maxNbParticles) * sizeof(unsigned int), CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_maxSqVel", sizeof(unsigned int), CL_MEM_READ_WRITE);
 
   // Clouds specific
   // Some buffers are duplicated because they are both input/output of some kernels
@@ -197,6 +247,7 @@ bool Clouds::createBuffers()
   clContext.createBuffer("p_cloudGen", m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
 
   clContext.createBuffer("c_startEndPartID", 2 * m_nbCells * sizeof(unsigned int), CL_MEM_READ_WRITE);
+  clContext.createBuffer("c_cloudDensVolumeAcc", m_nbCells * sizeof(unsigned int), CL_MEM_READ_WRITE);
 
   // Physical parameters displayable in UI, only m_maxNbParts * sizeof(float) size supported for now
   PhysicalQuantity partID { "Particle ID", "p_partID", { 0.0f, (float)(m_maxNbParticles - 1) }, { 0.0f, (float)(32000 - 1) } };
@@ -223,11 +274,18 @@ bool Clouds::createKernels() const
   clContext.createKernel(PROGRAM_CLOUDS, KERNEL_INFINITE_POS, { "p_pos" });
 
   // For rendering purpose only
-  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_RESET_PART_DETECTOR, { "c_partDetector" });
-  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_FILL_PART_DETECTOR, { "p_pos", "c_partDetector" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_RESET_PART_DETECTOR, { "" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_FILL_PART_DETECTOR, { "p_pos", "" });
   clContext.createKernel(PROGRAM_CLOUDS, KERNEL_RESET_CAMERA_DIST, { "p_cameraDist" });
-  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_FILL_CAMERA_DIST, { "p_pos", "u_cameraPos", "p_cameraDist" });
-  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_FILL_COLOR, { "", "", "", "p_col" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_FILL_CAMERA_DIST, { "p_pos", "u_frameState", "p_cameraDist" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_COUNT_VISIBLE_PARTS, { "p_pos", RadixSort::PermutationBufferName(), "", "u_frameState", "", "u_groupNbVisibleParts" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_SCAN_VISIBLE_PARTS, { "", "u_groupNbVisibleParts", "u_nbVisibleParts" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_COMPACT_VISIBLE_PARTS, { "p_pos", RadixSort::PermutationBufferName(), "", "u_frameState", "", "u_groupNbVisibleParts", "" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_FILL_RENDER_SLOT, { RadixSort::PermutationBufferName(), "", "p_pos", "p_prevPos", "", "", "", "", "", "", "" });
+
+  // Adaptive time step
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_RESET_MAX_SQ_VEL, { "u_maxSqVel" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_MAX_SQ_VEL, { "p_vel", "u_maxSqVel" });
 
   // Radix Sort based on 3D grid, using predicted positions, not corrected ones
   clContext.createKernel(PROGRAM_CLOUDS, KERNEL_RESET_CELL_ID, { "p_cellID" });
@@ -268,11 +326,17 @@ bool Clouds::createKernels() const
   /// Velocity update and correction using vorticity confinement and xsph viscosity
   clContext.createKernel(PROGRAM_CLOUDS, KERNEL_UPDATE_VEL, { "p_totCorrPos", "", "p_vel" });
   clContext.createKernel(PROGRAM_CLOUDS, KERNEL_COMPUTE_VORTICITY, { "p_predPos", "c_startEndPartID", "p_vel", "", "p_vort" });
-  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_VORTICITY_CONFINEMENT, { "p_predPos", "c_startEndPartID", "p_vort", "", "p_vel" });
-  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_XSPH_VISCOSITY, { "p_predPos", "c_startEndPartID", "p_velInViscosity", "", "p_vel" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_VORTICITY_CONFINEMENT, { "p_predPos", "c_startEndPartID", "p_vort", "p_vel", "", "p_velOut" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_XSPH_VISCOSITY, { "p_predPos", "c_startEndPartID", "p_vel", "", "p_velOut" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_VORTICITY_CONFINEMENT_XSPH, { "p_predPos", "c_startEndPartID", "p_vort", "p_vel", "", "p_velOut" });
   /// Position update
   clContext.createKernel(PROGRAM_CLOUDS, KERNEL_UPDATE_POS, { "p_predPos", "", "p_pos" });
 
+  // Volume rendering
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_RESET_DENSITY_VOLUME, { "c_cloudDensVolumeAcc" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_SPLAT_DENSITY_VOLUME, { "p_pos", "p_cloudDens", "c_cloudDensVolumeAcc" });
+  clContext.createKernel(PROGRAM_CLOUDS, KERNEL_FILL_DENSITY_VOLUME, { "c_cloudDensVolumeAcc", "" });
+
   return true;
 }
 
@@ -290,7 +354,8 @@ void Clouds::transferJsonInputsToModel(json& inputJson)
 
     m_fluidKernelInputs->restDensity = (cl_float)(fluidsJson["Rest Density"][0]);
     m_fluidKernelInputs->relaxCFM = (cl_float)(fluidsJson["Relax CFM"][0]);
-    m_fluidKernelInputs->timeStep = (cl_float)(fluidsJson["Time Step"][0]);
+    m_timeStep = fluidsJson["Time Step"][0];
+    m_fluidKernelInputs->timeStep = (cl_float)m_timeStep;
     m_fluidKernelInputs->dim = (cl_uint)((m_dimension == Geometry::Dimension::dim2D) ? 2 : 3);
 
     m_fluidKernelInputs->isArtPressureEnabled = (cl_uint)((fluidsJson["Artificial Pressure"]["Enable##Pressure"] == true) ? 1 : 0);
@@ -301,12 +366,18 @@ void Clouds::transferJsonInputsToModel(json& inputJson)
     m_fluidKernelInputs->isVorticityConfEnabled = (cl_uint)((fluidsJson["Vorticity Confinement"]["Enable##Vorticity"] == true) ? 1 : 0);
     m_fluidKernelInputs->vorticityConfCoeff = (cl_float)(fluidsJson["Vorticity Confinement"]["Coefficient##Vorticity"][0]);
     m_fluidKernelInputs->xsphViscosityCoeff = (cl_float)(fluidsJson["Vorticity Confinement"]["xSPH Viscosity Coefficient"][0]);
+    m_isConfinementKernelFused = (fluidsJson["Vorticity Confinement"]["Fused Confinement Kernel"] == true);
+
+    m_isAdaptiveTimeStepEnabled = (fluidsJson["Adaptive Time Step"]["Enable##AdaptiveTimeStep"] == true);
+    m_cflNumber = fluidsJson["Adaptive Time Step"]["CFL Number"][0];
+    m_maxTimeStep = fluidsJson["Adaptive Time Step"]["Max Time Step"][0];
+    m_maxNbAdaptiveSteps = fluidsJson["Adaptive Time Step"]["Max Nb Steps"][0];
 
     const auto& cloudsJson = inputJson["Clouds"];
 
     // Some values are taken from the fluids input json as values must remain equal
     m_cloudKernelInputs->restDensity = (cl_float)(fluidsJson["Rest Density"][0]);
-    m_cloudKernelInputs->timeStep = (cl_float)(fluidsJson["Time Step"][0]);
+    m_cloudKernelInputs->timeStep = (cl_float)m_timeStep;
     m_cloudKernelInputs->dim = (cl_uint)((m_dimension == Geometry::Dimension::dim2D) ? 2 : 3);
     m_cloudKernelInputs->relaxCFM = (cl_float)(fluidsJson["Relax CFM"][0]);
 
@@ -330,9 +401,15 @@ void Clouds::transferJsonInputsToModel(json& inputJson)
 
 void Clouds::transferKernelInputsToGPU()
 {
-  updateFluidsParamsInKernels();
+  // Jacobi iterations and kernel fusion only drive the host-side solver loop
+  const bool isFluidsDirty = m_parameters.isDirty("/Fluids", { "/Fluids/Nb Jacobi Iterations", "/Fluids/Vorticity Confinement/Fused Confinement Kernel" });
 
-  updateCloudsParamsInKernels();
+  if (isFluidsDirty)
+    updateFluidsParamsInKernels();
+
+  // Clouds kernel inputs also take some of the fluids parameters
+  if (isFluidsDirty || m_parameters.isDirty("/Clouds"))
+    updateCloudsParamsInKernels();
 };
 
 void Clouds::updateFluidsParamsInKernels()
@@ -349,8 +426,9 @@ void Clouds::updateFluidsParamsInKernels()
   clContext.setKernelArg(KERNEL_CONSTRAINT_FACTOR_FLUIDS, 3, sizeof(FluidKernelInputs), m_fluidKernelInputs);
   clContext.setKernelArg(KERNEL_CONSTRAINT_CORRECTION_FLUIDS, 3, sizeof(FluidKernelInputs), m_fluidKernelInputs);
   clContext.setKernelArg(KERNEL_COMPUTE_VORTICITY, 3, sizeof(FluidKernelInputs), m_fluidKernelInputs);
-  clContext.setKernelArg(KERNEL_VORTICITY_CONFINEMENT, 3, sizeof(FluidKernelInputs), m_fluidKernelInputs);
+  clContext.setKernelArg(KERNEL_VORTICITY_CONFINEMENT, 4, sizeof(FluidKernelInputs), m_fluidKernelInputs);
   clContext.setKernelArg(KERNEL_XSPH_VISCOSITY, 3, sizeof(FluidKernelInputs), m_fluidKernelInputs);
+  clContext.setKernelArg(KERNEL_VORTICITY_CONFINEMENT_XSPH, 4, sizeof(FluidKernelInputs), m_fluidKernelInputs);
 }
 
 void Clouds::updateCloudsParamsInKernels()
@@ -389,13 +467,26 @@ void Clouds::reset()
 
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.acquireGLBuffers({ "p_pos", "c_partDetector" });
-  clContext.runKernel(KERNEL_RESET_PART_DETECTOR, m_nbCells);
-  clContext.runKernel(KERNEL_FILL_PART_DETECTOR, m_currNbParticles);
-  clContext.releaseGLBuffers({ "p_pos", "c_partDetector" });
-
   clContext.runKernel(KERNEL_RESET_CELL_ID, m_maxNbParticles);
   clContext.runKernel(KERNEL_RESET_CAMERA_DIST, m_maxNbParticles);
+
+  resetAdaptiveTimeStep();
+}
+
+float Clouds::applyAdaptiveTimeStep(float remainingTime)
+{
+  const float timeStep = computeAdaptiveTimeStep(KERNEL_RESET_MAX_SQ_VEL, KERNEL_MAX_SQ_VEL, remainingTime);
+
+  // Both kernel inputs must keep the same time step
+  if (m_fluidKernelInputs->timeStep != timeStep)
+  {
+    m_fluidKernelInputs->timeStep = timeStep;
+    m_cloudKernelInputs->timeStep = timeStep;
+    updateFluidsParamsInKernels();
+    updateCloudsParamsInKernels();
+  }
+
+  return timeStep;
 }
 
 void Clouds::initCloudsParticles()
@@ -405,8 +496,6 @@ void Clouds::initCloudsParticles()
 
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.acquireGLBuffers({ "p_pos", "p_col" });
-
   std::vector<Math::float3> gridVerts;
 
   Math::float3 startFluidPos = { 0.0f, 0.0f, 0.0f };
@@ -481,9 +570,6 @@ void Clouds::initCloudsParticles()
   std::vector<std::array<float, 4>> vel(m_maxNbParticles, std::array<float, 4>({ 0.0f, 0.0f, 0.0f, 0.0f }));
   clContext.loadBufferFromHost("p_vel", 0, 4 * sizeof(float) * vel.size(), vel.data());
 
-  std::vector<std::array<float, 4>> col(m_maxNbParticles, std::array<float, 4>({ 0.0f, 0.1f, 1.0f, 0.0f }));
-  clContext.loadBufferFromHost("p_col", 0, 4 * sizeof(float) * col.size(), col.data());
-
   std::vector<float> cloudDens(m_maxNbParticles, 0.0f);
   clContext.loadBufferFromHost("p_cloudDens", 0, sizeof(float) * cloudDens.size(), cloudDens.data());
 
@@ -496,8 +582,6 @@ void Clouds::initCloudsParticles()
   clContext.runKernel(KERNEL_INIT_TEMP, m_maxNbParticles);
 
   clContext.runKernel(KERNEL_INIT_VAPOR_DENSITY, m_maxNbParticles);
-
-  clContext.releaseGLBuffers({ "p_pos", "p_col" });
 }
 
 void Clouds::update()
@@ -507,10 +591,21 @@ void Clouds::update()
 
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.acquireGLBuffers({ "p_pos", "p_col", "c_partDetector", "u_cameraPos" });
+  // Rendering purpose, positions before this update kept for interpolation, following particles through sorts
+  if (m_isInterpolationEnabled)
+    clContext.copyBuffer("p_pos", "p_prevPos");
 
-  if (!m_pause)
+  // Fixed time step, several solver steps per update if time budget allows it
+  // Adaptive one covering up to max time step per substep with as many steps as the CFL condition requires,
+  // the rest of it being dropped if max number of steps is reached, slowing down violent phases to keep them stable
+  float remainingTime = simulatedTimePerUpdate(m_timeStep);
+  const size_t nbMaxSteps = m_isAdaptiveTimeStepEnabled ? m_maxNbAdaptiveSteps : m_nbSubsteps;
+  for (size_t substep = 0; !m_pause && substep < nbMaxSteps; ++substep)
   {
+    remainingTime -= m_isAdaptiveTimeStepEnabled ? applyAdaptiveTimeStep(remainingTime) : m_timeStep;
+
+    const bool isLastSubstep = (substep + 1 == nbMaxSteps) || (remainingTime < 0.5f * MIN_TIME_STEP);
+
     // Clouds thermodynamics
     // Copying temperature to other buffer as HeatGround kernel need it as both input and output
     clContext.copyBuffer("p_temp", "p_tempIn");
@@ -540,7 +635,7 @@ void Clouds::update()
     // NNS - spatial partitioning
     clContext.runKernel(KERNEL_FILL_CELL_ID, m_currNbParticles);
 
-    m_radixSort.sort("p_cellID", { "p_pos", "p_col", "p_vel", "p_predPos", "p_totCorrPos" }, { "p_temp", "p_buoyancy", "p_vaporDens", "p_cloudDens", "p_partID" });
+    m_radixSort.sort("p_cellID", withPrevPos({ "p_pos", "p_vel", "p_predPos", "p_totCorrPos" }), { "p_temp", "p_buoyancy", "p_vaporDens", "p_cloudDens", "p_partID" });
 
     clContext.runKernel(KERNEL_RESET_START_END_CELL, m_nbCells);
     clContext.runKernel(KERNEL_FILL_START_CELL, m_currNbParticles);
@@ -593,35 +688,81 @@ void Clouds::update()
     {
       // Computing vorticity
       clContext.runKernel(KERNEL_COMPUTE_VORTICITY, m_currNbParticles);
-      // Applying vorticity confinement to attenue virtual damping
-      clContext.runKernel(KERNEL_VORTICITY_CONFINEMENT, m_currNbParticles);
-      // Copying velocity buffer as input for vorticity confinement correction
-      clContext.copyBuffer("p_vel", "p_velInViscosity");
-      // Applying xsph viscosity correction for a more coherent motion
-      clContext.runKernel(KERNEL_XSPH_VISCOSITY, m_currNbParticles);
+
+      if (m_isConfinementKernelFused)
+      {
+        // Applying vorticity confinement and xsph viscosity correction in a single pass, both reading unmodified velocities
+        clContext.runKernel(KERNEL_VORTICITY_CONFINEMENT_XSPH, m_currNbParticles);
+        // Corrected velocities becoming the current ones, kernels following the swapped buffers
+        clContext.swapBuffers("p_vel", "p_velOut");
+      }
+      else
+      {
+        // Applying vorticity confinement to attenue virtual damping
+        clContext.runKernel(KERNEL_VORTICITY_CONFINEMENT, m_currNbParticles);
+        // Confined velocities becoming the current ones, read by xsph viscosity instead of a copy of them
+        clContext.swapBuffers("p_vel", "p_velOut");
+        // Applying xsph viscosity correction for a more coherent motion
+        clContext.runKernel(KERNEL_XSPH_VISCOSITY, m_currNbParticles);
+        clContext.swapBuffers("p_vel", "p_velOut");
+      }
     }
 
     // Updating pos
     clContext.runKernel(KERNEL_UPDATE_POS, m_currNbParticles);
 
-    // Rendering purpose
-    clContext.runKernel(KERNEL_RESET_PART_DETECTOR, m_nbCells);
-    clContext.runKernel(KERNEL_FILL_PART_DETECTOR, m_currNbParticles);
+    if (isLastSubstep)
+      break;
   }
 
-  // Sending selected physical parameter to color buffer for rendering
-  const auto& currentPhysicalQuantity = currentDisplayedPhysicalQuantity();
-  cl_float minVal = (cl_float)currentPhysicalQuantity.userRange.first;
-  cl_float maxVal = (cl_float)currentPhysicalQuantity.userRange.second;
-  clContext.setKernelArg(KERNEL_FILL_COLOR, 0, currentPhysicalQuantity.bufferName);
-  clContext.setKernelArg(KERNEL_FILL_COLOR, 1, sizeof(cl_float), &minVal);
-  clContext.setKernelArg(KERNEL_FILL_COLOR, 2, sizeof(cl_float), &maxVal);
-  clContext.runKernel(KERNEL_FILL_COLOR, m_currNbParticles);
+  if (m_isAdaptiveTimeStepEnabled)
+    reportDroppedTime(remainingTime);
 
-  // Rendering purpose
-  clContext.runKernel(KERNEL_FILL_CAMERA_DIST, m_currNbParticles);
+  // Nothing published without render slots, update then waiting for the device queue like a plain compute step
+  if (!hasRenderSlots())
+  {
+    clContext.finishTasks();
+    return;
+  }
+
+  // Render slot granted by the graphics engine, not drawn anymore
+  auto sharedGLBuffers = renderSlotBufferNames();
+  if (m_isVolumeRenderingEnabled)
+    sharedGLBuffers.push_back(renderSlotBufferName("r_densityVolume", m_renderSlot));
 
-  m_radixSort.sort("p_cameraDist", { "p_pos", "p_col", "p_vel", "p_predPos" }, { "p_temp", "p_buoyancy", "p_vaporDens", "p_cloudDens", "p_partID" });
+  clContext.acquireGLBuffers(sharedGLBuffers);
+
+  // Rendering purpose, only once per update, paused or not
+  fillPartDetector(KERNEL_RESET_PART_DETECTOR, KERNEL_FILL_PART_DETECTOR);
+
+  if (m_isVolumeRenderingEnabled)
+  {
+    // Rendering purpose, cloud density splatted into the grid and ray-marched by the graphics engine
+    // No camera sort needed, particles are not drawn
+    clContext.runKernel(KERNEL_RESET_DENSITY_VOLUME, m_nbCells);
+    clContext.runKernel(KERNEL_SPLAT_DENSITY_VOLUME, m_currNbParticles);
+    clContext.setKernelArg(KERNEL_FILL_DENSITY_VOLUME, 1, renderSlotBufferName("r_densityVolume", m_renderSlot));
+    clContext.runKernel(KERNEL_FILL_DENSITY_VOLUME, m_nbCells);
+  }
+  else
+  {
+    // Rendering purpose
+    // Camera state of the last frame drawn by the graphics engine
+    loadCameraState();
+
+    // Only computing the permutation, simulation buffers being read in camera order while filling the render slot
+    clContext.runKernel(KERNEL_FILL_CAMERA_DIST, m_currNbParticles);
+
+    m_radixSort.sort("p_cameraDist");
+
+    // Rendering purpose, publishing particles into the render slot, positions on 3x16 bits instead of 4x32 bits if quantized
+    // Selected physical quantity sent to color buffer, colormap and user range are applied at rendering
+    fillRenderSlot(KERNEL_FILL_RENDER_SLOT, currentDisplayedPhysicalQuantity().bufferName, true);
+
+    // Rendering purpose, only particles inside camera frustum are drawn
+    if (m_isFrustumCullingEnabled)
+      runFrustumCulling(KERNEL_COUNT_VISIBLE_PARTS, KERNEL_SCAN_VISIBLE_PARTS, KERNEL_COMPACT_VISIBLE_PARTS, true);
+  }
 
-  clContext.releaseGLBuffers({ "p_pos", "p_col", "c_partDetector", "u_cameraPos" });
+  clContext.releaseGLBuffers(sharedGLBuffers);
 }
\ No newline at end of file
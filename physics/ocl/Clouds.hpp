@@ -53,6 +53,14 @@ class Clouds : public OclModel<FluidKernelInputs, CloudKernelInputs>
   void update() override;
   void reset() override;
 
+  std::map<std::string, double> qualityMetrics() override { return particleMetrics(m_fluidKernelInputs->restDensity); }
+
+  // Air filling the whole box, restored particles would come back within it whatever their position
+  bool isNbParticlesAdjustable() const override { return false; }
+
+  // Only depending on the box, to be built before the model is created
+  static programSpecs ProgramSpecs(const Geometry::BoxSize3D& boxSize, const Geometry::BoxSize3D& gridRes);
+
   private:
   bool createProgram() const;
   bool createBuffers();
@@ -63,6 +71,9 @@ class Clouds : public OclModel<FluidKernelInputs, CloudKernelInputs>
   void updateFluidsParamsInKernels();
   void updateCloudsParamsInKernels();
 
+  // Adaptive time step set in kernels, see computeAdaptiveTimeStep()
+  float applyAdaptiveTimeStep(float remainingTime);
+
   void transferJsonInputsToModel(json& inputJson) override;
   void transferKernelInputsToGPU() override;
 
@@ -71,6 +82,11 @@ class Clouds : public OclModel<FluidKernelInputs, CloudKernelInputs>
   size_t m_maxNbPartsInCell;
 
   size_t m_nbJacobiIters;
+  // Vorticity confinement and xsph viscosity applied by a single kernel, viscosity then ignoring confinement
+  bool m_isConfinementKernelFused;
+
+  // Simulated time per substep with a fixed time step, see simulatedTimePerUpdate()
+  float m_timeStep;
 
   RadixSort m_radixSort;
 
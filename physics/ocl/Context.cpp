@@ -7,6 +7,9 @@
 #endif
 #ifdef __linux__
 #include "GL/glx.h"
+#ifdef HEADLESS_ENABLED
+#include <EGL/egl.h>
+#endif
 #endif
 #ifdef __APPLE__
 #include <OpenGL/OpenGL.h>
@@ -17,11 +20,28 @@
 #include "Utils.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 
+namespace
+{
+// Appended to model-specific options of every program
+const std::string COMMON_BUILD_OPTIONS = " -cl-denorms-are-zero -cl-fast-relaxed-math";
+}
+
+bool Physics::CL::Context::s_isComputeOnlyRequested = false;
+cl_device_type Physics::CL::Context::s_computeOnlyDeviceType = CL_DEVICE_TYPE_DEFAULT;
+
+void Physics::CL::Context::RequestComputeOnly(cl_device_type deviceType)
+{
+  s_isComputeOnlyRequested = true;
+  s_computeOnlyDeviceType = deviceType;
+}
+
 Physics::CL::Context& Physics::CL::Context::Get()
 {
   static Context context;
@@ -29,21 +49,34 @@ Physics::CL::Context& Physics::CL::Context::Get()
 }
 
 Physics::CL::Context::Context()
-    : m_isKernelProfilingEnabled(false)
+    : m_scopeUseCounter(0)
+    , m_scopeCacheBudget(0)
+    , m_isKernelProfilingEnabled(false)
+    , m_isComputeOnly(s_isComputeOnlyRequested)
     , m_init(false)
 {
   if (!findPlatforms())
     return;
 
-  if (!findGPUDevices())
-    return;
+  if (m_isComputeOnly)
+  {
+    if (!createComputeOnlyContext())
+      return;
+  }
+  else
+  {
+    if (!findGPUDevices())
+      return;
 
-  if (!createContext())
-    return;
+    if (!createContext())
+      return;
+  }
 
-  if (!createCommandQueue())
+  if (!createCommandQueue(cl_queue))
     return;
 
+  m_scopeCacheBudget = (size_t)(cl_device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 2);
+
   m_init = true;
 }
 
@@ -151,6 +184,15 @@ bool Physics::CL::Context::createContext()
       CL_CONTEXT_PLATFORM, (cl_context_properties)platform(),
       0
     };
+#ifdef HEADLESS_ENABLED
+    // Offscreen rendering, no GLX context but an EGL one
+    if (glXGetCurrentContext() == nullptr)
+    {
+      props[1] = (cl_context_properties)eglGetCurrentContext();
+      props[2] = CL_EGL_DISPLAY_KHR;
+      props[3] = (cl_context_properties)eglGetCurrentDisplay();
+    }
+#endif
 #endif
 #ifdef __APPLE__
     cl_context_properties props[] = {
@@ -184,7 +226,43 @@ bool Physics::CL::Context::createContext()
   return false;
 }
 
-bool Physics::CL::Context::createCommandQueue()
+bool Physics::CL::Context::createComputeOnlyContext()
+{
+  LOG_INFO("Trying to create an OpenCL context without OpenGL interop");
+
+  for (const auto& platform : m_allPlatforms)
+  {
+    std::vector<cl::Device> devicesOnPlatform;
+    platform.getDevices(s_computeOnlyDeviceType, &devicesOnPlatform);
+
+    if (devicesOnPlatform.empty())
+      continue;
+
+    cl_context_properties props[] = {
+      CL_CONTEXT_PLATFORM, (cl_context_properties)platform(),
+      0
+    };
+
+    for (const auto& device : devicesOnPlatform)
+    {
+      cl_int err;
+      cl_context = cl::Context(device, props, nullptr, nullptr, &err);
+      if (err == CL_SUCCESS)
+      {
+        cl_platform = platform;
+        cl_device = device;
+
+        LOG_INFO("Success! Created a compute-only OpenCL context with platform {} and device {}", getPlatformName(), getDeviceName());
+        return true;
+      }
+    }
+  }
+
+  LOG_ERROR("Error while creating compute-only OpenCL context, no device of requested type");
+  return false;
+}
+
+bool Physics::CL::Context::createCommandQueue(cl::CommandQueue& queue)
 {
   if (cl_context() == 0 || cl_device() == 0)
     return false;
@@ -192,7 +270,7 @@ bool Physics::CL::Context::createCommandQueue()
   cl_command_queue_properties properties = CL_QUEUE_PROFILING_ENABLE;
 
   cl_int err;
-  cl_queue = cl::CommandQueue(cl_context, cl_device, properties, &err);
+  queue = cl::CommandQueue(cl_context, cl_device, properties, &err);
   if (err != CL_SUCCESS)
   {
     LOG_ERROR("Cannot create OpenCL queue");
@@ -201,6 +279,56 @@ bool Physics::CL::Context::createCommandQueue()
   return true;
 }
 
+cl::CommandQueue& Physics::CL::Context::queue()
+{
+  return (cl_threadQueue() != nullptr && std::this_thread::get_id() == m_threadQueueOwner) ? cl_threadQueue : cl_queue;
+}
+
+bool Physics::CL::Context::createThreadQueue()
+{
+  if (!m_init)
+    return false;
+
+  if (cl_threadQueue() != nullptr)
+  {
+    LOG_ERROR("OpenCL thread queue already created");
+    return false;
+  }
+
+  // Commands already enqueued by other threads completed before the thread ones start
+  if (!finishTasks())
+    return false;
+
+  if (!createCommandQueue(cl_threadQueue))
+    return false;
+
+  m_threadQueueOwner = std::this_thread::get_id();
+
+  LOG_DEBUG("OpenCL thread queue created");
+  return true;
+}
+
+bool Physics::CL::Context::releaseThreadQueue()
+{
+  if (!m_init || cl_threadQueue() == nullptr)
+    return true;
+
+  // Only the owner thread finishes its own queue
+  if (std::this_thread::get_id() != m_threadQueueOwner)
+  {
+    LOG_ERROR("OpenCL thread queue released by another thread");
+    return false;
+  }
+
+  const bool isFinished = finishTasks();
+
+  cl_threadQueue = cl::CommandQueue();
+  m_threadQueueOwner = std::thread::id();
+
+  LOG_DEBUG("OpenCL thread queue released");
+  return isFinished;
+}
+
 bool Physics::CL::Context::release()
 {
   if (!m_init)
@@ -211,24 +339,125 @@ bool Physics::CL::Context::release()
   LOG_DEBUG("Physics::CL::Context::release - Context has been cleaned");
 
   m_programsMap.clear();
+  m_programBuildKeys.clear();
   m_kernelsMap.clear();
+  m_kernelArgNames.clear();
   m_buffersMap.clear();
   m_GLBuffersMap.clear();
   m_imagesMap.clear();
 
+  m_parkedScopes.clear();
+  m_cachedMemoryNames.clear();
+  m_currScopeName.clear();
+
+  // Waiting for background builds still running
+  m_prebuiltPrograms.clear();
+
+  return true;
+}
+
+bool Physics::CL::Context::useScope(const std::string& scopeName)
+{
+  if (!m_init)
+    return false;
+
+  if (!m_currScopeName.empty())
+    parkScope();
+
+  m_currScopeName = scopeName;
+
+  auto it = m_parkedScopes.find(scopeName);
+  if (it == m_parkedScopes.end())
+    return true;
+
+  auto& scope = it->second;
+  m_programsMap.swap(scope.programsMap);
+  m_programBuildKeys.swap(scope.programBuildKeys);
+  m_buffersMap.swap(scope.buffersMap);
+  m_imagesMap.swap(scope.imagesMap);
+
+  for (const auto& buffer : m_buffersMap)
+    m_cachedMemoryNames.insert(buffer.first);
+  for (const auto& image : m_imagesMap)
+    m_cachedMemoryNames.insert(image.first);
+
+  LOG_INFO("Reusing cached OpenCL scope {}: {} programs, {} MB", scopeName, m_programsMap.size(), scope.memorySize / (1024 * 1024));
+
+  m_parkedScopes.erase(it);
+
+  return true;
+}
+
+bool Physics::CL::Context::parkScope()
+{
+  if (!m_init || m_currScopeName.empty())
+    return true;
+
+  finishTasks();
+
+  Scope scope;
+  scope.lastUse = ++m_scopeUseCounter;
+  scope.programsMap.swap(m_programsMap);
+  scope.programBuildKeys.swap(m_programBuildKeys);
+  scope.buffersMap.swap(m_buffersMap);
+  scope.imagesMap.swap(m_imagesMap);
+
+  for (const auto& buffer : scope.buffersMap)
+    scope.memorySize += buffer.second.getInfo<CL_MEM_SIZE>();
+  for (const auto& image : scope.imagesMap)
+    scope.memorySize += image.second.getInfo<CL_MEM_SIZE>();
+
+  // GL buffers belong to the graphics engine, likely recreated along with the next model
+  m_kernelsMap.clear();
+  m_kernelArgNames.clear();
+  m_GLBuffersMap.clear();
+  m_cachedMemoryNames.clear();
+
+  LOG_DEBUG("OpenCL scope {} parked with {} MB", m_currScopeName, scope.memorySize / (1024 * 1024));
+
+  m_parkedScopes[m_currScopeName] = std::move(scope);
+  m_currScopeName.clear();
+
+  while (parkedScopesMemory() > m_scopeCacheBudget)
+    evictOldestScope();
+
+  return true;
+}
+
+size_t Physics::CL::Context::parkedScopesMemory() const
+{
+  size_t memorySize = 0;
+  for (const auto& scope : m_parkedScopes)
+    memorySize += scope.second.memorySize;
+
+  return memorySize;
+}
+
+bool Physics::CL::Context::evictOldestScope()
+{
+  if (m_parkedScopes.empty())
+    return false;
+
+  auto oldest = std::min_element(m_parkedScopes.begin(), m_parkedScopes.end(),
+      [](const auto& scopeA, const auto& scopeB) { return scopeA.second.lastUse < scopeB.second.lastUse; });
+
+  LOG_INFO("Evicting cached OpenCL scope {}, {} MB released", oldest->first, oldest->second.memorySize / (1024 * 1024));
+
+  m_parkedScopes.erase(oldest);
+
   return true;
 }
 
 bool Physics::CL::Context::finishTasks()
 {
-  cl_int err = cl_queue.flush();
+  cl_int err = queue().flush();
   if (err != CL_SUCCESS)
   {
     CL_ERROR(err, "Cannot flush queue");
     return false;
   }
 
-  err = cl_queue.finish();
+  err = queue().finish();
   if (err != CL_SUCCESS)
   {
     CL_ERROR(err, "Cannot finish queue");
@@ -239,11 +468,17 @@ bool Physics::CL::Context::finishTasks()
   return true;
 }
 
-bool Physics::CL::Context::createProgram(std::string programName, std::vector<std::string> sourceNames, std::string specificBuildOptions)
+std::string Physics::CL::Context::programBuildKey(const std::vector<std::string>& sourceNames, const std::string& specificBuildOptions)
 {
-  if (!m_init)
-    return false;
+  std::string buildKey = specificBuildOptions;
+  for (const auto& sourceName : sourceNames)
+    buildKey += " " + sourceName;
+
+  return buildKey;
+}
 
+cl::Program::Sources Physics::CL::Context::readProgramSources(const std::vector<std::string>& sourceNames)
+{
   cl::Program::Sources sources;
   for (const auto& sourceName : sourceNames)
   {
@@ -260,9 +495,93 @@ bool Physics::CL::Context::createProgram(std::string programName, std::vector<st
     sources.push_back(sourceCode);
   }
 
-  auto program = cl::Program(cl_context, sources);
+  return sources;
+}
+
+std::shared_future<bool> Physics::CL::Context::buildProgramAsync(const programSpecs& specs)
+{
+  if (!m_init)
+  {
+    std::promise<bool> notBuilt;
+    notBuilt.set_value(false);
+    return notBuilt.get_future().share();
+  }
+
+  const std::string buildKey = programBuildKey(specs.sourceNames, specs.buildOptions);
+
+  auto it = m_prebuiltPrograms.find(specs.name);
+  if (it != m_prebuiltPrograms.end() && it->second.buildKey == buildKey)
+    return it->second.isBuilt;
+
+  PrebuiltProgram prebuilt;
+  prebuilt.buildKey = buildKey;
+  prebuilt.program = std::make_shared<cl::Program>();
+
+  // OpenCL calls are thread-safe, kernel arguments setting aside, so programs can build concurrently
+  // Only the task touches the program until its future is ready
+  auto program = prebuilt.program;
+  const cl::Context context = cl_context;
+  const cl::Device device = cl_device;
+  prebuilt.isBuilt = std::async(std::launch::async, [specs, program, context, device]() {
+    try
+    {
+      *program = cl::Program(context, readProgramSources(specs.sourceNames));
+      program->build({ device }, (specs.buildOptions + COMMON_BUILD_OPTIONS).c_str());
+    }
+    catch (...)
+    {
+      return false;
+    }
+
+    LOG_INFO("Program {} built in background", specs.name);
+    return true;
+  }).share();
+
+  m_prebuiltPrograms[specs.name] = prebuilt;
+
+  return prebuilt.isBuilt;
+}
+
+bool Physics::CL::Context::createProgram(std::string programName, std::vector<std::string> sourceNames, std::string specificBuildOptions)
+{
+  if (!m_init)
+    return false;
+
+  const std::string buildKey = programBuildKey(sourceNames, specificBuildOptions);
+
+  if (m_programsMap.find(programName) != m_programsMap.end())
+  {
+    // Cached by the scope, already built with the same sources and options
+    if (m_programBuildKeys[programName] == buildKey)
+    {
+      LOG_DEBUG("Program {} already built, reusing it", programName);
+      return true;
+    }
+
+    m_programsMap.erase(programName);
+  }
+
+  // Built in background with the same sources and options, waiting for it if not done yet
+  auto itPrebuilt = m_prebuiltPrograms.find(programName);
+  if (itPrebuilt != m_prebuiltPrograms.end() && itPrebuilt->second.buildKey == buildKey)
+  {
+    const auto& prebuilt = itPrebuilt->second;
+
+    if (prebuilt.isBuilt.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      LOG_INFO("Waiting for program {} being built in background", programName);
+
+    // Otherwise built again below to report the build log
+    if (prebuilt.isBuilt.get())
+    {
+      m_programsMap.insert(std::make_pair(programName, *prebuilt.program));
+      m_programBuildKeys[programName] = buildKey;
+      return true;
+    }
+  }
+
+  auto program = cl::Program(cl_context, readProgramSources(sourceNames));
 
-  std::string options = specificBuildOptions + std::string(" -cl-denorms-are-zero -cl-fast-relaxed-math");
+  std::string options = specificBuildOptions + COMMON_BUILD_OPTIONS;
 
   try
   {
@@ -280,6 +599,7 @@ bool Physics::CL::Context::createProgram(std::string programName, std::vector<st
   }
 
   m_programsMap.insert(std::make_pair(programName, program));
+  m_programBuildKeys[programName] = buildKey;
 
   return true;
 }
@@ -289,15 +609,38 @@ bool Physics::CL::Context::createBuffer(std::string bufferName, size_t bufferSiz
   if (!m_init)
     return false;
 
-  cl_int err;
+  cl_int err = CL_SUCCESS;
 
-  if (m_buffersMap.find(bufferName) != m_buffersMap.end())
+  auto it = m_buffersMap.find(bufferName);
+  if (it != m_buffersMap.end())
   {
-    LOG_ERROR("Buffer {} already existing", bufferName);
-    return false;
+    if (m_cachedMemoryNames.erase(bufferName) == 0)
+    {
+      LOG_ERROR("Buffer {} already existing", bufferName);
+      return false;
+    }
+
+    // Restored from the scope cache, reused as is if matching
+    if (it->second.getInfo<CL_MEM_SIZE>() == bufferSize && it->second.getInfo<CL_MEM_FLAGS>() == memoryFlags)
+      return true;
+
+    m_buffersMap.erase(it);
   }
 
-  auto buffer = cl::Buffer(cl_context, memoryFlags, bufferSize, nullptr, &err);
+  cl::Buffer buffer;
+
+  // Making room by evicting cached scopes if device memory is short
+  do
+  {
+    try
+    {
+      buffer = cl::Buffer(cl_context, memoryFlags, bufferSize, nullptr, &err);
+    }
+    catch (const cl::Error& error)
+    {
+      err = error.err();
+    }
+  } while (err != CL_SUCCESS && evictOldestScope());
 
   if (err != CL_SUCCESS)
   {
@@ -317,10 +660,25 @@ bool Physics::CL::Context::createImage2D(std::string name, imageSpecs specs, cl_
 
   cl_int err;
 
-  if (m_imagesMap.find(name) != m_imagesMap.end())
+  auto it = m_imagesMap.find(name);
+  if (it != m_imagesMap.end())
   {
-    LOG_ERROR("Image {} already existing", name);
-    return false;
+    if (m_cachedMemoryNames.erase(name) == 0)
+    {
+      LOG_ERROR("Image {} already existing", name);
+      return false;
+    }
+
+    // Restored from the scope cache, reused as is if matching
+    if (it->second.getImageInfo<CL_IMAGE_WIDTH>() == specs.width && it->second.getImageInfo<CL_IMAGE_HEIGHT>() == specs.height
+        && it->second.getInfo<CL_MEM_FLAGS>() == memoryFlags)
+    {
+      const auto format = it->second.getImageInfo<CL_IMAGE_FORMAT>();
+      if (format.image_channel_order == specs.channelOrder && format.image_channel_data_type == specs.channelType)
+        return true;
+    }
+
+    m_imagesMap.erase(it);
   }
 
   cl::ImageFormat format(specs.channelOrder, specs.channelType);
@@ -338,7 +696,7 @@ bool Physics::CL::Context::createImage2D(std::string name, imageSpecs specs, cl_
   return true;
 }
 
-bool Physics::CL::Context::loadBufferFromHost(std::string bufferName, size_t offset, size_t sizeToFill, const void* hostPtr)
+bool Physics::CL::Context::loadBufferFromHost(std::string bufferName, size_t offset, size_t sizeToFill, const void* hostPtr, bool isBlocking)
 {
   if (!m_init)
     return false;
@@ -365,7 +723,7 @@ bool Physics::CL::Context::loadBufferFromHost(std::string bufferName, size_t off
   else
     destBuffer = itSrc->second;
 
-  err = cl_queue.enqueueWriteBuffer(destBuffer, CL_TRUE, offset, sizeToFill, hostPtr);
+  err = queue().enqueueWriteBuffer(destBuffer, isBlocking ? CL_TRUE : CL_FALSE, offset, sizeToFill, hostPtr);
 
   if (err != CL_SUCCESS)
   {
@@ -376,7 +734,7 @@ bool Physics::CL::Context::loadBufferFromHost(std::string bufferName, size_t off
   return true;
 }
 
-bool Physics::CL::Context::unloadBufferFromDevice(std::string bufferName, size_t offset, size_t sizeToFill, void* hostPtr)
+bool Physics::CL::Context::unloadBufferFromDevice(std::string bufferName, size_t offset, size_t sizeToFill, void* hostPtr, bool isBlocking, cl::Event* event)
 {
   if (!m_init)
     return false;
@@ -403,7 +761,7 @@ bool Physics::CL::Context::unloadBufferFromDevice(std::string bufferName, size_t
   else
     srcBuffer = itSrc->second;
 
-  err = cl_queue.enqueueReadBuffer(srcBuffer, CL_TRUE, offset, sizeToFill, hostPtr);
+  err = queue().enqueueReadBuffer(srcBuffer, isBlocking ? CL_TRUE : CL_FALSE, offset, sizeToFill, hostPtr, nullptr, event);
 
   if (err != CL_SUCCESS)
   {
@@ -437,6 +795,18 @@ bool Physics::CL::Context::swapBuffers(std::string bufferNameA, std::string buff
   itA->second = itB->second;
   itB->second = tempBuffer;
 
+  for (const auto& [kernelName, argNames] : m_kernelArgNames)
+  {
+    auto kernel = m_kernelsMap.at(kernelName);
+    for (cl_uint i = 0; i < argNames.size(); ++i)
+    {
+      if (argNames[i] == bufferNameA)
+        kernel.setArg(i, itA->second);
+      else if (argNames[i] == bufferNameB)
+        kernel.setArg(i, itB->second);
+    }
+  }
+
   return true;
 }
 
@@ -470,14 +840,29 @@ bool Physics::CL::Context::copyBuffer(std::string srcBufferName, std::string dst
     srcBuffer = itSrc->second;
   }
 
+  cl::Buffer dstBuffer;
+
   const auto& itDst = m_buffersMap.find(dstBufferName);
+
   if (itDst == m_buffersMap.end())
   {
-    LOG_ERROR("Cannot copy buffers, destination buffer {} not existing", dstBufferName);
-    return false;
+    auto itDstGL = m_GLBuffersMap.find(dstBufferName);
+
+    if (itDstGL == m_GLBuffersMap.end())
+    {
+      LOG_ERROR("Cannot copy buffers, destination buffer {} not existing", dstBufferName);
+      return false;
+    }
+    else
+    {
+      dstBuffer = itDstGL->second;
+    }
+  }
+  else
+  {
+    dstBuffer = itDst->second;
   }
 
-  cl::Buffer dstBuffer = itDst->second;
   size_t dstBufferSize;
   err = dstBuffer.getInfo(CL_MEM_SIZE, &dstBufferSize);
 
@@ -503,7 +888,7 @@ bool Physics::CL::Context::copyBuffer(std::string srcBufferName, std::string dst
   }
 
   // Only copying the amount of data which can fit into the destination buffer
-  err = cl_queue.enqueueCopyBuffer(srcBuffer, dstBuffer, 0, 0, dstBufferSize);
+  err = queue().enqueueCopyBuffer(srcBuffer, dstBuffer, 0, 0, dstBufferSize);
 
   if (err != CL_SUCCESS)
   {
@@ -514,11 +899,15 @@ bool Physics::CL::Context::copyBuffer(std::string srcBufferName, std::string dst
   return true;
 }
 
-bool Physics::CL::Context::createGLBuffer(std::string GLBufferName, unsigned int VBOIndex, cl_mem_flags memoryFlags)
+bool Physics::CL::Context::createGLBuffer(std::string GLBufferName, unsigned int VBOIndex, cl_mem_flags memoryFlags, size_t bufferSize)
 {
   if (!m_init)
     return false;
 
+  // No OpenGL context to share buffers with, kernels writing into a device buffer nobody draws
+  if (m_isComputeOnly)
+    return createBuffer(GLBufferName, bufferSize, CL_MEM_READ_WRITE);
+
   cl_int err;
 
   if (m_GLBuffersMap.find(GLBufferName) != m_GLBuffersMap.end())
@@ -597,6 +986,7 @@ bool Physics::CL::Context::createKernel(std::string programName, std::string ker
   }
 
   m_kernelsMap.insert(std::make_pair(kernelName, kernel));
+  m_kernelArgNames.insert(std::make_pair(kernelName, argNames));
 
   return true;
 }
@@ -622,6 +1012,10 @@ bool Physics::CL::Context::setKernelArg(std::string kernelName, cl_uint argIndex
     return false;
   }
 
+  auto& argNames = m_kernelArgNames[kernelName];
+  if (argIndex < argNames.size())
+    argNames[argIndex].clear();
+
   return true;
 }
 
@@ -661,10 +1055,15 @@ bool Physics::CL::Context::setKernelArg(std::string kernelName, cl_uint argIndex
     return false;
   }
 
+  auto& argNames = m_kernelArgNames[kernelName];
+  if (argIndex >= argNames.size())
+    argNames.resize(argIndex + 1);
+  argNames[argIndex] = argName;
+
   return true;
 }
 
-bool Physics::CL::Context::runKernel(std::string kernelName, size_t numGlobalWorkItems, size_t numLocalWorkItems)
+bool Physics::CL::Context::runKernel(std::string kernelName, size_t numGlobalWorkItems, size_t numLocalWorkItems, size_t globalWorkOffset)
 {
   if (!m_init)
     return false;
@@ -679,10 +1078,11 @@ bool Physics::CL::Context::runKernel(std::string kernelName, size_t numGlobalWor
   cl::Event event;
   cl::NDRange global(numGlobalWorkItems);
   cl::NDRange local = (numLocalWorkItems > 0) ? cl::NDRange(numLocalWorkItems) : cl::NullRange;
+  cl::NDRange offset = (globalWorkOffset > 0) ? cl::NDRange(globalWorkOffset) : cl::NullRange;
 
   cl_int err;
 
-  err = cl_queue.enqueueNDRangeKernel(it->second, cl::NullRange, global, local, nullptr, &event);
+  err = queue().enqueueNDRangeKernel(it->second, offset, global, local, nullptr, &event);
   if (err != CL_SUCCESS)
   {
     CL_ERROR(err, "Failure of kernel " + kernelName + " while running");
@@ -702,6 +1102,10 @@ bool Physics::CL::Context::runKernel(std::string kernelName, size_t numGlobalWor
 
     //if (profilingTimeMs > 1.0)
     LOG_INFO("Profiling kernel {} : {} ms", kernelName, profilingTimeMs);
+
+    auto& kernelTime = m_kernelTimes[kernelName];
+    kernelTime.totalTimeMs += profilingTimeMs;
+    ++kernelTime.nbRuns;
   }
 
   return true;
@@ -712,6 +1116,10 @@ bool Physics::CL::Context::interactWithGLBuffers(const std::vector<std::string>&
   if (!m_init)
     return false;
 
+  // GL buffers being plain device buffers, only keeping the queue completion on release
+  if (m_isComputeOnly)
+    return (interaction == interOpCLGL::RELEASE) ? finishTasks() : true;
+
   std::vector<cl::Memory> GLBuffers;
 
   for (const auto& GLBufferName : GLBufferNames)
@@ -728,7 +1136,7 @@ bool Physics::CL::Context::interactWithGLBuffers(const std::vector<std::string>&
     }
   }
 
-  cl_int err = (interaction == interOpCLGL::ACQUIRE) ? cl_queue.enqueueAcquireGLObjects(&GLBuffers) : cl_queue.enqueueReleaseGLObjects(&GLBuffers);
+  cl_int err = (interaction == interOpCLGL::ACQUIRE) ? queue().enqueueAcquireGLObjects(&GLBuffers) : queue().enqueueReleaseGLObjects(&GLBuffers, nullptr, &m_releaseEvent);
   if (err != CL_SUCCESS)
   {
     CL_ERROR(err, "Cannot interact with GL buffers");
@@ -742,9 +1150,25 @@ bool Physics::CL::Context::interactWithGLBuffers(const std::vector<std::string>&
     LOG_DEBUG(interaction == interOpCLGL::ACQUIRE ? "GL buffers acquired {}" : "GL buffers released {}", allNames);
   }
 
-  // Must flush and finish queue to make sure GL buffers have been released
+  // Only flushing queue, waitForGLBuffersRelease() making sure GL buffers have been released
   if (interaction == interOpCLGL::RELEASE)
-    finishTasks();
+    queue().flush();
+
+  return true;
+}
+
+bool Physics::CL::Context::waitForGLBuffersRelease()
+{
+  if (!m_init || m_releaseEvent() == nullptr)
+    return true;
+
+  cl_int err = m_releaseEvent.wait();
+  m_releaseEvent = cl::Event();
+  if (err != CL_SUCCESS)
+  {
+    CL_ERROR(err, "Cannot wait for GL buffers release");
+    return false;
+  }
 
   return true;
 }
@@ -762,14 +1186,14 @@ bool Physics::CL::Context::mapAndSendBufferToDevice(std::string bufferName, cons
   }
 
   cl_int err;
-  void* mappedMemory = cl_queue.enqueueMapBuffer(it->second, CL_TRUE, CL_MAP_WRITE, 0, bufferSize, nullptr, nullptr, &err);
+  void* mappedMemory = queue().enqueueMapBuffer(it->second, CL_TRUE, CL_MAP_WRITE, 0, bufferSize, nullptr, nullptr, &err);
   if (err < 0)
   {
     CL_ERROR(err, "Cannot map buffer " + bufferName + " to host memory");
     return false;
   }
   memcpy(mappedMemory, bufferPtr, bufferSize);
-  err = cl_queue.enqueueUnmapMemObject(it->second, mappedMemory);
+  err = queue().enqueueUnmapMemObject(it->second, mappedMemory);
   if (err < 0)
   {
     CL_ERROR(err, "Cannot unmap buffer" + bufferName);
@@ -2,8 +2,12 @@
 
 #include "opencl.hpp"
 
+#include <future>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace Physics
@@ -18,38 +22,87 @@ struct imageSpecs
   size_t height;
 };
 
+// Sources and build options of a program, enough to build it ahead of the model using it
+struct programSpecs
+{
+  std::string name;
+  std::vector<std::string> sourceNames;
+  std::string buildOptions;
+};
+
+// Accumulated device time of a kernel while profiling is enabled
+struct KernelTime
+{
+  double totalTimeMs = 0.0;
+  size_t nbRuns = 0;
+};
+
 class Context
 {
   public:
   static Context& Get();
+  // Context on the first device of the given type without OpenGL interop, GL buffers being replaced by device buffers
+  // Must be requested before the first Get()
+  static void RequestComputeOnly(cl_device_type deviceType);
+
+  bool isComputeOnly() const { return m_isComputeOnly; }
 
   // Check if the context has been instantiated
   bool isInit() const { return m_init; }
-  // Release every programs and kernels/buffers/datas on GPU side
+  // Release every programs and kernels/buffers/datas on GPU side, cached scopes included
   bool release();
 
+  // Programs and memory objects are owned by a named scope, one per model type
+  // Parking the current scope keeps its programs and device buffers cached, kernels and GL buffers being released,
+  // so that the next model using this scope skips program builds and reuses buffers of identical size and flags
+  // Least recently used parked scopes are evicted beyond the cache budget or when an allocation fails
+  bool useScope(const std::string& scopeName);
+  bool parkScope();
+  // Device memory parked scopes may keep, half of the device global memory by default
+  void setScopeCacheBudget(size_t budget) { m_scopeCacheBudget = budget; }
+
   // Send all the tasks to device queue and wait for them to be complete
   bool finishTasks();
 
+  // Queue dedicated to the calling thread, e.g. the simulation one, used by all its commands until released
+  // Other threads keep the default queue, which is finished first so that commands stay ordered across both
+  bool createThreadQueue();
+  // Finishing the thread queue, its thread going back to the default queue
+  bool releaseThreadQueue();
+
   bool isProfiling() const { return m_isKernelProfilingEnabled; }
   void enableProfiler(bool enable) { m_isKernelProfilingEnabled = enable; }
+  const std::map<std::string, KernelTime>& kernelTimes() const { return m_kernelTimes; }
+  void resetKernelTimes() { m_kernelTimes.clear(); }
 
   bool createProgram(std::string name, std::vector<std::string> sourceNames, std::string specificBuildOptions);
   bool createProgram(std::string name, std::string sourceName, std::string specificBuildOptions) { return createProgram(name, std::vector<std::string>({ sourceName }), specificBuildOptions); }
-  bool createGLBuffer(std::string name, unsigned int VBOIndex, cl_mem_flags memoryFlags);
+  bool createProgram(const programSpecs& specs) { return createProgram(specs.name, specs.sourceNames, specs.buildOptions); }
+  // Building a program on a background thread, createProgram() with the same specs only waiting for it if not done yet
+  // Same specs requested again return the same future, true once successfully built
+  std::shared_future<bool> buildProgramAsync(const programSpecs& specs);
+  // Size only used by compute-only context, shared GL buffers being already allocated
+  bool createGLBuffer(std::string name, unsigned int VBOIndex, cl_mem_flags memoryFlags, size_t bufferSize);
   bool createBuffer(std::string name, size_t bufferSize, cl_mem_flags memoryFlags);
   bool createImage2D(std::string name, imageSpecs specs, cl_mem_flags memoryFlags);
-  bool loadBufferFromHost(std::string name, size_t offset, size_t sizeToFill, const void* hostPtr);
-  bool unloadBufferFromDevice(std::string name, size_t offset, size_t sizeToFill, void* hostPtr);
+  // Non-blocking load reading hostPtr once the queue reaches it, hostPtr must not be modified before
+  bool loadBufferFromHost(std::string name, size_t offset, size_t sizeToFill, const void* hostPtr, bool isBlocking = true);
+  // Non-blocking unload only filling hostPtr once the queue reaches it, e.g. after finishTasks() or waiting for event, hostPtr must outlive it
+  bool unloadBufferFromDevice(std::string name, size_t offset, size_t sizeToFill, void* hostPtr, bool isBlocking = true, cl::Event* event = nullptr);
+  // Swapping handles, kernel args set from either buffer name following it, e.g. for double-buffering
   bool swapBuffers(std::string bufferNameA, std::string bufferNameB);
   bool copyBuffer(std::string srcBufferName, std::string dstBufferName);
   bool createKernel(std::string programName, std::string kernelName, std::vector<std::string> argNames);
   bool setKernelArg(std::string kernelName, cl_uint argIndex, size_t argSize, const void* value);
   bool setKernelArg(std::string kernelName, cl_uint argIndex, const std::string& bufferName);
-  bool runKernel(std::string kernelName, size_t numFlobalWorkItems, size_t numLocalWorkItems = 0);
+  // Global offset shifting work-item IDs, e.g. to only process particles beyond a given index
+  bool runKernel(std::string kernelName, size_t numFlobalWorkItems, size_t numLocalWorkItems = 0, size_t globalWorkOffset = 0);
 
   bool acquireGLBuffers(const std::vector<std::string>& GLBufferNames) { return interactWithGLBuffers(GLBufferNames, interOpCLGL::ACQUIRE); }
+  // Release only flushed, not finished, OpenGL must not use the buffers before waitForGLBuffersRelease() returns
   bool releaseGLBuffers(const std::vector<std::string>& GLBufferNames) { return interactWithGLBuffers(GLBufferNames, interOpCLGL::RELEASE); }
+  // Blocking until the last release is complete, along with all tasks enqueued before it
+  bool waitForGLBuffersRelease();
 
   bool mapAndSendBufferToDevice(std::string bufferName, const void* bufferPtr, size_t bufferSize);
 
@@ -67,7 +120,10 @@ class Context
   bool findPlatforms();
   bool findGPUDevices();
   bool createContext();
-  bool createCommandQueue();
+  bool createComputeOnlyContext();
+  bool createCommandQueue(cl::CommandQueue& queue);
+  // Thread queue if called from the thread owning it, default queue otherwise
+  cl::CommandQueue& queue();
 
   enum class interOpCLGL
   {
@@ -76,18 +132,65 @@ class Context
   };
   bool interactWithGLBuffers(const std::vector<std::string>& GLBufferNames, interOpCLGL interaction);
 
+  static std::string programBuildKey(const std::vector<std::string>& sourceNames, const std::string& specificBuildOptions);
+  static cl::Program::Sources readProgramSources(const std::vector<std::string>& sourceNames);
+
+  // Program built by a background task, shared by all scopes using it
+  struct PrebuiltProgram
+  {
+    std::string buildKey;
+    std::shared_ptr<cl::Program> program;
+    std::shared_future<bool> isBuilt;
+  };
+
+  // Evicting least recently used parked scope, false if there is none
+  bool evictOldestScope();
+  size_t parkedScopesMemory() const;
+
+  struct Scope
+  {
+    std::map<std::string, cl::Program> programsMap;
+    std::map<std::string, std::string> programBuildKeys;
+    std::map<std::string, cl::Buffer> buffersMap;
+    std::map<std::string, cl::Image2D> imagesMap;
+    size_t memorySize = 0;
+    size_t lastUse = 0;
+  };
+
   cl::Platform cl_platform;
   cl::Device cl_device;
   cl::Context cl_context;
   cl::CommandQueue cl_queue;
+  cl::CommandQueue cl_threadQueue;
+  std::thread::id m_threadQueueOwner;
 
   std::map<std::string, cl::Program> m_programsMap;
   std::map<std::string, cl::Kernel> m_kernelsMap;
+  // Buffer name bound to each kernel arg, empty if none, to rebind them when swapping buffers
+  std::map<std::string, std::vector<std::string>> m_kernelArgNames;
   std::map<std::string, cl::Buffer> m_buffersMap;
   std::map<std::string, cl::BufferGL> m_GLBuffersMap;
   std::map<std::string, cl::Image2D> m_imagesMap;
+  // Source names and build options of each program, rebuilt only if they differ
+  std::map<std::string, std::string> m_programBuildKeys;
+  std::map<std::string, PrebuiltProgram> m_prebuiltPrograms;
+
+  std::string m_currScopeName;
+  std::map<std::string, Scope> m_parkedScopes;
+  // Buffers and images restored from the cache, not created again by the current model yet
+  std::set<std::string> m_cachedMemoryNames;
+  size_t m_scopeUseCounter;
+  size_t m_scopeCacheBudget;
+
+  // Last GL buffers release, waited for by the thread handing buffers back to OpenGL
+  cl::Event m_releaseEvent;
 
   bool m_isKernelProfilingEnabled;
+  std::map<std::string, KernelTime> m_kernelTimes;
+
+  static bool s_isComputeOnlyRequested;
+  static cl_device_type s_computeOnlyDeviceType;
+  bool m_isComputeOnly;
 
   bool m_init;
 
@@ -7,6 +7,8 @@
 
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <iostream>
@@ -20,10 +22,18 @@ using namespace Physics::CL;
 
 #define PROGRAM_FLUIDS "fluids"
 
+constexpr size_t MAX_NB_PARTS_IN_CELL = 100;
+
 // utils.cl
 #define KERNEL_INFINITE_POS "infPosVerts"
 #define KERNEL_RESET_CAMERA_DIST "resetCameraDist"
 #define KERNEL_FILL_CAMERA_DIST "fillCameraDist"
+#define KERNEL_COUNT_VISIBLE_PARTS "countVisibleParts"
+#define KERNEL_SCAN_VISIBLE_PARTS "scanVisibleParts"
+#define KERNEL_COMPACT_VISIBLE_PARTS "compactVisibleParts"
+#define KERNEL_FILL_RENDER_SLOT "fillRenderSlot"
+#define KERNEL_RESET_MAX_SQ_VEL "resetMaxSqVel"
+#define KERNEL_MAX_SQ_VEL "computeMaxSqVel"
 
 // grid.cl
 #define KERNEL_RESET_PART_DETECTOR "resetGridDetector"
@@ -40,14 +50,23 @@ using namespace Physics::CL;
 #define KERNEL_APPLY_BOUNDARY "fld_applyBoundaryCondition"
 #define KERNEL_DENSITY "fld_computeDensity"
 #define KERNEL_CONSTRAINT_FACTOR "fld_computeConstraintFactor"
+#define KERNEL_DENSITY_CONSTRAINT_FACTOR "fld_computeDensityAndConstraintFactor"
 #define KERNEL_CONSTRAINT_CORRECTION "fld_computeConstraintCorrection"
 #define KERNEL_CORRECT_POS "fld_correctPosition"
 #define KERNEL_UPDATE_VEL "fld_updateVel"
 #define KERNEL_COMPUTE_VORTICITY "fld_computeVorticity"
 #define KERNEL_VORTICITY_CONFINEMENT "fld_applyVorticityConfinement"
 #define KERNEL_XSPH_VISCOSITY "fld_applyXsphViscosityCorrection"
+#define KERNEL_VORTICITY_CONFINEMENT_XSPH "fld_applyVorticityConfinementAndXsphViscosity"
 #define KERNEL_UPDATE_POS "fld_updatePosition"
-#define KERNEL_FILL_COLOR "fld_fillFluidColor"
+#define KERNEL_PACK_POS "fld_packPosition"
+#define KERNEL_PACK_VEL "fld_packVelocity"
+#define KERNEL_DENSITY_CONSTRAINT_FACTOR_PACKED "fld_computeDensityAndConstraintFactorPacked"
+#define KERNEL_CONSTRAINT_CORRECTION_PACKED "fld_computeConstraintCorrectionPacked"
+#define KERNEL_COMPUTE_VORTICITY_PACKED "fld_computeVorticityPacked"
+#define KERNEL_VORTICITY_CONFINEMENT_PACKED "fld_applyVorticityConfinementPacked"
+#define KERNEL_XSPH_VISCOSITY_PACKED "fld_applyXsphViscosityCorrectionPacked"
+#define KERNEL_VORTICITY_CONFINEMENT_XSPH_PACKED "fld_applyVorticityConfinementAndXsphViscosityPacked"
 
 static const json initFluidsJson // clang-format off
 { 
@@ -56,6 +75,8 @@ static const json initFluidsJson // clang-format off
       { "Relax CFM", { 600.0f, 100.0f, 1000.0f } },
       { "Time Step", { 0.010f, 0.0001f, 0.020f } },
       { "Nb Jacobi Iterations", { 2, 1, 6 } },
+      { "Fused Density Kernel", false },
+      { "Compact Storage", false },
       { "Artificial Pressure",
           { { "Enable##Pressure", true },
             { "Coefficient##Pressure", { 0.001f, 0.0f, 0.001f} },
@@ -66,7 +87,15 @@ static const json initFluidsJson // clang-format off
       { "Vorticity Confinement",
           { { "Enable##Vorticity", true },
             { "Coefficient##Vorticity", {0.0004f, 0.0f, 0.001f}},
-            { "xSPH Viscosity Coefficient", {0.0001f, 0.0f, 0.001f}}
+            { "xSPH Viscosity Coefficient", {0.0001f, 0.0f, 0.001f}},
+            { "Fused Confinement Kernel", false }
+          }
+      },
+      { "Adaptive Time Step",
+          { { "Enable##AdaptiveTimeStep", false },
+            { "CFL Number", {0.4f, 0.05f, 1.0f}},
+            { "Max Time Step", {0.020f, 0.001f, 0.050f}},
+            { "Max Nb Steps", {8, 1, 16}}
           }
       }
     }
@@ -74,11 +103,15 @@ static const json initFluidsJson // clang-format off
 }; // clang-format on
 
 Fluids::Fluids(ModelParams params)
-    : OclModel<FluidKernelInputs>(params, FluidKernelInputs {}, json(initFluidsJson))
+    : OclModel<FluidKernelInputs>(ALL_MODELS.at(ModelType::FLUIDS), params, FluidKernelInputs {}, json(initFluidsJson))
     , m_simplifiedMode(true)
-    , m_maxNbPartsInCell(100)
+    , m_maxNbPartsInCell(MAX_NB_PARTS_IN_CELL)
     , m_radixSort(params.maxNbParticles)
     , m_nbJacobiIters(2)
+    , m_isDensityKernelFused(false)
+    , m_isStorageCompact(false)
+    , m_isConfinementKernelFused(false)
+    , m_timeStep(0.010f)
 {
   createProgram();
 
@@ -94,58 +127,96 @@ Fluids::Fluids(ModelParams params)
 // Must be on implementation side as FluidKernelInputs must be complete
 Fluids::~Fluids() {};
 
-bool Fluids::createProgram() const
+programSpecs Fluids::ProgramSpecs(const Geometry::BoxSize3D& boxSize, const Geometry::BoxSize3D& gridRes)
 {
-  CL::Context& clContext = CL::Context::Get();
+  assert(boxSize.x / gridRes.x == boxSize.y / gridRes.y);
+  assert(boxSize.z / gridRes.z == boxSize.y / gridRes.y);
 
-  assert(m_boxSize.x / m_gridRes.x == m_boxSize.y / m_gridRes.y);
-  assert(m_boxSize.z / m_gridRes.z == m_boxSize.y / m_gridRes.y);
-
-  float effectRadius = ((float)m_boxSize.x) / m_gridRes.x;
+  float effectRadius = ((float)boxSize.x) / gridRes.x;
 
   std::ostringstream clBuildOptions;
   clBuildOptions << "-DEFFECT_RADIUS=" << Utils::FloatToStr(effectRadius);
-  clBuildOptions << " -DABS_WALL_X=" << Utils::FloatToStr(m_boxSize.x / 2.0f);
-  clBuildOptions << " -DABS_WALL_Y=" << Utils::FloatToStr(m_boxSize.y / 2.0f);
-  clBuildOptions << " -DABS_WALL_Z=" << Utils::FloatToStr(m_boxSize.z / 2.0f);
-  clBuildOptions << " -DGRID_RES_X=" << m_gridRes.x;
-  clBuildOptions << " -DGRID_RES_Y=" << m_gridRes.y;
-  clBuildOptions << " -DGRID_RES_Z=" << m_gridRes.z;
-  clBuildOptions << " -DGRID_CELL_SIZE_XYZ=" << Utils::FloatToStr((float)m_boxSize.x / m_gridRes.x);
-  clBuildOptions << " -DGRID_NUM_CELLS=" << m_nbCells;
-  clBuildOptions << " -DNUM_MAX_PARTS_IN_CELL=" << m_maxNbPartsInCell;
+  clBuildOptions << " -DABS_WALL_X=" << Utils::FloatToStr(boxSize.x / 2.0f);
+  clBuildOptions << " -DABS_WALL_Y=" << Utils::FloatToStr(boxSize.y / 2.0f);
+  clBuildOptions << " -DABS_WALL_Z=" << Utils::FloatToStr(boxSize.z / 2.0f);
+  clBuildOptions << " -DGRID_RES_X=" << gridRes.x;
+  clBuildOptions << " -DGRID_RES_Y=" << gridRes.y;
+  clBuildOptions << " -DGRID_RES_Z=" << gridRes.z;
+  clBuildOptions << " -DGRID_CELL_SIZE_XYZ=" << Utils::FloatToStr((float)boxSize.x / gridRes.x);
+  clBuildOptions << " -DGRID_NUM_CELLS=" << gridRes.x * gridRes.y * gridRes.z;
+  clBuildOptions << " -DNUM_MAX_PARTS_IN_CELL=" << MAX_NB_PARTS_IN_CELL;
   clBuildOptions << " -DPOLY6_COEFF=" << Utils::FloatToStr(315.0f / (64.0f * Math::PI_F * std::pow(effectRadius, 9.f)));
   clBuildOptions << " -DSPIKY_COEFF=" << Utils::FloatToStr(15.0f / (Math::PI_F * std::pow(effectRadius, 6.f)));
+  if (SelectedSphKernelEval() == SphKernelEval::LOOKUP_TABLE)
+    clBuildOptions << " -DSPH_LUT";
   clBuildOptions << " -DMAX_VEL=" << Utils::FloatToStr(30.0f);
 
-  LOG_INFO(clBuildOptions.str());
   // file.cl order matters, define.cl must be first
-  clContext.createProgram(PROGRAM_FLUIDS, std::vector<std::string>({ "define.cl", "sph.cl", "fluids.cl", "utils.cl", "grid.cl" }), clBuildOptions.str());
+  return { PROGRAM_FLUIDS, { "define.cl", "sph.cl", "fluids.cl", "utils.cl", "grid.cl" }, clBuildOptions.str() };
+}
+
+bool Fluids::createProgram() const
+{
+  CL::Context& clContext = CL::Context::Get();
+
+  const auto specs = ProgramSpecs(m_boxSize, m_gridRes);
+
+  LOG_INFO(specs.buildOptions);
+  clContext.createProgram(specs);
 
   return true;
 }
 
-bool Fluids::createBuffers() const
+bool Fluids::createBuffers()
 {
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.createGLBuffer("u_cameraPos", m_cameraVBO, CL_MEM_READ_ONLY);
-  clContext.createGLBuffer("p_pos", m_particlePosVBO, CL_MEM_READ_WRITE);
-  clContext.createGLBuffer("p_col", m_particleColVBO, CL_MEM_READ_WRITE);
-  clContext.createGLBuffer("c_partDetector", m_gridVBO, CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_frameState", FRAME_STATE_SIZE, CL_MEM_READ_ONLY);
+
+  // Particles state published for rendering, one set of GL buffers per render slot
+  for (size_t slot = 0; slot < m_particleRenderSlots.size(); ++slot)
+  {
+    const auto& renderSlot = m_particleRenderSlots[slot];
+    clContext.createGLBuffer(renderSlotBufferName("r_pos", slot), renderSlot.posVBO, CL_MEM_WRITE_ONLY, 4 * m_maxNbParticles * sizeof(cl_float));
+    clContext.createGLBuffer(renderSlotBufferName("r_prevPos", slot), renderSlot.prevPosVBO, CL_MEM_WRITE_ONLY, 4 * m_maxNbParticles * sizeof(cl_float));
+    clContext.createGLBuffer(renderSlotBufferName("r_col", slot), renderSlot.colVBO, CL_MEM_WRITE_ONLY, m_maxNbParticles * sizeof(cl_float));
+    clContext.createGLBuffer(renderSlotBufferName("r_quantizedPos", slot), renderSlot.quantizedPosVBO, CL_MEM_WRITE_ONLY, 4 * m_maxNbParticles * sizeof(cl_ushort));
+    clContext.createGLBuffer(renderSlotBufferName("r_visibleIndex", slot), renderSlot.indexVBO, CL_MEM_WRITE_ONLY, m_maxNbParticles * sizeof(cl_uint));
+    clContext.createGLBuffer(renderSlotBufferName("r_partDetector", slot), renderSlot.gridDetectorVBO, CL_MEM_WRITE_ONLY, m_nbCells * sizeof(cl_uchar));
+  }
+
+  clContext.createBuffer("p_pos", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
+  clContext.createBuffer("p_prevPos", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
+  clContext.createBuffer("p_col", m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
 
   clContext.createBuffer("p_density", m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_predPos", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_corrPos", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
+  // Only used by compact storage, constraint factor being otherwise stored in w of predicted positions
   clContext.createBuffer("p_constFactor", m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_vel", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
-  clContext.createBuffer("p_velInViscosity", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
+  clContext.createBuffer("p_velOut", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_vort", 4 * m_maxNbParticles * sizeof(float), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_cellID", m_maxNbParticles * sizeof(unsigned int), CL_MEM_READ_WRITE);
+
+  // Compact storage, 3x16 bits per particle
+  clContext.createBuffer("p_packedPredPos", 3 * m_maxNbParticles * sizeof(cl_ushort), CL_MEM_READ_WRITE);
+  clContext.createBuffer("p_packedVel", 3 * m_maxNbParticles * sizeof(cl_half), CL_MEM_READ_WRITE);
+  clContext.createBuffer("p_packedVort", 3 * m_maxNbParticles * sizeof(cl_half), CL_MEM_READ_WRITE);
   clContext.createBuffer("p_cameraDist", m_maxNbParticles * sizeof(unsigned int), CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_nbVisibleParts", sizeof(unsigned int), CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_groupNbVisibleParts", nbCullingGroups(m_maxNbParticles) * sizeof(unsigned int), CL_MEM_READ_WRITE);
+  clContext.createBuffer("u_maxSqVel", sizeof(unsigned int), CL_MEM_READ_WRITE);
 
   clContext.createBuffer("c_startEndPartID", 2 * m_nbCells * sizeof(unsigned int), CL_MEM_READ_WRITE);
 
+  // Physical parameters displayable in UI, density colored around rest density, see Render::Colormap::FLUIDS
+  const float restDensity = getKernelInput<FluidKernelInputs>(0).restDensity;
+  PhysicalQuantity density { "Density", "p_density", { 0.0f, 2.0f * restDensity }, { 0.65f * restDensity, 1.35f * restDensity } };
+  m_allDisplayableQuantities.insert(std::make_pair(density.name, density));
+
+  m_currentDisplayedQuantityName = density.name;
+
   return true;
 }
 
@@ -157,11 +228,18 @@ bool Fluids::createKernels() const
   clContext.createKernel(PROGRAM_FLUIDS, KERNEL_INFINITE_POS, { "p_pos" });
 
   // For rendering purpose only
-  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_RESET_PART_DETECTOR, { "c_partDetector" });
-  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_FILL_PART_DETECTOR, { "p_pos", "c_partDetector" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_RESET_PART_DETECTOR, { "" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_FILL_PART_DETECTOR, { "p_pos", "" });
   clContext.createKernel(PROGRAM_FLUIDS, KERNEL_RESET_CAMERA_DIST, { "p_cameraDist" });
-  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_FILL_CAMERA_DIST, { "p_pos", "u_cameraPos", "p_cameraDist" });
-  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_FILL_COLOR, { "p_density", "", "p_col" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_FILL_CAMERA_DIST, { "p_pos", "u_frameState", "p_cameraDist" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_COUNT_VISIBLE_PARTS, { "p_pos", RadixSort::PermutationBufferName(), "", "u_frameState", "", "u_groupNbVisibleParts" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_SCAN_VISIBLE_PARTS, { "", "u_groupNbVisibleParts", "u_nbVisibleParts" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_COMPACT_VISIBLE_PARTS, { "p_pos", RadixSort::PermutationBufferName(), "", "u_frameState", "", "u_groupNbVisibleParts", "" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_FILL_RENDER_SLOT, { RadixSort::PermutationBufferName(), "", "p_pos", "p_prevPos", "p_col", "", "", "", "", "", "" });
+
+  // Adaptive time step
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_RESET_MAX_SQ_VEL, { "u_maxSqVel" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_MAX_SQ_VEL, { "p_vel", "u_maxSqVel" });
 
   // Radix Sort based on 3D grid, using predicted positions, not corrected ones
   clContext.createKernel(PROGRAM_FLUIDS, KERNEL_RESET_CELL_ID, { "p_cellID" });
@@ -179,17 +257,30 @@ bool Fluids::createKernels() const
   clContext.createKernel(PROGRAM_FLUIDS, KERNEL_APPLY_BOUNDARY, { "p_predPos" });
   /// Jacobi solver to correct position
   clContext.createKernel(PROGRAM_FLUIDS, KERNEL_DENSITY, { "p_predPos", "c_startEndPartID", "", "p_density" });
-  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_CONSTRAINT_FACTOR, { "p_predPos", "p_density", "c_startEndPartID", "", "p_constFactor" });
-  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_CONSTRAINT_CORRECTION, { "p_constFactor", "c_startEndPartID", "p_predPos", "", "p_corrPos" });
+  /// Constraint factor stored in w of predicted positions, one load per neighbor for the correction
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_CONSTRAINT_FACTOR, { "p_density", "c_startEndPartID", "", "p_predPos" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_DENSITY_CONSTRAINT_FACTOR, { "c_startEndPartID", "", "p_density", "p_predPos" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_CONSTRAINT_CORRECTION, { "p_predPos", "c_startEndPartID", "", "p_corrPos" });
   clContext.createKernel(PROGRAM_FLUIDS, KERNEL_CORRECT_POS, { "p_corrPos", "p_predPos" });
   /// Velocity update and correction using vorticity confinement and xsph viscosity
   clContext.createKernel(PROGRAM_FLUIDS, KERNEL_UPDATE_VEL, { "p_predPos", "p_pos", "", "p_vel" });
   clContext.createKernel(PROGRAM_FLUIDS, KERNEL_COMPUTE_VORTICITY, { "p_predPos", "c_startEndPartID", "p_vel", "", "p_vort" });
-  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_VORTICITY_CONFINEMENT, { "p_predPos", "c_startEndPartID", "p_vort", "", "p_vel" });
-  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_XSPH_VISCOSITY, { "p_predPos", "c_startEndPartID", "p_velInViscosity", "", "p_vel" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_VORTICITY_CONFINEMENT, { "p_predPos", "c_startEndPartID", "p_vort", "p_vel", "", "p_velOut" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_XSPH_VISCOSITY, { "p_predPos", "c_startEndPartID", "p_vel", "", "p_velOut" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_VORTICITY_CONFINEMENT_XSPH, { "p_predPos", "c_startEndPartID", "p_vort", "p_vel", "", "p_velOut" });
   /// Position update
   clContext.createKernel(PROGRAM_FLUIDS, KERNEL_UPDATE_POS, { "p_predPos", "p_pos" });
 
+  // Compact storage variants, neighbors read on 3x16 bits instead of 4x32 bits
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_PACK_POS, { "p_predPos", "p_cellID", "p_packedPredPos" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_PACK_VEL, { "p_vel", "p_packedVel" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_DENSITY_CONSTRAINT_FACTOR_PACKED, { "p_packedPredPos", "p_cellID", "p_predPos", "c_startEndPartID", "", "p_density", "p_constFactor" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_CONSTRAINT_CORRECTION_PACKED, { "p_constFactor", "c_startEndPartID", "p_packedPredPos", "p_cellID", "p_predPos", "", "p_corrPos" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_COMPUTE_VORTICITY_PACKED, { "p_packedPredPos", "p_cellID", "p_predPos", "c_startEndPartID", "p_packedVel", "", "p_packedVort" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_VORTICITY_CONFINEMENT_PACKED, { "p_packedPredPos", "p_cellID", "p_predPos", "c_startEndPartID", "p_packedVort", "p_vel", "", "p_velOut" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_XSPH_VISCOSITY_PACKED, { "p_packedPredPos", "p_cellID", "p_predPos", "c_startEndPartID", "p_packedVel", "p_vel", "", "p_velOut" });
+  clContext.createKernel(PROGRAM_FLUIDS, KERNEL_VORTICITY_CONFINEMENT_XSPH_PACKED, { "p_packedPredPos", "p_cellID", "p_predPos", "c_startEndPartID", "p_packedVort", "p_packedVel", "p_vel", "", "p_velOut" });
+
   return true;
 }
 
@@ -206,13 +297,10 @@ void Fluids::reset()
 
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.acquireGLBuffers({ "p_pos", "c_partDetector" });
-  clContext.runKernel(KERNEL_RESET_PART_DETECTOR, m_nbCells);
-  clContext.runKernel(KERNEL_FILL_PART_DETECTOR, m_currNbParticles);
-  clContext.releaseGLBuffers({ "p_pos", "c_partDetector" });
-
   clContext.runKernel(KERNEL_RESET_CELL_ID, m_maxNbParticles);
   clContext.runKernel(KERNEL_RESET_CAMERA_DIST, m_maxNbParticles);
+
+  resetAdaptiveTimeStep();
 }
 
 void Fluids::transferJsonInputsToModel(json& inputJson)
@@ -225,12 +313,15 @@ void Fluids::transferJsonInputsToModel(json& inputJson)
     const auto& fluidsJson = inputJson["Fluids"];
 
     m_nbJacobiIters = fluidsJson["Nb Jacobi Iterations"][0];
+    m_isDensityKernelFused = (fluidsJson["Fused Density Kernel"] == true);
+    m_isStorageCompact = (fluidsJson["Compact Storage"] == true);
 
     auto& kernelInputs = getKernelInput<FluidKernelInputs>(0);
 
     kernelInputs.restDensity = (cl_float)(fluidsJson["Rest Density"][0]);
     kernelInputs.relaxCFM = (cl_float)(fluidsJson.at("Relax CFM")[0]);
-    kernelInputs.timeStep = (cl_float)(fluidsJson["Time Step"][0]);
+    m_timeStep = fluidsJson["Time Step"][0];
+    kernelInputs.timeStep = (cl_float)m_timeStep;
     kernelInputs.dim = (cl_uint)((m_dimension == Geometry::Dimension::dim2D) ? 2 : 3);
 
     kernelInputs.isArtPressureEnabled = (cl_uint)((fluidsJson["Artificial Pressure"]["Enable##Pressure"] == true) ? 1 : 0);
@@ -241,6 +332,12 @@ void Fluids::transferJsonInputsToModel(json& inputJson)
     kernelInputs.isVorticityConfEnabled = (cl_uint)((fluidsJson["Vorticity Confinement"]["Enable##Vorticity"] == true) ? 1 : 0);
     kernelInputs.vorticityConfCoeff = (cl_float)(fluidsJson["Vorticity Confinement"]["Coefficient##Vorticity"][0]);
     kernelInputs.xsphViscosityCoeff = (cl_float)(fluidsJson["Vorticity Confinement"]["xSPH Viscosity Coefficient"][0]);
+    m_isConfinementKernelFused = (fluidsJson["Vorticity Confinement"]["Fused Confinement Kernel"] == true);
+
+    m_isAdaptiveTimeStepEnabled = (fluidsJson["Adaptive Time Step"]["Enable##AdaptiveTimeStep"] == true);
+    m_cflNumber = fluidsJson["Adaptive Time Step"]["CFL Number"][0];
+    m_maxTimeStep = fluidsJson["Adaptive Time Step"]["Max Time Step"][0];
+    m_maxNbAdaptiveSteps = fluidsJson["Adaptive Time Step"]["Max Nb Steps"][0];
   }
   catch (...)
   {
@@ -251,6 +348,18 @@ void Fluids::transferJsonInputsToModel(json& inputJson)
 };
 
 void Fluids::transferKernelInputsToGPU()
+{
+  if (!m_init)
+    return;
+
+  // Jacobi iterations and kernel variants only drive the host-side solver loop
+  if (!m_parameters.isDirty("/Fluids", { "/Fluids/Nb Jacobi Iterations", "/Fluids/Fused Density Kernel", "/Fluids/Compact Storage", "/Fluids/Vorticity Confinement/Fused Confinement Kernel" }))
+    return;
+
+  updateFluidsParamsInKernels();
+}
+
+void Fluids::updateFluidsParamsInKernels()
 {
   if (!m_init)
     return;
@@ -262,12 +371,33 @@ void Fluids::transferKernelInputsToGPU()
   clContext.setKernelArg(KERNEL_PREDICT_POS, 2, sizeof(FluidKernelInputs), &kernelInputs);
   clContext.setKernelArg(KERNEL_UPDATE_VEL, 2, sizeof(FluidKernelInputs), &kernelInputs);
   clContext.setKernelArg(KERNEL_DENSITY, 2, sizeof(FluidKernelInputs), &kernelInputs);
-  clContext.setKernelArg(KERNEL_CONSTRAINT_FACTOR, 3, sizeof(FluidKernelInputs), &kernelInputs);
-  clContext.setKernelArg(KERNEL_CONSTRAINT_CORRECTION, 3, sizeof(FluidKernelInputs), &kernelInputs);
-  clContext.setKernelArg(KERNEL_FILL_COLOR, 1, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_CONSTRAINT_FACTOR, 2, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_DENSITY_CONSTRAINT_FACTOR, 1, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_CONSTRAINT_CORRECTION, 2, sizeof(FluidKernelInputs), &kernelInputs);
   clContext.setKernelArg(KERNEL_COMPUTE_VORTICITY, 3, sizeof(FluidKernelInputs), &kernelInputs);
-  clContext.setKernelArg(KERNEL_VORTICITY_CONFINEMENT, 3, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_VORTICITY_CONFINEMENT, 4, sizeof(FluidKernelInputs), &kernelInputs);
   clContext.setKernelArg(KERNEL_XSPH_VISCOSITY, 3, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_VORTICITY_CONFINEMENT_XSPH, 4, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_DENSITY_CONSTRAINT_FACTOR_PACKED, 4, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_CONSTRAINT_CORRECTION_PACKED, 5, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_COMPUTE_VORTICITY_PACKED, 5, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_VORTICITY_CONFINEMENT_PACKED, 6, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_XSPH_VISCOSITY_PACKED, 6, sizeof(FluidKernelInputs), &kernelInputs);
+  clContext.setKernelArg(KERNEL_VORTICITY_CONFINEMENT_XSPH_PACKED, 7, sizeof(FluidKernelInputs), &kernelInputs);
+}
+
+float Fluids::applyAdaptiveTimeStep(float remainingTime)
+{
+  const float timeStep = computeAdaptiveTimeStep(KERNEL_RESET_MAX_SQ_VEL, KERNEL_MAX_SQ_VEL, remainingTime);
+
+  auto& kernelInputs = getKernelInput<FluidKernelInputs>(0);
+  if (kernelInputs.timeStep != timeStep)
+  {
+    kernelInputs.timeStep = timeStep;
+    updateFluidsParamsInKernels();
+  }
+
+  return timeStep;
 }
 
 void Fluids::initFluidsParticles()
@@ -277,8 +407,6 @@ void Fluids::initFluidsParticles()
 
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.acquireGLBuffers({ "p_pos", "p_col" });
-
   std::vector<Math::float3> gridVerts;
 
   Math::float3 startFluidPos = { 0.0f, 0.0f, 0.0f };
@@ -391,10 +519,45 @@ void Fluids::initFluidsParticles()
   std::vector<std::array<float, 4>> vel(m_maxNbParticles, std::array<float, 4>({ 0.0f, 0.0f, 0.0f, 0.0f }));
   clContext.loadBufferFromHost("p_vel", 0, 4 * sizeof(float) * vel.size(), vel.data());
 
-  std::vector<std::array<float, 4>> col(m_maxNbParticles, std::array<float, 4>({ 0.0f, 0.1f, 1.0f, 0.0f }));
-  clContext.loadBufferFromHost("p_col", 0, 4 * sizeof(float) * col.size(), col.data());
+  std::vector<float> col(m_maxNbParticles, getKernelInput<FluidKernelInputs>(0).restDensity);
+  clContext.loadBufferFromHost("p_col", 0, sizeof(float) * col.size(), col.data());
+}
+
+void Fluids::onNbParticlesChanged(size_t prevNbParticles)
+{
+  if (m_currNbParticles > prevNbParticles)
+    respawnParticles(prevNbParticles, m_currNbParticles - prevNbParticles);
 
-  clContext.releaseGLBuffers({ "p_pos", "p_col" });
+  excludeInactiveParticles(KERNEL_RESET_CELL_ID, KERNEL_RESET_CAMERA_DIST);
+}
+
+void Fluids::respawnParticles(size_t startIndex, size_t nbParticles)
+{
+  CL::Context& clContext = CL::Context::Get();
+
+  // Layers spaced by half the effect radius, below rest density, stacked from the top of the box
+  const Math::float3 boxSize = { (float)m_boxSize.x, (float)m_boxSize.y, (float)m_boxSize.z };
+  const float spacing = 0.5f * boxSize.x / m_gridRes.x;
+  const bool is2D = (m_dimension == Geometry::Dimension::dim2D);
+  const size_t nbPartsPerRow = std::max<size_t>((size_t)(boxSize.z / spacing), 1);
+  const size_t nbRowsPerLayer = is2D ? 1 : std::max<size_t>((size_t)(boxSize.x / spacing), 1);
+
+  std::vector<std::array<float, 4>> pos(nbParticles);
+  for (size_t i = 0; i < nbParticles; ++i)
+  {
+    const size_t layer = i / (nbPartsPerRow * nbRowsPerLayer);
+    const size_t row = (i / nbPartsPerRow) % nbRowsPerLayer;
+    const size_t col = i % nbPartsPerRow;
+
+    const float x = is2D ? 0.0f : (row + 0.5f) * spacing - boxSize.x / 2.0f;
+    const float y = std::max(boxSize.y / 2.0f - (layer + 0.5f) * spacing, boxSize.y / -2.0f);
+    const float z = (col + 0.5f) * spacing - boxSize.z / 2.0f;
+    pos[i] = { x, y, z, 0.0f };
+  }
+  clContext.loadBufferFromHost("p_pos", 4 * sizeof(float) * startIndex, 4 * sizeof(float) * pos.size(), pos.data());
+
+  std::vector<std::array<float, 4>> vel(nbParticles, std::array<float, 4>({ 0.0f, 0.0f, 0.0f, 0.0f }));
+  clContext.loadBufferFromHost("p_vel", 4 * sizeof(float) * startIndex, 4 * sizeof(float) * vel.size(), vel.data());
 }
 
 void Fluids::update()
@@ -404,17 +567,28 @@ void Fluids::update()
 
   CL::Context& clContext = CL::Context::Get();
 
-  clContext.acquireGLBuffers({ "p_pos", "p_col", "c_partDetector", "u_cameraPos" });
+  // Rendering purpose, positions before this update kept for interpolation, following particles through sorts
+  if (m_isInterpolationEnabled)
+    clContext.copyBuffer("p_pos", "p_prevPos");
 
-  if (!m_pause)
+  // Fixed time step, several solver steps per update if time budget allows it
+  // Adaptive one covering up to max time step per substep with as many steps as the CFL condition requires,
+  // the rest of it being dropped if max number of steps is reached, slowing down violent phases to keep them stable
+  float remainingTime = simulatedTimePerUpdate(m_timeStep);
+  const size_t nbMaxSteps = m_isAdaptiveTimeStepEnabled ? m_maxNbAdaptiveSteps : m_nbSubsteps;
+  for (size_t substep = 0; !m_pause && substep < nbMaxSteps; ++substep)
   {
+    remainingTime -= m_isAdaptiveTimeStepEnabled ? applyAdaptiveTimeStep(remainingTime) : m_timeStep;
+
+    const bool isLastSubstep = (substep + 1 == nbMaxSteps) || (remainingTime < 0.5f * MIN_TIME_STEP);
+
     // Predicting velocity and position
     clContext.runKernel(KERNEL_PREDICT_POS, m_currNbParticles);
 
     // NNS - spatial partitioning
     clContext.runKernel(KERNEL_FILL_CELL_ID, m_currNbParticles);
 
-    m_radixSort.sort("p_cellID", { "p_pos", "p_col", "p_vel", "p_predPos" });
+    m_radixSort.sort("p_cellID", withPrevPos({ "p_pos", "p_vel", "p_predPos" }));
 
     clContext.runKernel(KERNEL_RESET_START_END_CELL, m_nbCells);
     clContext.runKernel(KERNEL_FILL_START_CELL, m_currNbParticles);
@@ -428,12 +602,33 @@ void Fluids::update()
     {
       // Clamping to boundary
       clContext.runKernel(KERNEL_APPLY_BOUNDARY, m_currNbParticles);
-      // Computing density using SPH method
-      clContext.runKernel(KERNEL_DENSITY, m_currNbParticles);
-      // Computing constraint factor Lambda
-      clContext.runKernel(KERNEL_CONSTRAINT_FACTOR, m_currNbParticles);
-      // Computing position correction
-      clContext.runKernel(KERNEL_CONSTRAINT_CORRECTION, m_currNbParticles);
+      // Compact storage only coming with the fused density kernel, m_isDensityKernelFused ignored
+      if (m_isStorageCompact)
+      {
+        // Packing positions once per iteration for neighbors to be read on 3x16 bits
+        clContext.runKernel(KERNEL_PACK_POS, m_currNbParticles);
+        // Computing density and constraint factor Lambda
+        clContext.runKernel(KERNEL_DENSITY_CONSTRAINT_FACTOR_PACKED, m_currNbParticles);
+        // Computing position correction
+        clContext.runKernel(KERNEL_CONSTRAINT_CORRECTION_PACKED, m_currNbParticles);
+      }
+      else
+      {
+        if (m_isDensityKernelFused)
+        {
+          // Computing density and constraint factor Lambda, visiting neighbors only once
+          clContext.runKernel(KERNEL_DENSITY_CONSTRAINT_FACTOR, m_currNbParticles);
+        }
+        else
+        {
+          // Computing density using SPH method
+          clContext.runKernel(KERNEL_DENSITY, m_currNbParticles);
+          // Computing constraint factor Lambda
+          clContext.runKernel(KERNEL_CONSTRAINT_FACTOR, m_currNbParticles);
+        }
+        // Computing position correction
+        clContext.runKernel(KERNEL_CONSTRAINT_CORRECTION, m_currNbParticles);
+      }
       // Correcting predicted position
       clContext.runKernel(KERNEL_CORRECT_POS, m_currNbParticles);
     }
@@ -443,29 +638,87 @@ void Fluids::update()
 
     if (getKernelInput<FluidKernelInputs>(0).isVorticityConfEnabled)
     {
-      // Computing vorticityx
-      clContext.runKernel(KERNEL_COMPUTE_VORTICITY, m_currNbParticles);
-      // Applying vorticity confinement to attenue virtual damping
-      clContext.runKernel(KERNEL_VORTICITY_CONFINEMENT, m_currNbParticles);
-      // Copying velocity buffer as input for vorticity confinement correction
-      clContext.copyBuffer("p_vel", "p_velInViscosity");
-      // Applying xsph viscosity correction for a more coherent motion
-      clContext.runKernel(KERNEL_XSPH_VISCOSITY, m_currNbParticles);
+      if (m_isStorageCompact)
+      {
+        // Packing corrected positions and velocities
+        clContext.runKernel(KERNEL_PACK_POS, m_currNbParticles);
+        clContext.runKernel(KERNEL_PACK_VEL, m_currNbParticles);
+        // Computing vorticity
+        clContext.runKernel(KERNEL_COMPUTE_VORTICITY_PACKED, m_currNbParticles);
+      }
+      else
+      {
+        // Computing vorticity
+        clContext.runKernel(KERNEL_COMPUTE_VORTICITY, m_currNbParticles);
+      }
+
+      if (m_isConfinementKernelFused)
+      {
+        // Applying vorticity confinement and xsph viscosity correction in a single pass, both reading unmodified velocities
+        clContext.runKernel(m_isStorageCompact ? KERNEL_VORTICITY_CONFINEMENT_XSPH_PACKED : KERNEL_VORTICITY_CONFINEMENT_XSPH, m_currNbParticles);
+        // Corrected velocities becoming the current ones, kernels following the swapped buffers
+        clContext.swapBuffers("p_vel", "p_velOut");
+      }
+      else
+      {
+        // Applying vorticity confinement to attenue virtual damping
+        clContext.runKernel(m_isStorageCompact ? KERNEL_VORTICITY_CONFINEMENT_PACKED : KERNEL_VORTICITY_CONFINEMENT, m_currNbParticles);
+        // Confined velocities becoming the current ones, read by xsph viscosity instead of a copy of them
+        clContext.swapBuffers("p_vel", "p_velOut");
+
+        // Applying xsph viscosity correction for a more coherent motion
+        if (m_isStorageCompact)
+          clContext.runKernel(KERNEL_PACK_VEL, m_currNbParticles);
+        clContext.runKernel(m_isStorageCompact ? KERNEL_XSPH_VISCOSITY_PACKED : KERNEL_XSPH_VISCOSITY, m_currNbParticles);
+        clContext.swapBuffers("p_vel", "p_velOut");
+      }
     }
 
     // Updating pos
     clContext.runKernel(KERNEL_UPDATE_POS, m_currNbParticles);
 
-    // Rendering purpose
-    clContext.runKernel(KERNEL_RESET_PART_DETECTOR, m_nbCells);
-    clContext.runKernel(KERNEL_FILL_PART_DETECTOR, m_currNbParticles);
-    clContext.runKernel(KERNEL_FILL_COLOR, m_currNbParticles);
+    if (isLastSubstep)
+      break;
+  }
+
+  if (m_isAdaptiveTimeStepEnabled)
+    reportDroppedTime(remainingTime);
+
+  // Nothing published without render slots, update then waiting for the device queue like a plain compute step
+  if (!hasRenderSlots())
+  {
+    clContext.finishTasks();
+    return;
+  }
+
+  // Render slot granted by the graphics engine, not drawn anymore
+  const auto sharedGLBuffers = renderSlotBufferNames();
+
+  clContext.acquireGLBuffers(sharedGLBuffers);
+
+  // Sending density to color buffer, colormap is applied at rendering
+  clContext.copyBuffer(currentDisplayedPhysicalQuantity().bufferName, "p_col");
+
+  // Rendering purpose, only once per update, paused or not
+  fillPartDetector(KERNEL_RESET_PART_DETECTOR, KERNEL_FILL_PART_DETECTOR);
+
+  // Camera state of the last frame drawn by the graphics engine
+  loadCameraState();
+
+  // Only computing the permutation, simulation buffers being read in camera order while filling the render slot
+  if (m_isCameraSortEnabled)
+  {
+    clContext.runKernel(KERNEL_FILL_CAMERA_DIST, m_currNbParticles);
+
+    m_radixSort.sort("p_cameraDist");
   }
 
-  // Rendering purpose
-  clContext.runKernel(KERNEL_FILL_CAMERA_DIST, m_currNbParticles);
+  // Rendering purpose, publishing particles into the render slot, positions on 3x16 bits instead of 4x32 bits if quantized
+  fillRenderSlot(KERNEL_FILL_RENDER_SLOT, "p_col", m_isCameraSortEnabled);
 
-  m_radixSort.sort("p_cameraDist", { "p_pos", "p_col", "p_vel", "p_predPos" });
+  // Rendering purpose, only particles inside camera frustum are drawn
+  if (m_isFrustumCullingEnabled)
+    runFrustumCulling(KERNEL_COUNT_VISIBLE_PARTS, KERNEL_SCAN_VISIBLE_PARTS, KERNEL_COMPACT_VISIBLE_PARTS, m_isCameraSortEnabled);
 
-  clContext.releaseGLBuffers({ "p_pos", "p_col", "c_partDetector", "u_cameraPos" });
+  clContext.releaseGLBuffers(sharedGLBuffers);
 }
\ No newline at end of file
@@ -44,20 +44,43 @@ class Fluids : public OclModel<FluidKernelInputs>
   void transferJsonInputsToModel(json& getInputJson) override;
   void transferKernelInputsToGPU() override;
 
+  std::map<std::string, double> qualityMetrics() override { return particleMetrics(getKernelInput<FluidKernelInputs>(0).restDensity); }
+
+  bool isNbParticlesAdjustable() const override { return true; }
+
+  // Only depending on the box, to be built before the model is created
+  static programSpecs ProgramSpecs(const Geometry::BoxSize3D& boxSize, const Geometry::BoxSize3D& gridRes);
+
   private:
   bool createProgram() const;
-  bool createBuffers() const;
+  bool createBuffers();
   bool createKernels() const;
 
   void initFluidsParticles();
+  // Restored particles dropped from the top of the box, their frozen positions overlapping the fluid
+  void respawnParticles(size_t startIndex, size_t nbParticles);
+  void onNbParticlesChanged(size_t prevNbParticles) override;
   void updateFluidsParamsInKernels();
 
+  // Adaptive time step set in kernels, see computeAdaptiveTimeStep()
+  float applyAdaptiveTimeStep(float remainingTime);
+
   bool m_simplifiedMode;
 
   size_t m_maxNbPartsInCell;
 
   // Input available in UI through input json
   size_t m_nbJacobiIters;
+  // Density and constraint factor computed by a single kernel instead of two, both walking the same neighbors
+  // Ignored with compact storage, only fused there
+  bool m_isDensityKernelFused;
+  // Neighbor positions, velocities and vorticity read from 3x16 bits copies, see fld_packPosition()
+  bool m_isStorageCompact;
+  // Vorticity confinement and xsph viscosity applied by a single kernel, viscosity then ignoring confinement
+  bool m_isConfinementKernelFused;
+
+  // Simulated time per substep with a fixed time step, see simulatedTimePerUpdate()
+  float m_timeStep;
 
   RadixSort m_radixSort;
 };
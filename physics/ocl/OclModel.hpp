@@ -2,8 +2,13 @@
 
 #include "../Model.hpp"
 #include "Context.hpp"
+#include "Logging.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <variant>
+#include <vector>
 
 namespace Physics::CL
 {
@@ -13,16 +18,24 @@ template <typename... KernelInputs>
 class OclModel : public Model
 {
   public:
-  OclModel(ModelParams params, KernelInputs... kernelInputs, json inputJson = {})
+  // Programs and buffers created by the model are owned by the context scope, cached once the model is destroyed
+  // Scope set before derived class members, which may create their own programs and buffers
+  OclModel(const std::string& contextScope, ModelParams params, KernelInputs... kernelInputs, json inputJson = {})
       : Model(params, inputJson)
   {
+    CL::Context::Get().useScope(contextScope);
+
     // Adding all inputs to kernel inputs for GPU-CPU interaction
     (m_kernelInputs.push_back(kernelInputs), ...);
   };
 
   ~OclModel()
   {
-    CL::Context::Get().release();
+    // Pending max velocity read still writing into this model otherwise
+    if (m_maxSqVelRead() != nullptr)
+      m_maxSqVelRead.wait();
+
+    CL::Context::Get().parkScope();
   }
 
   bool isProfilingEnabled() const override
@@ -44,6 +57,33 @@ class OclModel : public Model
     return (platformName.find("Intel") != std::string::npos);
   }
 
+  std::string deviceName() const override
+  {
+    CL::Context& clContext = Physics::CL::Context::Get();
+    return clContext.isInit() ? clContext.getDeviceName() : "";
+  }
+
+  std::map<std::string, KernelProfile> kernelProfiles() const override
+  {
+    std::map<std::string, KernelProfile> profiles;
+    for (const auto& [kernelName, kernelTime] : Physics::CL::Context::Get().kernelTimes())
+      profiles[kernelName] = { kernelTime.totalTimeMs, kernelTime.nbRuns };
+    return profiles;
+  }
+
+  void resetKernelProfiles() override
+  {
+    Physics::CL::Context::Get().resetKernelTimes();
+  }
+
+  void finishRenderSlot() override
+  {
+    Physics::CL::Context::Get().waitForGLBuffersRelease();
+
+    // Read back before GL buffers release in the queue
+    m_nbVisibleParticles = (size_t)m_nbVisiblePartsReadback;
+  }
+
   // Model.hpp
   void updateModelWithInputJson(json& inputJson) override
   {
@@ -51,6 +91,8 @@ class OclModel : public Model
     transferJsonInputsToModel(inputJson);
     // Then transfer kernel inputs from CPU to GPU
     transferKernelInputsToGPU();
+    // Everything transferred
+    m_parameters.clearDirty();
   }
 
   virtual void transferJsonInputsToModel(json& inputJson) = 0;
@@ -66,6 +108,206 @@ class OclModel : public Model
   size_t getNbKernelInputs() { return m_kernelInputs.size(); }
 
   protected:
+  // Lower bound of Time Step input, also bounding adaptive time steps
+  static constexpr float MIN_TIME_STEP = 0.0001f;
+
+  // Simulated time covered by an update, in as many steps as the CFL condition requires if time step is adaptive,
+  // calm scenes then taking steps up to max time step instead of the fixed one
+  float simulatedTimePerUpdate(float fixedTimeStep) const
+  {
+    return (m_isAdaptiveTimeStepEnabled ? m_maxTimeStep : fixedTimeStep) * m_nbSubsteps;
+  }
+
+  // Time step from CFL condition on max velocity reduced on device, steps evenly covering the remaining time
+  // Max velocity is the one of the previous step, read without blocking the queue
+  float computeAdaptiveTimeStep(const std::string& resetMaxSqVelKernelName, const std::string& maxSqVelKernelName, float remainingTime)
+  {
+    CL::Context& clContext = Physics::CL::Context::Get();
+
+    // Max velocity read at the start of the previous step, the device being already busy with that step
+    // so that waiting for it does not drain the queue, unlike a blocking read of the current one
+    if (m_maxSqVelRead() != nullptr)
+    {
+      m_maxSqVelRead.wait();
+      m_maxSqVelRead = cl::Event();
+      std::memcpy(&m_maxSqVel, &m_maxSqVelBits, sizeof(float));
+    }
+
+    clContext.runKernel(resetMaxSqVelKernelName, 1);
+    clContext.runKernel(maxSqVelKernelName, m_currNbParticles);
+    clContext.unloadBufferFromDevice("u_maxSqVel", 0, sizeof(cl_uint), &m_maxSqVelBits, false, &m_maxSqVelRead);
+
+    // CFL condition, particles not moving further than a fraction of the SPH effect radius per step
+    const float effectRadius = ((float)m_boxSize.x) / m_gridRes.x;
+    float timeStep = (m_maxSqVel > 0.0f) ? m_cflNumber * effectRadius / std::sqrt(m_maxSqVel) : m_maxTimeStep;
+    timeStep = std::clamp(timeStep, MIN_TIME_STEP, m_maxTimeStep);
+
+    // NaN or infinite velocities, e.g. from an exploding scene, giving the smallest step instead of a NaN one
+    if (!std::isfinite(m_maxSqVel))
+      timeStep = MIN_TIME_STEP;
+
+    // Remaining time evenly split, avoiding a tiny last step
+    return remainingTime / std::ceil(remainingTime / timeStep);
+  }
+
+  // Simulated time left once max number of adaptive steps is reached, dropped to keep violent phases stable
+  void reportDroppedTime(float remainingTime)
+  {
+    m_droppedTime = (!m_pause && remainingTime >= 0.5f * MIN_TIME_STEP) ? remainingTime : 0.0f;
+
+    if (m_droppedTime > 0.0f)
+      LOG_DEBUG("Max number of adaptive steps reached, {} s of simulated time dropped", m_droppedTime);
+  }
+
+  // Particles back at rest, previous max velocity not relevant anymore
+  void resetAdaptiveTimeStep()
+  {
+    if (m_maxSqVelRead() != nullptr)
+    {
+      m_maxSqVelRead.wait();
+      m_maxSqVelRead = cl::Event();
+    }
+    m_maxSqVel = 0.0f;
+    m_droppedTime = 0.0f;
+  }
+
+  // Work-group size of frustum culling kernels, must match CULLING_GROUP_SIZE in define.cl
+  static constexpr size_t CULLING_GROUP_SIZE = 128;
+  static size_t nbCullingGroups(size_t nbParticles) { return (nbParticles + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE; }
+
+  // Publishing particles into the render slot straight from simulation buffers, in camera order if they have been sorted
+  // Fill kernel args are the permutation and the particle buffers, see fillRenderSlot in utils.cl
+  void fillRenderSlot(const std::string& fillKernelName, const std::string& colBufferName, bool isSorted)
+  {
+    CL::Context& clContext = Physics::CL::Context::Get();
+
+    const cl_uint isSortedArg = isSorted ? 1 : 0;
+    const cl_uint isPosQuantized = m_isPosQuantizationEnabled ? 1 : 0;
+    const cl_uint isInterpolated = m_isInterpolationEnabled ? 1 : 0;
+    clContext.setKernelArg(fillKernelName, 1, sizeof(cl_uint), &isSortedArg);
+    clContext.setKernelArg(fillKernelName, 4, colBufferName);
+    clContext.setKernelArg(fillKernelName, 5, sizeof(cl_uint), &isPosQuantized);
+    clContext.setKernelArg(fillKernelName, 6, sizeof(cl_uint), &isInterpolated);
+    clContext.setKernelArg(fillKernelName, 7, renderSlotBufferName("r_pos", m_renderSlot));
+    clContext.setKernelArg(fillKernelName, 8, renderSlotBufferName("r_prevPos", m_renderSlot));
+    clContext.setKernelArg(fillKernelName, 9, renderSlotBufferName("r_col", m_renderSlot));
+    clContext.setKernelArg(fillKernelName, 10, renderSlotBufferName("r_quantizedPos", m_renderSlot));
+
+    clContext.runKernel(fillKernelName, m_currNbParticles);
+  }
+
+  // Camera state set by the graphics engine, written by value so that OpenGL can keep updating its own copy
+  // Non-blocking, camera state not being modified before the render slot is finished
+  void loadCameraState()
+  {
+    CL::Context& clContext = Physics::CL::Context::Get();
+    clContext.loadBufferFromHost("u_frameState", 0, FRAME_STATE_SIZE, m_cameraState.data(), false);
+  }
+
+  // Flagging grid cells occupied by particles into the render slot detector
+  void fillPartDetector(const std::string& resetKernelName, const std::string& fillKernelName)
+  {
+    CL::Context& clContext = Physics::CL::Context::Get();
+
+    const auto detectorName = renderSlotBufferName("r_partDetector", m_renderSlot);
+    clContext.setKernelArg(resetKernelName, 0, detectorName);
+    clContext.setKernelArg(fillKernelName, 1, detectorName);
+
+    clContext.runKernel(resetKernelName, m_nbCells);
+    clContext.runKernel(fillKernelName, m_currNbParticles);
+  }
+
+  // Particles beyond the active count given cell IDs and camera distances above any valid one,
+  // sorts keeping them at the end, out of the simulation and of the rendering
+  void excludeInactiveParticles(const std::string& resetCellIDKernelName, const std::string& resetCameraDistKernelName)
+  {
+    if (m_currNbParticles >= m_maxNbParticles)
+      return;
+
+    CL::Context& clContext = Physics::CL::Context::Get();
+
+    const size_t nbInactiveParticles = m_maxNbParticles - m_currNbParticles;
+    clContext.runKernel(resetCellIDKernelName, nbInactiveParticles, 0, m_currNbParticles);
+    clContext.runKernel(resetCameraDistKernelName, nbInactiveParticles, 0, m_currNbParticles);
+  }
+
+  // Frustum culling compacting visible particles indices in render slot order, e.g. sorted along camera axis
+  // Number of visible particles read back without stalling the queue, valid once the render slot is finished
+  void runFrustumCulling(const std::string& countKernelName, const std::string& scanKernelName, const std::string& compactKernelName, bool isSorted)
+  {
+    CL::Context& clContext = Physics::CL::Context::Get();
+
+    const cl_uint isSortedArg = isSorted ? 1 : 0;
+    const cl_uint nbParts = (cl_uint)m_currNbParticles;
+    const cl_uint nbGroups = (cl_uint)nbCullingGroups(m_currNbParticles);
+    for (const auto& kernelName : { countKernelName, compactKernelName })
+    {
+      clContext.setKernelArg(kernelName, 2, sizeof(cl_uint), &isSortedArg);
+      clContext.setKernelArg(kernelName, 4, sizeof(cl_uint), &nbParts);
+    }
+    clContext.setKernelArg(scanKernelName, 0, sizeof(cl_uint), &nbGroups);
+    clContext.setKernelArg(compactKernelName, 6, renderSlotBufferName("r_visibleIndex", m_renderSlot));
+
+    clContext.runKernel(countKernelName, nbGroups * CULLING_GROUP_SIZE, CULLING_GROUP_SIZE);
+    clContext.runKernel(scanKernelName, 1);
+    clContext.runKernel(compactKernelName, nbGroups * CULLING_GROUP_SIZE, CULLING_GROUP_SIZE);
+
+    clContext.unloadBufferFromDevice("u_nbVisibleParts", 0, sizeof(cl_uint), &m_nbVisiblePartsReadback, false);
+  }
+
+  // Kinetic energy per particle of unit mass, and relative error to rest density if one is given
+  std::map<std::string, double> particleMetrics(float restDensity = 0.0f) const
+  {
+    std::map<std::string, double> metrics;
+    if (m_currNbParticles == 0)
+      return metrics;
+
+    CL::Context& clContext = Physics::CL::Context::Get();
+
+    std::vector<cl_float4> vel(m_currNbParticles);
+    if (clContext.unloadBufferFromDevice("p_vel", 0, m_currNbParticles * sizeof(cl_float4), vel.data()))
+    {
+      double kineticEnergy = 0.0;
+      for (const auto& v : vel)
+        kineticEnergy += 0.5 * ((double)v.s[0] * v.s[0] + (double)v.s[1] * v.s[1] + (double)v.s[2] * v.s[2]);
+      metrics["kineticEnergy"] = kineticEnergy / m_currNbParticles;
+    }
+
+    std::vector<cl_float> density(m_currNbParticles);
+    if (restDensity > 0.0f && clContext.unloadBufferFromDevice("p_density", 0, m_currNbParticles * sizeof(cl_float), density.data()))
+    {
+      double sumError = 0.0, maxError = 0.0;
+      for (const auto dens : density)
+      {
+        const double error = std::abs(dens / restDensity - 1.0);
+        sumError += error;
+        maxError = std::max(maxError, error);
+      }
+      metrics["meanDensityError"] = sumError / m_currNbParticles;
+      metrics["maxDensityError"] = maxError;
+    }
+
+    if (m_isAdaptiveTimeStepEnabled)
+      metrics["droppedTime"] = m_droppedTime;
+
+    return metrics;
+  }
+
   std::vector<std::variant<KernelInputs...>> m_kernelInputs;
+
+  // Filled by runFrustumCulling() once the queue reaches the readback, see finishRenderSlot()
+  cl_uint m_nbVisiblePartsReadback = 0;
+
+  // Adaptive time step inputs, read from input json by models supporting it
+  bool m_isAdaptiveTimeStepEnabled = false;
+  float m_cflNumber = 0.4f;
+  float m_maxTimeStep = 0.020f;
+  size_t m_maxNbAdaptiveSteps = 8;
+  // Simulated time dropped by the last update, see reportDroppedTime()
+  float m_droppedTime = 0.0f;
+  // Max squared velocity of the previous step, its bits being filled by a pending read until m_maxSqVelRead completes
+  float m_maxSqVel = 0.0f;
+  cl_uint m_maxSqVelBits = 0;
+  cl::Event m_maxSqVelRead;
 };
 }
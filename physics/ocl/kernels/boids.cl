@@ -33,11 +33,11 @@ inline uint getCell1DIndexFromPos(float4 pos);
 
 
 /*
-  Fill color buffer with chosen color, could be a physics variable for real-time analysis
+  Fill color buffer with uniform value, colormap is applied at rendering
 */
-__kernel void bd_fillBoidsColor(__global float4 *col)
+__kernel void bd_fillBoidsColor(__global float *col)
 {
-  col[ID] = (float4)(1.0f, 0.02f, 0.02f, 0.5f);
+  col[ID] = 1.0f;
 }
 
 /*
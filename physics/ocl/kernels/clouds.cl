@@ -15,6 +15,10 @@
 // define.cl must be included as first file.cl to create OpenCL program
 #define WALL_COEFF 1000.0f
 
+// Cloud density volume, accumulated as fixed-point values, no float atomics in OpenCL 1.2
+#define VOLUME_FIXED_POINT_SCALE 1000.0f
+#define VOLUME_MAX_DENSITY       100.0f
+
 // See CloudKernelInputs in Clouds.cpp
 typedef struct defCloudParams{
   uint dim;
@@ -107,7 +111,7 @@ inline float artPressure(const float4 vec, FluidParams fluid)
   if(fluid.isArtPressureEnabled == 0)
     return 0.0f;
 
-  return - fluid.artPressureCoeff * pow((poly6(vec, EFFECT_RADIUS) / poly6L(fluid.artPressureRadius * EFFECT_RADIUS, EFFECT_RADIUS)), fluid.artPressureExp);
+  return - fluid.artPressureCoeff * pown(poly6(vec, EFFECT_RADIUS) / poly6L(fluid.artPressureRadius * EFFECT_RADIUS, EFFECT_RADIUS), (int)fluid.artPressureExp);
 }
 
 /*
@@ -791,10 +795,11 @@ __kernel void cld_applyVorticityConfinement(//Input
                                             const __global float4 *predPos,      // 0
                                             const __global uint2  *startEndCell, // 1
                                             const __global float4 *vort,         // 2
+                                            const __global float4 *velIn,        // 3
                                             //Param
-                                            const     FluidParams fluid,         // 3
+                                            const     FluidParams fluid,         // 4
                                             //Output
-                                                  __global float4 *vel)          // 4
+                                                  __global float4 *velOut)       // 5
 {
   const float4 pos = predPos[ID];
   const float4 vorticity = vort[ID];
@@ -846,10 +851,9 @@ __kernel void cld_applyVorticityConfinement(//Input
   }
 
   // Adding vorticity confinement to attenue virtual damping
-  vel[ID] += fluid.vorticityConfCoeff * cross(normalize(n), vorticity) * fluid.timeStep;
+  velOut[ID] = velIn[ID] + fluid.vorticityConfCoeff * cross(normalize(n), vorticity) * fluid.timeStep;
 }
 
-
 /*
   Apply xsph viscosity correction
 */
@@ -914,6 +918,81 @@ __kernel void cld_applyXsphViscosityCorrection(//Input
   velOut[ID] = velocity + fluid.xsphViscosityCoeff * viscosity;
 }
 
+/*
+  Apply vorticity confinement and xsph viscosity correction in a single neighborhood traversal
+  Approximation of both kernels above, viscosity being computed on velocities before confinement instead of after
+*/
+__kernel void cld_applyVorticityConfinementAndXsphViscosity(//Input
+                                                            const __global float4 *predPos,      // 0
+                                                            const __global uint2  *startEndCell, // 1
+                                                            const __global float4 *vort,         // 2
+                                                            const __global float4 *velIn,        // 3
+                                                            //Param
+                                                            const     FluidParams fluid,         // 4
+                                                            //Output
+                                                                  __global float4 *velOut)       // 5
+{
+  const float4 pos = predPos[ID];
+  const float4 vorticity = vort[ID];
+  const float4 velocity = velIn[ID];
+  const int3 cellIndex3D = convert_int3(getCell3DIndexFromPos(pos));
+
+  float4 vec = (float4)(0.0f);
+  // vorticity confinement
+  float4 n = (float4)(0.0f);
+  float4 viscosity = (float4)(0.0f);
+
+  uint cellNIndex1D = 0;
+  int3 cellNIndex3D = (int3)(0);
+  int3 gridResXYZ = (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z);
+  uint2 startEndN = (uint2)(0, 0);
+
+  float4 absWallXYZ = (float4)(ABS_WALL_X, ABS_WALL_Y, ABS_WALL_Z, 0.0f);
+  float4 signAbsWall = (float4)(0.0f);
+
+  // 27 cells to visit, current one + 3D neighbors
+  for (int iX = -1; iX <= 1; ++iX)
+  {
+    for (int iY = -1; iY <= 1; ++iY)
+    {
+      for (int iZ = -1; iZ <= 1; ++iZ)
+      {
+        signAbsWall = (float4)(0.0f);
+
+        cellNIndex3D = (cellIndex3D + (int3)(iX, iY, iZ) + gridResXYZ) % gridResXYZ;
+
+        // Periodic BC for x, periodic neighbors must be considered
+        if((cellIndex3D.x + iX) >= GRID_RES_X) signAbsWall.x = 2.0f;
+        else if((cellIndex3D.x + iX) < 0) signAbsWall.x = -2.0f;
+
+        // Wall BC for y, out of domain cells are discarded
+        if(((cellIndex3D.y + iY) >= GRID_RES_Y) || ((cellIndex3D.y + iY) < 0)) continue;
+        
+        // Periodic BC for z, periodic neighbors must be considered
+        if((cellIndex3D.z + iZ) >= GRID_RES_Z) signAbsWall.z = 2.0f;
+        else if((cellIndex3D.z + iZ) < 0) signAbsWall.z = -2.0f;
+
+        cellNIndex1D = (cellNIndex3D.x * GRID_RES_Y + cellNIndex3D.y) * GRID_RES_Z + cellNIndex3D.z;
+
+        startEndN = startEndCell[cellNIndex1D];
+
+        for (uint e = startEndN.x; e <= startEndN.y; ++e)
+        {
+          vec = pos - predPos[e] - absWallXYZ * signAbsWall;
+
+          n += fast_length(vort[e]) * gradSpiky(vec, EFFECT_RADIUS);
+          viscosity += (velIn[e] - velocity) * poly6(vec, EFFECT_RADIUS);
+        }
+      }
+    }
+  }
+
+  // Adding vorticity confinement to attenue virtual damping
+  // and xsph viscosity for a more coherent motion
+  velOut[ID] = velocity + fluid.vorticityConfCoeff * cross(normalize(n), vorticity) * fluid.timeStep
+                        + fluid.xsphViscosityCoeff * viscosity;
+}
+
 /*
   Correction position using Constraint correction value
 */
@@ -964,4 +1043,49 @@ __kernel void cld_updateVel(//Input
 {
   // Clamping velocity and preventing division by 0
   vel[ID] = clamp((totCorrPos[ID]) / (fluid.timeStep + FLOAT_EPS), -MAX_VEL, MAX_VEL);
-}
\ No newline at end of file
+}
+
+/*
+  Reset cloud density volume accumulator. For rendering purpose only.
+*/
+__kernel void cld_resetDensityVolume(__global uint *densVolumeAcc)
+{
+  densVolumeAcc[ID] = 0;
+}
+
+/*
+  Splat cloud density of each particle into the grid cell containing it. For rendering purpose only.
+*/
+__kernel void cld_splatDensityVolume(//Input
+                                     const __global float4 *pos,           // 0
+                                     const __global float  *cloudDens,     // 1
+                                     //Output
+                                           __global uint   *densVolumeAcc) // 2
+{
+  const uint cellIndex = getCell1DIndexFromPos(pos[ID]);
+
+  if (cellIndex >= GRID_NUM_CELLS)
+    return;
+
+  const float dens = clamp(cloudDens[ID], 0.0f, VOLUME_MAX_DENSITY);
+
+  atomic_add(&densVolumeAcc[cellIndex], convert_uint_sat_rte(dens * VOLUME_FIXED_POINT_SCALE));
+}
+
+/*
+  Convert accumulated cloud density into the 3D texture layout, x being the fastest coordinate. For rendering purpose only.
+*/
+__kernel void cld_fillDensityVolume(//Input
+                                    const __global uint  *densVolumeAcc, // 0
+                                    //Output
+                                          __global float *densVolume)    // 1
+{
+  const uint x = ID % GRID_RES_X;
+  const uint y = (ID / GRID_RES_X) % GRID_RES_Y;
+  const uint z = ID / (GRID_RES_X * GRID_RES_Y);
+
+  // Same cell ordering than getCell1DIndexFromPos
+  const uint cellIndex = x * GRID_RES_Z * GRID_RES_Y + y * GRID_RES_Z + z;
+
+  densVolume[ID] = (float)densVolumeAcc[cellIndex] / VOLUME_FIXED_POINT_SCALE;
+}
@@ -9,6 +9,15 @@
 #define GRAVITY_ACC   (float4)(0.0f, -ABS_GRAVITY_ACC_Y, 0.0f, 0.0f)
 #define FAR_DIST      1000000.0f
 
+// Clip-space tolerance used for particles frustum culling, avoiding popping of point sprites on screen borders
+#define FRUSTUM_MARGIN 1.05f
+// Work-group size of frustum culling kernels, see CULLING_GROUP_SIZE in OclModel.hpp
+#define CULLING_GROUP_SIZE 128
+
+// float4 offsets inside the camera state copied from the graphics engine, see FRAME_STATE_SIZE in Model.hpp
+#define FRAME_STATE_PROJ_VIEW  0
+#define FRAME_STATE_CAMERA_POS 4
+
 // See FluidsKernelInputs in Fluids.cpp / Clouds.cpp
 typedef struct defFluidParams{
   float restDensity;
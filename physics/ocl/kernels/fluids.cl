@@ -42,8 +42,44 @@ inline uint3 getCell3DIndexFromPos(float4 pos);
   Compute 1D index of the cell containing given position
 */
 inline uint getCell1DIndexFromPos(float4 pos);
+/*
+  Compute 3D index of the cell from its 1D index
+*/
+inline uint3 getCell3DIndexFrom1DIndex(uint cell1DIndex);
 //
 
+/*
+  Compact storage of solver state read from neighbors, decoded in registers
+  Positions on 3x16 bits fixed point relative to the origin of the cell particles were sorted in,
+  covering one extra cell on each side for positions drifting during solver iterations,
+  positions drifting further being saturated at packing and read back from the float buffer
+  Velocities and vorticity on 3x16 bits half floats
+*/
+#define PACKED_POS_RANGE 3.0f
+
+inline float3 getCellOrigin(const int3 cellIndex3D)
+{
+  return convert_float3(cellIndex3D) * GRID_CELL_SIZE_XYZ - (float3)(ABS_WALL_X, ABS_WALL_Y, ABS_WALL_Z);
+}
+
+inline float4 unpackPos(const __global ushort *packedPos, const __global float4 *predPos, const uint index, const int3 cellIndex3D)
+{
+  const ushort3 packed = vload3(index, packedPos);
+
+  // Saturated components mean position drifted out of packed range, full precision position read instead
+  if (any(packed == (ushort3)(0)) || any(packed == (ushort3)(USHRT_MAX)))
+    return (float4)(predPos[index].xyz, 0.0f);
+
+  const float3 offset = (convert_float3(packed) * (PACKED_POS_RANGE / 65535.0f) - 1.0f) * GRID_CELL_SIZE_XYZ;
+
+  return (float4)(getCellOrigin(cellIndex3D) + offset, 0.0f);
+}
+
+inline float4 unpackHalf(const __global half *packedVec, const uint index)
+{
+  return (float4)(vload_half3(index, packedVec), 0.0f);
+}
+
 /*
   Artificial pressure to remove tensile instability
   Preventing particle clustering and improving surface tension
@@ -53,7 +89,7 @@ inline float artPressure(const float4 vec, FluidParams fluid)
   if(fluid.isArtPressureEnabled == 0)
     return 0.0f;
 
-  return - fluid.artPressureCoeff * pow((poly6(vec, EFFECT_RADIUS) / poly6L(fluid.artPressureRadius * EFFECT_RADIUS, EFFECT_RADIUS)), fluid.artPressureExp);
+  return - fluid.artPressureCoeff * pown(poly6(vec, EFFECT_RADIUS) / poly6L(fluid.artPressureRadius * EFFECT_RADIUS, EFFECT_RADIUS), (int)fluid.artPressureExp);
 }
 
 /*
@@ -127,17 +163,18 @@ __kernel void fld_computeDensity(//Input
 
 /*
   Compute Constraint Factor (Lambda), coefficient along jacobian
+  Stored in w of the predicted position, read along with it by the constraint correction
+  Only xyz of neighbors are read, their w being concurrently written
 */
 __kernel void fld_computeConstraintFactor(//Input
-                                          const __global float4 *predPos,       // 0
-                                          const __global float  *density,       // 1
-                                          const __global uint2  *startEndCell,  // 2
+                                          const __global float  *density,       // 0
+                                          const __global uint2  *startEndCell,  // 1
                                           //Param
-                                          const     FluidParams fluid,          // 3
-                                          //Output
-                                                __global float  *constFactor)   // 4
+                                          const     FluidParams fluid,          // 2
+                                          //Input/Output
+                                                __global float4 *predPos)       // 3
 {
-  const float4 pos = predPos[ID];
+  const float4 pos = (float4)(predPos[ID].xyz, 0.0f);
   const int3 cellIndex3D = convert_int3(getCell3DIndexFromPos(pos));
   const float densityC = density[ID] / fluid.restDensity - 1.0f;
 
@@ -173,7 +210,7 @@ __kernel void fld_computeConstraintFactor(//Input
 
         for (uint e = startEndN.x; e <= startEndN.y; ++e)
         {
-          vec = pos - predPos[e];
+          vec = (float4)(pos.xyz - predPos[e].xyz, 0.0f);
 
           // Supposed to be null if vec = 0.0f;
           grad = gradSpiky(vec, EFFECT_RADIUS);
@@ -189,23 +226,96 @@ __kernel void fld_computeConstraintFactor(//Input
   sumSqGradC += dot(sumGradCi, sumGradCi);
   sumSqGradC /= fluid.restDensity * fluid.restDensity;
 
-  constFactor[ID] = - densityC / (sumSqGradC + fluid.relaxCFM);
+  predPos[ID].w = - densityC / (sumSqGradC + fluid.relaxCFM);
+}
+
+/*
+  Compute fluid density and Constraint Factor (Lambda) in a single neighborhood traversal
+  Same results as fld_computeDensity followed by fld_computeConstraintFactor, Lambda being stored in w as well
+*/
+__kernel void fld_computeDensityAndConstraintFactor(//Input
+                                                    const __global uint2  *startEndCell,  // 0
+                                                    //Param
+                                                    const     FluidParams fluid,          // 1
+                                                    //Output
+                                                          __global float  *density,       // 2
+                                                    //Input/Output
+                                                          __global float4 *predPos)       // 3
+{
+  const float4 pos = (float4)(predPos[ID].xyz, 0.0f);
+  const int3 cellIndex3D = convert_int3(getCell3DIndexFromPos(pos));
+
+  float fluidDensity = 0.0f;
+
+  float4 vec = (float4)(0.0f);
+  float4 grad = (float4)(0.0f);
+  float4 sumGradCi = (float4)(0.0f);
+  float  sumSqGradC = 0.0f;
+
+  uint cellNIndex1D = 0;
+  int3 cellNIndex3D = (int3)(0);
+  int3 gridResXYZ = (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z);
+  uint2 startEndN = (uint2)(0);
+
+  // 27 cells to visit, current one + 3D neighbors
+  for (int iX = -1; iX <= 1; ++iX)
+  {
+    for (int iY = -1; iY <= 1; ++iY)
+    {
+      for (int iZ = -1; iZ <= 1; ++iZ)
+      {
+        cellNIndex3D = (cellIndex3D + (int3)(iX, iY, iZ) + gridResXYZ) % gridResXYZ;
+
+        // Removing out of range cells
+        if(any(cellNIndex3D < (int3)(0)) || any(cellNIndex3D >= (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z)))
+          continue;
+
+        cellNIndex1D = (cellNIndex3D.x * GRID_RES_Y + cellNIndex3D.y) * GRID_RES_Z + cellNIndex3D.z;
+
+        startEndN = startEndCell[cellNIndex1D];
+
+        for (uint e = startEndN.x; e <= startEndN.y; ++e)
+        {
+          vec = (float4)(pos.xyz - predPos[e].xyz, 0.0f);
+
+          fluidDensity += poly6(vec, EFFECT_RADIUS);
+
+          // Supposed to be null if vec = 0.0f;
+          grad = gradSpiky(vec, EFFECT_RADIUS);
+          // Contribution from the ID particle
+          sumGradCi += grad;
+          // Contribution from its neighbors
+          sumSqGradC += dot(grad, grad);
+        }
+      }
+    }
+  }
+
+  sumSqGradC += dot(sumGradCi, sumGradCi);
+  sumSqGradC /= fluid.restDensity * fluid.restDensity;
+
+  const float densityC = fluidDensity / fluid.restDensity - 1.0f;
+
+  density[ID] = fluidDensity;
+  predPos[ID].w = - densityC / (sumSqGradC + fluid.relaxCFM);
 }
 
 /*
   Compute Constraint Correction
+  Constraint factor (Lambda) of each particle is read from w of its predicted position
 */
 __kernel void fld_computeConstraintCorrection(//Input
-                                              const __global float  *constFactor,  // 0
+                                              const __global float4 *predPos,      // 0
                                               const __global uint2  *startEndCell, // 1
-                                              const __global float4 *predPos,      // 2
                                               //Param
-                                              const     FluidParams fluid,         // 3
+                                              const     FluidParams fluid,         // 2
                                               //Output
-                                                    __global float4 *corrPos)      // 4
+                                                    __global float4 *corrPos)      // 3
 {
-  const float4 pos = predPos[ID];
-  const float lambdaI = constFactor[ID];
+  const float4 posLambda = predPos[ID];
+  const float4 pos = (float4)(posLambda.xyz, 0.0f);
+  const float lambdaI = posLambda.w;
+  float4 posLambdaN = (float4)(0.0f);
   const int3 cellIndex3D = convert_int3(getCell3DIndexFromPos(pos));
 
   float4 vec = (float4)(0.0f);
@@ -235,9 +345,10 @@ __kernel void fld_computeConstraintCorrection(//Input
 
         for (uint e = startEndN.x; e <= startEndN.y; ++e)
         {
-          vec = pos - predPos[e];
+          posLambdaN = predPos[e];
+          vec = (float4)(pos.xyz - posLambdaN.xyz, 0.0f);
 
-          corr += (lambdaI + constFactor[e] + artPressure(vec, fluid)) * gradSpiky(vec, EFFECT_RADIUS);
+          corr += (lambdaI + posLambdaN.w + artPressure(vec, fluid)) * gradSpiky(vec, EFFECT_RADIUS);
         }
       }
     }
@@ -248,13 +359,14 @@ __kernel void fld_computeConstraintCorrection(//Input
 
 /*
   Correction position using Constraint correction value
+  Constraint factor stored in w is cleared, other kernels relying on a null w
 */
 __kernel void fld_correctPosition(//Input
                                   const __global float4 *corrPos, // 0
                                   //Output
                                         __global float4 *predPos) // 1
 {
-  predPos[ID] += corrPos[ID];
+  predPos[ID] = (float4)(predPos[ID].xyz + corrPos[ID].xyz, 0.0f);
 }
 
 /*
@@ -330,10 +442,11 @@ __kernel void fld_applyVorticityConfinement(//Input
                                             const __global float4 *predPos,      // 0
                                             const __global uint2  *startEndCell, // 1
                                             const __global float4 *vort,         // 2
+                                            const __global float4 *velIn,        // 3
                                             //Param
-                                            const     FluidParams fluid,         // 3
+                                            const     FluidParams fluid,         // 4
                                             //Output
-                                                  __global float4 *vel)          // 4
+                                                  __global float4 *velOut)       // 5
 {
   const float4 pos = predPos[ID];
   const float4 vorticity = vort[ID];
@@ -345,7 +458,7 @@ __kernel void fld_applyVorticityConfinement(//Input
   uint cellNIndex1D = 0;
   int3 cellNIndex3D = (int3)(0);
   int3 gridResXYZ = (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z);
-  uint2 startEndN = (uint2)(0);
+  uint2 startEndN = (uint2)(0, 0);
 
   // 27 cells to visit, current one + 3D neighbors
   for (int iX = -1; iX <= 1; ++iX)
@@ -373,10 +486,9 @@ __kernel void fld_applyVorticityConfinement(//Input
   }
 
   // Adding vorticity confinement to attenue virtual damping
-  vel[ID] += fluid.vorticityConfCoeff * cross(normalize(n), vorticity) * fluid.timeStep;
+  velOut[ID] = velIn[ID] + fluid.vorticityConfCoeff * cross(normalize(n), vorticity) * fluid.timeStep;
 }
 
-
 /*
   Apply xsph viscosity correction
 */
@@ -429,6 +541,69 @@ __kernel void fld_applyXsphViscosityCorrection(//Input
   velOut[ID] = velocity + fluid.xsphViscosityCoeff * viscosity;
 }
 
+/*
+  Apply vorticity confinement and xsph viscosity correction in a single neighborhood traversal
+  Approximation of both kernels above, viscosity being computed on velocities before confinement instead of after
+*/
+__kernel void fld_applyVorticityConfinementAndXsphViscosity(//Input
+                                                            const __global float4 *predPos,      // 0
+                                                            const __global uint2  *startEndCell, // 1
+                                                            const __global float4 *vort,         // 2
+                                                            const __global float4 *velIn,        // 3
+                                                            //Param
+                                                            const     FluidParams fluid,         // 4
+                                                            //Output
+                                                                  __global float4 *velOut)       // 5
+{
+  const float4 pos = predPos[ID];
+  const float4 vorticity = vort[ID];
+  const float4 velocity = velIn[ID];
+  const int3 cellIndex3D = convert_int3(getCell3DIndexFromPos(pos));
+
+  float4 vec = (float4)(0.0f);
+  // vorticity confinement
+  float4 n = (float4)(0.0f);
+  float4 viscosity = (float4)(0.0f);
+
+  uint cellNIndex1D = 0;
+  int3 cellNIndex3D = (int3)(0);
+  int3 gridResXYZ = (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z);
+  uint2 startEndN = (uint2)(0);
+
+  // 27 cells to visit, current one + 3D neighbors
+  for (int iX = -1; iX <= 1; ++iX)
+  {
+    for (int iY = -1; iY <= 1; ++iY)
+    {
+      for (int iZ = -1; iZ <= 1; ++iZ)
+      {
+        cellNIndex3D = (cellIndex3D + (int3)(iX, iY, iZ) + gridResXYZ) % gridResXYZ;
+
+        // Removing out of range cells
+        if(any(cellNIndex3D < (int3)(0)) || any(cellNIndex3D >= (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z)))
+          continue;
+
+        cellNIndex1D = (cellNIndex3D.x * GRID_RES_Y + cellNIndex3D.y) * GRID_RES_Z + cellNIndex3D.z;
+
+        startEndN = startEndCell[cellNIndex1D];
+
+        for (uint e = startEndN.x; e <= startEndN.y; ++e)
+        {
+          vec = pos - predPos[e];
+
+          n += fast_length(vort[e]) * gradSpiky(vec, EFFECT_RADIUS);
+          viscosity += (velIn[e] - velocity) * poly6(vec, EFFECT_RADIUS);
+        }
+      }
+    }
+  }
+
+  // Adding vorticity confinement to attenue virtual damping
+  // and xsph viscosity for a more coherent motion
+  velOut[ID] = velocity + fluid.vorticityConfCoeff * cross(normalize(n), vorticity) * fluid.timeStep
+                        + fluid.xsphViscosityCoeff * viscosity;
+}
+
 /*
   Apply Bouncing wall boundary conditions on position
 */
@@ -450,30 +625,389 @@ __kernel void fld_updatePosition(//Input
 }
 
 /*
-  Fill fluid color buffer with constraint value for real-time analysis
-  Blue => constraint == 0, i.e density close from the rest density, system close from equilibrium
-  Light blue => constraint > 0, i.e density is smaller than rest density, system is not stabilized
-  Dark blue => constraint < 0, i.e density is bigger than rest density, system is not stabilized
+  Pack predicted positions relative to the cell they were sorted in, see unpackPos()
+  Cell is kept even if positions left it during Jacobi iterations, neighbors being searched in sorted cells
+  Out of range offsets saturate to 0 or USHRT_MAX, flagging positions to read unpacked
 */
-__kernel void fld_fillFluidColor(//Input
-                                 const  __global float  *density, // 0
-                                 //Param
-                                 const      FluidParams fluid,    // 1
-                                 //Output
-                                        __global float4 *col)     // 2
+__kernel void fld_packPosition(//Input
+                               const __global float4 *predPos,   // 0
+                               const __global uint   *cellID,    // 1
+                               //Output
+                                     __global ushort *packedPos) // 2
+{
+  const int3 cellIndex3D = convert_int3(getCell3DIndexFrom1DIndex(cellID[ID]));
+  const float3 offset = (predPos[ID].xyz - getCellOrigin(cellIndex3D)) / GRID_CELL_SIZE_XYZ;
+
+  vstore3(convert_ushort3_sat_rte((offset + 1.0f) * (65535.0f / PACKED_POS_RANGE)), ID, packedPos);
+}
+
+/*
+  Pack velocities on half floats
+*/
+__kernel void fld_packVelocity(//Input
+                               const __global float4 *vel,       // 0
+                               //Output
+                                     __global half   *packedVel) // 1
 {
-  float4 blue      = (float4)(0.0f, 0.1f, 1.0f, 0.5f);
-  float4 lightBlue = (float4)(0.7f, 0.7f, 1.0f, 0.5f);
-  float4 darkBlue  = (float4)(0.0f, 0.0f, 0.8f, 0.5f);
+  vstore_half3(vel[ID].xyz, ID, packedVel);
+}
 
-  float constraint = (1.0f - density[ID] / fluid.restDensity);
+/*
+  Compute fluid density and Constraint Factor (Lambda) from packed positions
+  Own position is decoded as well, so that its contribution to gradients stays null
+*/
+__kernel void fld_computeDensityAndConstraintFactorPacked(//Input
+                                                          const __global ushort *packedPos,     // 0
+                                                          const __global uint   *cellID,        // 1
+                                                          const __global float4 *predPos,       // 2
+                                                          const __global uint2  *startEndCell,  // 3
+                                                          //Param
+                                                          const     FluidParams fluid,          // 4
+                                                          //Output
+                                                                __global float  *density,       // 5
+                                                                __global float  *constFactor)   // 6
+{
+  const int3 cellIndex3D = convert_int3(getCell3DIndexFrom1DIndex(cellID[ID]));
+  const float4 pos = unpackPos(packedPos, predPos, ID, cellIndex3D);
 
-  float4 color = blue;
+  float fluidDensity = 0.0f;
 
-  if(constraint > 0.0f)
-    color += constraint * (lightBlue - blue) / 0.35f;
-  else if(constraint < 0.0f)
-    color += constraint * (blue - darkBlue) / 0.35f;
+  float4 vec = (float4)(0.0f);
+  float4 grad = (float4)(0.0f);
+  float4 sumGradCi = (float4)(0.0f);
+  float  sumSqGradC = 0.0f;
 
-  col[ID] = color;
-}
\ No newline at end of file
+  uint cellNIndex1D = 0;
+  int3 cellNIndex3D = (int3)(0);
+  int3 gridResXYZ = (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z);
+  uint2 startEndN = (uint2)(0);
+
+  // 27 cells to visit, current one + 3D neighbors
+  for (int iX = -1; iX <= 1; ++iX)
+  {
+    for (int iY = -1; iY <= 1; ++iY)
+    {
+      for (int iZ = -1; iZ <= 1; ++iZ)
+      {
+        cellNIndex3D = (cellIndex3D + (int3)(iX, iY, iZ) + gridResXYZ) % gridResXYZ;
+
+        // Removing out of range cells
+        if(any(cellNIndex3D < (int3)(0)) || any(cellNIndex3D >= (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z)))
+          continue;
+
+        cellNIndex1D = (cellNIndex3D.x * GRID_RES_Y + cellNIndex3D.y) * GRID_RES_Z + cellNIndex3D.z;
+
+        startEndN = startEndCell[cellNIndex1D];
+
+        for (uint e = startEndN.x; e <= startEndN.y; ++e)
+        {
+          vec = pos - unpackPos(packedPos, predPos, e, cellNIndex3D);
+
+          fluidDensity += poly6(vec, EFFECT_RADIUS);
+
+          // Supposed to be null if vec = 0.0f;
+          grad = gradSpiky(vec, EFFECT_RADIUS);
+          // Contribution from the ID particle
+          sumGradCi += grad;
+          // Contribution from its neighbors
+          sumSqGradC += dot(grad, grad);
+        }
+      }
+    }
+  }
+
+  sumSqGradC += dot(sumGradCi, sumGradCi);
+  sumSqGradC /= fluid.restDensity * fluid.restDensity;
+
+  const float densityC = fluidDensity / fluid.restDensity - 1.0f;
+
+  density[ID] = fluidDensity;
+  constFactor[ID] = - densityC / (sumSqGradC + fluid.relaxCFM);
+}
+
+/*
+  Compute Constraint Correction from packed positions
+*/
+__kernel void fld_computeConstraintCorrectionPacked(//Input
+                                                    const __global float  *constFactor,  // 0
+                                                    const __global uint2  *startEndCell, // 1
+                                                    const __global ushort *packedPos,    // 2
+                                                    const __global uint   *cellID,       // 3
+                                                    const __global float4 *predPos,      // 4
+                                                    //Param
+                                                    const     FluidParams fluid,         // 5
+                                                    //Output
+                                                          __global float4 *corrPos)      // 6
+{
+  const int3 cellIndex3D = convert_int3(getCell3DIndexFrom1DIndex(cellID[ID]));
+  const float4 pos = unpackPos(packedPos, predPos, ID, cellIndex3D);
+  const float lambdaI = constFactor[ID];
+
+  float4 vec = (float4)(0.0f);
+  float4 corr = (float4)(0.0f);
+
+  uint cellNIndex1D = 0;
+  int3 cellNIndex3D = (int3)(0);
+  int3 gridResXYZ = (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z);
+  uint2 startEndN = (uint2)(0, 0);
+
+  // 27 cells to visit, current one + 3D neighbors
+  for (int iX = -1; iX <= 1; ++iX)
+  {
+    for (int iY = -1; iY <= 1; ++iY)
+    {
+      for (int iZ = -1; iZ <= 1; ++iZ)
+      {
+        cellNIndex3D = (cellIndex3D + (int3)(iX, iY, iZ) + gridResXYZ) % gridResXYZ;
+
+        // Removing out of range cells
+        if(any(cellNIndex3D < (int3)(0)) || any(cellNIndex3D >= (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z)))
+          continue;
+
+        cellNIndex1D = (cellNIndex3D.x * GRID_RES_Y + cellNIndex3D.y) * GRID_RES_Z + cellNIndex3D.z;
+
+        startEndN = startEndCell[cellNIndex1D];
+
+        for (uint e = startEndN.x; e <= startEndN.y; ++e)
+        {
+          vec = pos - unpackPos(packedPos, predPos, e, cellNIndex3D);
+
+          corr += (lambdaI + constFactor[e] + artPressure(vec, fluid)) * gradSpiky(vec, EFFECT_RADIUS);
+        }
+      }
+    }
+  }
+
+  corrPos[ID] = corr / fluid.restDensity;
+}
+
+/*
+  Compute vorticity from packed positions and velocities, stored packed as well
+*/
+__kernel void fld_computeVorticityPacked(//Input
+                                         const __global ushort *packedPos,    // 0
+                                         const __global uint   *cellID,       // 1
+                                         const __global float4 *predPos,      // 2
+                                         const __global uint2  *startEndCell, // 3
+                                         const __global half   *packedVel,    // 4
+                                         //Param
+                                         const     FluidParams fluid,         // 5
+                                         //Output
+                                               __global half   *packedVort)   // 6
+{
+  const int3 cellIndex3D = convert_int3(getCell3DIndexFrom1DIndex(cellID[ID]));
+  const float4 pos = unpackPos(packedPos, predPos, ID, cellIndex3D);
+  const float4 velocity = unpackHalf(packedVel, ID);
+
+  float4 vort = (float4)(0.0f);
+
+  uint cellNIndex1D = 0;
+  int3 cellNIndex3D = (int3)(0);
+  int3 gridResXYZ = (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z);
+  uint2 startEndN = (uint2)(0, 0);
+
+  // 27 cells to visit, current one + 3D neighbors
+  for (int iX = -1; iX <= 1; ++iX)
+  {
+    for (int iY = -1; iY <= 1; ++iY)
+    {
+      for (int iZ = -1; iZ <= 1; ++iZ)
+      {
+        cellNIndex3D = (cellIndex3D + (int3)(iX, iY, iZ) + gridResXYZ) % gridResXYZ;
+
+        // Removing out of range cells
+        if(any(cellNIndex3D < (int3)(0)) || any(cellNIndex3D >= (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z)))
+          continue;
+
+        cellNIndex1D = (cellNIndex3D.x * GRID_RES_Y + cellNIndex3D.y) * GRID_RES_Z + cellNIndex3D.z;
+
+        startEndN = startEndCell[cellNIndex1D];
+
+        for (uint e = startEndN.x; e <= startEndN.y; ++e)
+        {
+          vort += cross((unpackHalf(packedVel, e) - velocity), gradSpiky(pos - unpackPos(packedPos, predPos, e, cellNIndex3D), EFFECT_RADIUS));
+        }
+      }
+    }
+  }
+
+  vstore_half3(vort.xyz, ID, packedVort);
+}
+
+/*
+  Apply vorticity confinement from packed positions and vorticity
+*/
+__kernel void fld_applyVorticityConfinementPacked(//Input
+                                                  const __global ushort *packedPos,    // 0
+                                                  const __global uint   *cellID,       // 1
+                                                  const __global float4 *predPos,      // 2
+                                                  const __global uint2  *startEndCell, // 3
+                                                  const __global half   *packedVort,   // 4
+                                                  const __global float4 *velIn,        // 5
+                                                  //Param
+                                                  const     FluidParams fluid,         // 6
+                                                  //Output
+                                                        __global float4 *velOut)       // 7
+{
+  const int3 cellIndex3D = convert_int3(getCell3DIndexFrom1DIndex(cellID[ID]));
+  const float4 pos = unpackPos(packedPos, predPos, ID, cellIndex3D);
+  const float4 vorticity = unpackHalf(packedVort, ID);
+
+  // vorticity confinement
+  float4 n = (float4)(0.0f);
+
+  uint cellNIndex1D = 0;
+  int3 cellNIndex3D = (int3)(0);
+  int3 gridResXYZ = (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z);
+  uint2 startEndN = (uint2)(0, 0);
+
+  // 27 cells to visit, current one + 3D neighbors
+  for (int iX = -1; iX <= 1; ++iX)
+  {
+    for (int iY = -1; iY <= 1; ++iY)
+    {
+      for (int iZ = -1; iZ <= 1; ++iZ)
+      {
+        cellNIndex3D = (cellIndex3D + (int3)(iX, iY, iZ) + gridResXYZ) % gridResXYZ;
+
+        // Removing out of range cells
+        if(any(cellNIndex3D < (int3)(0)) || any(cellNIndex3D >= (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z)))
+          continue;
+
+        cellNIndex1D = (cellNIndex3D.x * GRID_RES_Y + cellNIndex3D.y) * GRID_RES_Z + cellNIndex3D.z;
+
+        startEndN = startEndCell[cellNIndex1D];
+
+        for (uint e = startEndN.x; e <= startEndN.y; ++e)
+        {
+          n += fast_length(unpackHalf(packedVort, e)) * gradSpiky(pos - unpackPos(packedPos, predPos, e, cellNIndex3D), EFFECT_RADIUS);
+        }
+      }
+    }
+  }
+
+  // Adding vorticity confinement to attenue virtual damping
+  velOut[ID] = velIn[ID] + fluid.vorticityConfCoeff * cross(normalize(n), vorticity) * fluid.timeStep;
+}
+
+/*
+  Apply xsph viscosity correction from packed positions and velocities
+  Packed velocities only used for differences with neighbors, base velocity being kept in full precision
+*/
+__kernel void fld_applyXsphViscosityCorrectionPacked(//Input
+                                                     const __global ushort *packedPos,    // 0
+                                                     const __global uint   *cellID,       // 1
+                                                     const __global float4 *predPos,      // 2
+                                                     const __global uint2  *startEndCell, // 3
+                                                     const __global half   *packedVel,    // 4
+                                                     const __global float4 *velIn,        // 5
+                                                     //Param
+                                                     const     FluidParams fluid,         // 6
+                                                     //Output
+                                                           __global float4 *velOut)       // 7
+{
+  const int3 cellIndex3D = convert_int3(getCell3DIndexFrom1DIndex(cellID[ID]));
+  const float4 pos = unpackPos(packedPos, predPos, ID, cellIndex3D);
+  const float4 packedVelocity = unpackHalf(packedVel, ID);
+
+  float4 viscosity = (float4)(0.0f);
+
+  uint cellNIndex1D = 0;
+  int3 cellNIndex3D = (int3)(0);
+  int3 gridResXYZ = (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z);
+  uint2 startEndN = (uint2)(0, 0);
+
+  // 27 cells to visit, current one + 3D neighbors
+  for (int iX = -1; iX <= 1; ++iX)
+  {
+    for (int iY = -1; iY <= 1; ++iY)
+    {
+      for (int iZ = -1; iZ <= 1; ++iZ)
+      {
+        cellNIndex3D = (cellIndex3D + (int3)(iX, iY, iZ) + gridResXYZ) % gridResXYZ;
+
+        // Removing out of range cells
+        if(any(cellNIndex3D < (int3)(0)) || any(cellNIndex3D >= (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z)))
+          continue;
+
+        cellNIndex1D = (cellNIndex3D.x * GRID_RES_Y + cellNIndex3D.y) * GRID_RES_Z + cellNIndex3D.z;
+
+        startEndN = startEndCell[cellNIndex1D];
+
+        for (uint e = startEndN.x; e <= startEndN.y; ++e)
+        {
+          viscosity += (unpackHalf(packedVel, e) - packedVelocity) * poly6(pos - unpackPos(packedPos, predPos, e, cellNIndex3D), EFFECT_RADIUS);
+        }
+      }
+    }
+  }
+
+  // Adding xsph viscosity for a more coherent motion
+  velOut[ID] = velIn[ID] + fluid.xsphViscosityCoeff * viscosity;
+}
+
+/*
+  Apply vorticity confinement and xsph viscosity correction from packed positions, velocities and vorticity
+  Approximation of both kernels above, viscosity being computed on velocities before confinement instead of after
+*/
+__kernel void fld_applyVorticityConfinementAndXsphViscosityPacked(//Input
+                                                                  const __global ushort *packedPos,    // 0
+                                                                  const __global uint   *cellID,       // 1
+                                                                  const __global float4 *predPos,      // 2
+                                                                  const __global uint2  *startEndCell, // 3
+                                                                  const __global half   *packedVort,   // 4
+                                                                  const __global half   *packedVel,    // 5
+                                                                  const __global float4 *velIn,        // 6
+                                                                  //Param
+                                                                  const     FluidParams fluid,         // 7
+                                                                  //Output
+                                                                        __global float4 *velOut)       // 8
+{
+  const int3 cellIndex3D = convert_int3(getCell3DIndexFrom1DIndex(cellID[ID]));
+  const float4 pos = unpackPos(packedPos, predPos, ID, cellIndex3D);
+  const float4 vorticity = unpackHalf(packedVort, ID);
+  const float4 packedVelocity = unpackHalf(packedVel, ID);
+
+  float4 vec = (float4)(0.0f);
+  // vorticity confinement
+  float4 n = (float4)(0.0f);
+  float4 viscosity = (float4)(0.0f);
+
+  uint cellNIndex1D = 0;
+  int3 cellNIndex3D = (int3)(0);
+  int3 gridResXYZ = (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z);
+  uint2 startEndN = (uint2)(0);
+
+  // 27 cells to visit, current one + 3D neighbors
+  for (int iX = -1; iX <= 1; ++iX)
+  {
+    for (int iY = -1; iY <= 1; ++iY)
+    {
+      for (int iZ = -1; iZ <= 1; ++iZ)
+      {
+        cellNIndex3D = (cellIndex3D + (int3)(iX, iY, iZ) + gridResXYZ) % gridResXYZ;
+
+        // Removing out of range cells
+        if(any(cellNIndex3D < (int3)(0)) || any(cellNIndex3D >= (int3)(GRID_RES_X, GRID_RES_Y, GRID_RES_Z)))
+          continue;
+
+        cellNIndex1D = (cellNIndex3D.x * GRID_RES_Y + cellNIndex3D.y) * GRID_RES_Z + cellNIndex3D.z;
+
+        startEndN = startEndCell[cellNIndex1D];
+
+        for (uint e = startEndN.x; e <= startEndN.y; ++e)
+        {
+          vec = pos - unpackPos(packedPos, predPos, e, cellNIndex3D);
+
+          n += fast_length(unpackHalf(packedVort, e)) * gradSpiky(vec, EFFECT_RADIUS);
+          viscosity += (unpackHalf(packedVel, e) - packedVelocity) * poly6(vec, EFFECT_RADIUS);
+        }
+      }
+    }
+  }
+
+  // Adding vorticity confinement to attenue virtual damping
+  // and xsph viscosity for a more coherent motion
+  velOut[ID] = velIn[ID] + fluid.vorticityConfCoeff * cross(normalize(n), vorticity) * fluid.timeStep
+                         + fluid.xsphViscosityCoeff * viscosity;
+}
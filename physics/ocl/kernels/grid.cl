@@ -38,25 +38,33 @@ inline uint getCell1DIndexFromPos(float4 pos)
 }
 
 /*
-  Reset grid detector buffer. For rendering purpose only.
+  Compute 3D index of the cell from its 1D index
 */
-__kernel void resetGridDetector(__global float8* gridDetector)
+inline uint3 getCell3DIndexFrom1DIndex(uint cell1DIndex)
 {
-  gridDetector[ID] = (float8)(0.0f);
+  return (uint3)(cell1DIndex / (GRID_RES_Y * GRID_RES_Z), (cell1DIndex / GRID_RES_Z) % GRID_RES_Y, cell1DIndex % GRID_RES_Z);
 }
 
 /*
-  Fill grid detector buffer. For rendering purpose only.
+  Reset grid detector buffer, one byte per cell. For rendering purpose only.
+*/
+__kernel void resetGridDetector(__global uchar *gridDetector)
+{
+  gridDetector[ID] = 0;
+}
+
+/*
+  Fill grid detector buffer, flagging cells occupied by at least one particle. For rendering purpose only.
 */
 __kernel void fillGridDetector(__global float4 *pPos,
-                               __global float8 *gridDetector)
+                               __global uchar  *gridDetector)
 {
   const float4 pos = pPos[ID];
 
   const uint gridDetectorIndex = getCell1DIndexFromPos(pos);
 
   if (gridDetectorIndex < GRID_NUM_CELLS)
-    gridDetector[gridDetectorIndex] = 1.0f;
+    gridDetector[gridDetectorIndex] = 1;
 }
 
 /*
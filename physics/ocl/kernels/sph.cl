@@ -2,6 +2,44 @@
 // Most defines are in define.cl
 // define.cl must be included as first file.cl to create OpenCL program
 
+// SPH_LUT - if defined, kernels are read from radial lookup tables instead of being evaluated analytically
+// Tables are generated at build time from EFFECT_RADIUS, POLY6_COEFF and SPIKY_COEFF, effectRadius arguments must be EFFECT_RADIUS then
+
+#ifdef SPH_LUT
+
+#define SPH_LUT_SIZE 256
+
+// Expanding a table entry macro F over SPH_LUT_SIZE consecutive indices
+#define LUT_4(F, i)   F(i), F(i + 1), F(i + 2), F(i + 3)
+#define LUT_16(F, i)  LUT_4(F, i), LUT_4(F, i + 4), LUT_4(F, i + 8), LUT_4(F, i + 12)
+#define LUT_64(F, i)  LUT_16(F, i), LUT_16(F, i + 16), LUT_16(F, i + 32), LUT_16(F, i + 48)
+#define LUT_256(F, i) LUT_64(F, i), LUT_64(F, i + 64), LUT_64(F, i + 128), LUT_64(F, i + 192)
+
+// Poly6 indexed by squared distance over squared effect radius
+#define POLY6_LUT_BASE(i)  (EFFECT_RADIUS * EFFECT_RADIUS * (1.0f - (float)(i) / SPH_LUT_SIZE))
+#define POLY6_LUT_ENTRY(i) (POLY6_COEFF * POLY6_LUT_BASE(i) * POLY6_LUT_BASE(i) * POLY6_LUT_BASE(i))
+
+// Spiky gradient magnitude indexed by distance over effect radius, distance being needed anyway to normalize the gradient
+#define SPIKY_LUT_BASE(i)  (EFFECT_RADIUS * (1.0f - (float)(i) / SPH_LUT_SIZE))
+#define SPIKY_LUT_ENTRY(i) (-3.0f * SPIKY_COEFF * SPIKY_LUT_BASE(i) * SPIKY_LUT_BASE(i))
+
+// Last entry is null, values beyond effect radius being clamped onto it
+__constant float POLY6_LUT[SPH_LUT_SIZE + 1] = { LUT_256(POLY6_LUT_ENTRY, 0), POLY6_LUT_ENTRY(SPH_LUT_SIZE) };
+__constant float SPIKY_LUT[SPH_LUT_SIZE + 1] = { LUT_256(SPIKY_LUT_ENTRY, 0), SPIKY_LUT_ENTRY(SPH_LUT_SIZE) };
+
+/*
+  Linear interpolation within a table covering [0, 1]
+*/
+inline float sampleLut(__constant float *lut, const float x)
+{
+  const float pos = clamp(x, 0.0f, 1.0f) * SPH_LUT_SIZE;
+  const int index = min((int)pos, SPH_LUT_SIZE - 1);
+
+  return mix(lut[index], lut[index + 1], pos - index);
+}
+
+#endif
+
 /*
   Poly6 kernel introduced in
   Muller et al. 2003. "Particle-based fluid simulation for interactive applications"
@@ -9,13 +47,22 @@
 */
 inline float poly6(const float4 vec, const float effectRadius)
 {
-  float vecLength = fast_length(vec);
-  return (1.0f - step(effectRadius, vecLength)) * POLY6_COEFF * pow((effectRadius * effectRadius - vecLength * vecLength), 3);
+#ifdef SPH_LUT
+  return sampleLut(POLY6_LUT, dot(vec, vec) / (effectRadius * effectRadius));
+#else
+  const float diff = max(effectRadius * effectRadius - dot(vec, vec), 0.0f);
+  return POLY6_COEFF * diff * diff * diff;
+#endif
 }
 
 inline float poly6L(const float vecLength, const float effectRadius)
 {
-  return (1.0f - step(effectRadius, vecLength)) * POLY6_COEFF * pow((effectRadius * effectRadius - vecLength * vecLength), 3);
+#ifdef SPH_LUT
+  return sampleLut(POLY6_LUT, vecLength * vecLength / (effectRadius * effectRadius));
+#else
+  const float diff = max(effectRadius * effectRadius - vecLength * vecLength, 0.0f);
+  return POLY6_COEFF * diff * diff * diff;
+#endif
 }
 
 /*
@@ -25,10 +72,18 @@ inline float poly6L(const float vecLength, const float effectRadius)
 */
 inline float4 gradSpiky(const float4 vec, const float effectRadius)
 {
-  const float vecLength = fast_length(vec);
+  const float sqVecLength = dot(vec, vec);
 
-  if(vecLength <= FLOAT_EPS)
+  if(sqVecLength <= FLOAT_EPS * FLOAT_EPS)
     return (float4)(0.0f);
 
-  return vec * (1.0f - step(effectRadius, vecLength)) * SPIKY_COEFF * -3 * pow((effectRadius - vecLength), 2) / vecLength;
+  const float invVecLength = rsqrt(sqVecLength);
+  const float vecLength = sqVecLength * invVecLength;
+
+#ifdef SPH_LUT
+  return vec * sampleLut(SPIKY_LUT, vecLength / effectRadius) * invVecLength;
+#else
+  const float diff = max(effectRadius - vecLength, 0.0f);
+  return vec * (SPIKY_COEFF * -3.0f * diff * diff * invVecLength);
+#endif
 }
@@ -41,38 +41,203 @@ __kernel void resetCameraDist(__global uint *cameraDist)
   Fill camera distance buffer
 */
 __kernel void fillCameraDist(//Input
-                             const __global float4 *pos,          // 0
-                             const __global float3 *cameraPos,    // 1
+                             const __global float4 *pos,              // 0
+                             const __global float4 *frameState,       // 1
                              //Output
-                                   __global uint   *cameraDist)   // 2
+                                   __global uint   *cameraDist)       // 2
 {
+  const float4 cameraPos = frameState[FRAME_STATE_CAMERA_POS];
+
   // Hack to be able to sort the cameraDist buffer using radix sort with closest particles coming last to be drawn on top using blending
   // We multiply squared length by 100 to have more precision before switching to uint
-  cameraDist[ID] = (uint)(max(FAR_DIST - length(pos[ID].xyz - cameraPos[0].xyz) * 100.0f, 0.0f));
+  cameraDist[ID] = (uint)(max(FAR_DIST - length(pos[ID].xyz - cameraPos.xyz) * 100.0f, 0.0f));
 }
 
 /*
-  Fill position buffer with inf positions
+  Reset max squared velocity of the particles
 */
-__kernel void infPosVerts(__global float4 *pos)
+__kernel void resetMaxSqVel(__global uint *maxSqVel)
 {
-  pos[ID] = (float4)(FAR_DIST, FAR_DIST, FAR_DIST, 0.0f);
+  maxSqVel[0] = 0;
+}
+
+/*
+  Max squared velocity of the particles, for adaptive time stepping
+  Positive floats being ordered like their bits as uint, atomic max on uint is used
+*/
+__kernel void computeMaxSqVel(//Input
+                              const __global float4 *vel,      // 0
+                              //Output
+                                    __global uint   *maxSqVel) // 1
+{
+  __local uint localMaxSqVel;
+
+  const float4 v = vel[ID];
+
+  // Aggregating at work-group level first to limit atomic operations on global max
+  if (get_local_id(0) == 0)
+    localMaxSqVel = 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  atomic_max(&localMaxSqVel, as_uint(dot(v.xyz, v.xyz)));
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (get_local_id(0) == 0)
+    atomic_max(maxSqVel, localMaxSqVel);
 }
 
 /*
-  Fill color buffer with physical buffer for display and analysis
+  Particle published at this place of the render slot, following camera sort permutation if particles are sorted
 */
-__kernel void fillColorFloat(//Input
-                             const  __global float  *physicalQuantity, // 0
-                            //Param
-                             const           float minVal, // 1
-                             const           float maxVal, // 2
-                            //Output
-                                    __global float4 *col)  // 3
+inline uint renderOrderID(const __global uint *order, const uint isSorted)
 {
-  float val = (physicalQuantity[ID] - minVal) / (maxVal - minVal);
-  val *= step(0.0f, val);
-  val *= step(val, 1.0f);
-  //col[ID] = (float4)(val, 0.0f, 0.3f, 1.0f);
-  col[ID] = (float4)(val, val, val, val);
+  return isSorted ? order[ID] : ID;
+}
+
+/*
+  Frustum culling test of a particle, camera projection-view matrix being stored row by row,
+  same row-vector convention than on OpenGL side
+*/
+inline bool isInCameraFrustum(const float4 p, const __global float4 *projView)
+{
+  const float4 clipPos = p.x * projView[0] + p.y * projView[1] + p.z * projView[2] + projView[3];
+
+  // Small margin to keep point sprites partially out of screen
+  // Unused particles, at far or infinite positions, are culled as well
+  const float limit = clipPos.w * FRUSTUM_MARGIN;
+  return (clipPos.w > 0.0f) && (fabs(clipPos.x) <= limit) && (fabs(clipPos.y) <= limit) && (fabs(clipPos.z) <= limit);
+}
+
+/*
+  Frustum culling, first pass counting particles visible by the camera in each work-group
+  Work-groups must be of CULLING_GROUP_SIZE, work-items beyond the number of particles counting as culled
+*/
+__kernel void countVisibleParts(//Input
+                                const __global float4 *pos,              // 0
+                                const __global uint   *order,            // 1
+                                const          uint    isSorted,         // 2
+                                const __global float4 *frameState,       // 3
+                                const          uint    nbParts,          // 4
+                                //Output
+                                      __global uint   *groupNbVisible)   // 5
+{
+  __local uint localNbVisibleParts;
+
+  const bool isVisible = (ID < nbParts) && isInCameraFrustum(pos[renderOrderID(order, isSorted)], frameState + FRAME_STATE_PROJ_VIEW);
+
+  if (get_local_id(0) == 0)
+    localNbVisibleParts = 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (isVisible)
+    atomic_inc(&localNbVisibleParts);
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (get_local_id(0) == 0)
+    groupNbVisible[get_group_id(0)] = localNbVisibleParts;
+}
+
+/*
+  Frustum culling, second pass turning visible counts of work-groups into their offsets in the index buffer
+  Run by a single work-item, a few hundreds of work-groups at most
+*/
+__kernel void scanVisibleParts(//Input
+                               const          uint  nbGroups,        // 0
+                               //Input/Output
+                                     __global uint *groupNbVisible,  // 1
+                               //Output
+                                     __global uint *nbVisibleParts)  // 2
+{
+  uint offset = 0;
+  for (uint group = 0; group < nbGroups; ++group)
+  {
+    const uint nbVisible = groupNbVisible[group];
+    groupNbVisible[group] = offset;
+    offset += nbVisible;
+  }
+
+  nbVisibleParts[0] = offset;
+}
+
+/*
+  Frustum culling, last pass compacting indices of visible particles in the index buffer used for drawing
+  Render slot order is kept, as sorted along camera axis for blending, thanks to a prefix sum within each work-group
+*/
+__kernel void compactVisibleParts(//Input
+                                  const __global float4 *pos,              // 0
+                                  const __global uint   *order,            // 1
+                                  const          uint    isSorted,         // 2
+                                  const __global float4 *frameState,       // 3
+                                  const          uint    nbParts,          // 4
+                                  const __global uint   *groupOffsets,     // 5
+                                  //Output
+                                        __global uint   *visibleIndices)   // 6
+{
+  __local uint localScan[2][CULLING_GROUP_SIZE];
+
+  const uint localID = get_local_id(0);
+  const bool isVisible = (ID < nbParts) && isInCameraFrustum(pos[renderOrderID(order, isSorted)], frameState + FRAME_STATE_PROJ_VIEW);
+
+  // Inclusive Hillis-Steele scan of visibility flags, ping-ponging between both local arrays
+  uint in = 0;
+  localScan[in][localID] = isVisible ? 1 : 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint stride = 1; stride < CULLING_GROUP_SIZE; stride *= 2)
+  {
+    const uint sum = localScan[in][localID] + ((localID >= stride) ? localScan[in][localID - stride] : 0);
+    localScan[1 - in][localID] = sum;
+    in = 1 - in;
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (isVisible)
+    visibleIndices[groupOffsets[get_group_id(0)] + localScan[in][localID] - 1] = ID;
+}
+
+/*
+  Publishing particles into the render slot drawn by OpenGL, written in camera order if sorted
+  Quantized positions on 3x16 bits replace float ones, normalized within the box, outside ones being clamped onto the walls
+  Previous positions only published for interpolation, not supported by quantized positions
+*/
+__kernel void fillRenderSlot(//Input
+                             const __global uint    *order,            // 0
+                             const          uint     isSorted,         // 1
+                             const __global float4  *pos,              // 2
+                             const __global float4  *prevPos,          // 3
+                             const __global float   *col,              // 4
+                             const          uint     isPosQuantized,   // 5
+                             const          uint     isInterpolated,   // 6
+                             //Output
+                                   __global float4  *slotPos,          // 7
+                                   __global float4  *slotPrevPos,      // 8
+                                   __global float   *slotCol,          // 9
+                                   __global ushort4 *slotQuantizedPos) // 10
+{
+  const uint partID = renderOrderID(order, isSorted);
+
+  slotCol[ID] = col[partID];
+
+  if (isPosQuantized)
+  {
+    const float3 absWall = (float3)(ABS_WALL_X, ABS_WALL_Y, ABS_WALL_Z);
+    const float3 normPos = clamp((pos[partID].xyz + absWall) / (2.0f * absWall), 0.0f, 1.0f);
+
+    slotQuantizedPos[ID] = (ushort4)(convert_ushort3_sat_rte(normPos * 65535.0f), 0);
+  }
+  else
+  {
+    slotPos[ID] = pos[partID];
+
+    if (isInterpolated)
+      slotPrevPos[ID] = prevPos[partID];
+  }
+}
+
+/*
+  Fill position buffer with inf positions
+*/
+__kernel void infPosVerts(__global float4 *pos)
+{
+  pos[ID] = (float4)(FAR_DIST, FAR_DIST, FAR_DIST, 0.0f);
 }
\ No newline at end of file
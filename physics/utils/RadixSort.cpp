@@ -20,13 +20,18 @@ using namespace Physics;
 #define KERNEL_PERMUTATE_FLOAT4 "permutateFloat4"
 #define KERNEL_PERMUTATE_FLOAT "permutateFloat"
 
+constexpr unsigned int NUM_RADIX = 256;
+constexpr unsigned int NUM_RADIX_BITS = 8;
+constexpr unsigned int NUM_GROUPS = 128;
+constexpr unsigned int NUM_ITEMS = 4;
+
 RadixSort::RadixSort(size_t numEntities)
     : m_numEntities(numEntities)
-    , m_numRadix(256)
-    , m_numRadixBits(8)
+    , m_numRadix(NUM_RADIX)
+    , m_numRadixBits(NUM_RADIX_BITS)
     , m_numTotalBits(32)
-    , m_numGroups(128)
-    , m_numItems(4)
+    , m_numGroups(NUM_GROUPS)
+    , m_numItems(NUM_ITEMS)
     , m_histoSplit(256)
 {
   m_numRadixPasses = m_numTotalBits / m_numRadixBits;
@@ -55,21 +60,26 @@ RadixSort::RadixSort(size_t numEntities)
   LOG_INFO("Radix sort correctly initialized");
 }
 
-bool RadixSort::createProgram() const
+CL::programSpecs RadixSort::ProgramSpecs()
 {
-  CL::Context& clContext = CL::Context::Get();
-
   std::ostringstream clBuildOptions;
-  clBuildOptions << " -D_RADIX=" << m_numRadix;
-  clBuildOptions << " -D_BITS=" << m_numRadixBits;
-  clBuildOptions << " -D_GROUPS=" << m_numGroups;
-  clBuildOptions << " -D_ITEMS=" << m_numItems;
+  clBuildOptions << " -D_RADIX=" << NUM_RADIX;
+  clBuildOptions << " -D_BITS=" << NUM_RADIX_BITS;
+  clBuildOptions << " -D_GROUPS=" << NUM_GROUPS;
+  clBuildOptions << " -D_ITEMS=" << NUM_ITEMS;
   if (sizeof(void*) < 8)
   {
     clBuildOptions << " -DHOST_PTR_IS_32bit";
   }
 
-  if (!clContext.createProgram(PROGRAM_RADIXSORT, "radixSort.cl", clBuildOptions.str()))
+  return { PROGRAM_RADIXSORT, { "radixSort.cl" }, clBuildOptions.str() };
+}
+
+bool RadixSort::createProgram() const
+{
+  CL::Context& clContext = CL::Context::Get();
+
+  if (!clContext.createProgram(ProgramSpecs()))
     return false;
 
   return true;
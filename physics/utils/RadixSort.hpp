@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../ocl/Context.hpp"
+
 #include <array>
 #include <vector>
 
@@ -43,6 +45,12 @@ class RadixSort
       const std::vector<std::string>& optionalInputBufferNamesFloat4 = {},
       const std::vector<std::string>& optionalInputBufferNamesFloat = {});
 
+  // Permutation left by the last sort, new index to old one, e.g. to read unsorted buffers in sorted order
+  static std::string PermutationBufferName() { return "RadixSortIndices"; }
+
+  // Same for all entity counts, to be built before any sort is created
+  static CL::programSpecs ProgramSpecs();
+
   private:
   bool createProgram() const;
   bool createBuffers() const;
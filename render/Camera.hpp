@@ -30,6 +30,8 @@ class Camera
   inline const Math::float3 focusPos() const { return m_focusPos; }
 
   inline Math::float4x4 getProjViewMat() const { return m_projViewMat; }
+  inline Math::float4x4 getProjMat() const { return m_projMat; }
+  inline Math::float4x4 getViewMat() const { return m_viewMat; }
 
   private:
   void updateProjMat();
@@ -3,17 +3,39 @@
 #include "Logging.hpp"
 #include "Math.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace Render;
 
 Engine::Engine(EngineParams params)
     : m_maxNbParticles(params.maxNbParticles)
     , m_nbParticles(params.currNbParticles)
+    , m_nbVisibleParticles(params.currNbParticles)
     , m_boxSize(params.boxSize)
     , m_gridRes(params.gridRes)
     , m_pointSize(params.pointSize)
     , m_isBoxVisible(true)
     , m_isGridVisible(false)
+    , m_isFrustumCullingEnabled(true)
+    , m_isPosQuantizationEnabled(false)
+    , m_isQuantizedPosPublished(false)
+    , m_isVolumeRenderingSupported(params.isVolumeRenderingSupported)
+    , m_isVolumeRenderingEnabled(false)
+    , m_isFluidSurfaceSupported(params.isFluidSurfaceSupported)
+    , m_isFluidSurfaceEnabled(false)
+    , m_fluidColor(0.1f, 0.4f, 0.9f)
+    , m_fluidBlurScale(0.2f)
+    , m_isInterpolationEnabled(false)
+    , m_interpolationFactor(1.0f)
+    , m_fluidSurfaceSize(0, 0)
     , m_targetPos({ 0.0f, 0.0f, 0.0f })
+    , m_colormap(params.colormap)
+    , m_colorRange(0.0f, 1.0f)
+    , m_timedFrameIndex(0)
+    , m_drawnRenderSlot(0)
+    , m_frameStateSlot(0)
+    , m_frameStateStride(0)
     , m_dimension(params.dimension)
 {
   glEnable(GL_DEPTH_TEST);
@@ -32,80 +54,363 @@ Engine::Engine(EngineParams params)
 
   initPointCloud();
 
+  initColormap();
+
   initBox();
 
   initGrid();
 
   initTarget();
+
+  initVolume();
+
+  initFluidSurface();
+
+  initTimerQueries();
 }
 
 Engine::~Engine()
 {
-  glDeleteBuffers(1, &m_pointCloudCoordVBO);
-  glDeleteBuffers(1, &m_pointCloudColorVBO);
+  for (auto& frameQueries : m_timerQueries)
+    glDeleteQueries(NB_RENDER_PASSES, frameQueries.data());
+
+  for (auto& renderSlot : m_renderSlots)
+  {
+    glDeleteBuffers(1, &renderSlot.coordVBO);
+    glDeleteBuffers(1, &renderSlot.prevCoordVBO);
+    glDeleteBuffers(1, &renderSlot.quantizedCoordVBO);
+    glDeleteBuffers(1, &renderSlot.colorVBO);
+    glDeleteBuffers(1, &renderSlot.indexEBO);
+    glDeleteBuffers(1, &renderSlot.gridDetectorVBO);
+    glDeleteBuffers(1, &renderSlot.densityVolumePBO);
+    if (renderSlot.fence)
+      glDeleteSync(renderSlot.fence);
+  }
   glDeleteBuffers(1, &m_box2DVBO);
   glDeleteBuffers(1, &m_box3DVBO);
-  glDeleteBuffers(1, &m_cameraVBO);
+  glDeleteBuffers(1, &m_gridPosVBO);
+  glDeleteBuffers(1, &m_gridEBO);
+  glDeleteBuffers(1, &m_frameStateUBO);
+  glDeleteTextures(1, &m_densityVolumeTexture);
+  glDeleteFramebuffers(1, &m_fluidDepthFBO);
+  glDeleteFramebuffers(1, &m_fluidBlurFBO);
+  glDeleteFramebuffers(1, &m_fluidThicknessFBO);
+  glDeleteTextures(1, &m_fluidDepthTexture);
+  glDeleteTextures(1, &m_fluidBlurTexture);
+  glDeleteTextures(1, &m_fluidThicknessTexture);
+  glDeleteRenderbuffers(1, &m_fluidDepthRBO);
   glDeleteBuffers(1, &m_targetVBO);
+  glDeleteTextures(1, &m_colormapTexture);
 }
 
 void Engine::buildShaders()
 {
   m_pointCloudShader = std::make_unique<Shader>(Render::PointCloudVertShader, Render::PointCloudFragShader);
+  m_pointCloudQuantizedShader = std::make_unique<Shader>(Render::PointCloudQuantizedVertShader, Render::PointCloudFragShader);
   m_box2DShader = std::make_unique<Shader>(Render::Box2DVertShader, Render::FragShader);
   m_box3DShader = std::make_unique<Shader>(Render::Box3DVertShader, Render::FragShader);
   m_gridShader = std::make_unique<Shader>(Render::GridVertShader, Render::FragShader);
   m_targetShader = std::make_unique<Shader>(Render::TargetVertShader, Render::FragShader);
+  m_volumeShader = std::make_unique<Shader>(Render::FullscreenVertShader, Render::VolumeFragShader);
+  m_fluidDepthShader = std::make_unique<Shader>(Render::FluidSpriteVertShader, Render::FluidDepthFragShader);
+  m_fluidThicknessShader = std::make_unique<Shader>(Render::FluidSpriteVertShader, Render::FluidThicknessFragShader);
+  m_fluidBlurShader = std::make_unique<Shader>(Render::FullscreenVertShader, Render::FluidBlurFragShader);
+  m_fluidShadingShader = std::make_unique<Shader>(Render::FullscreenVertShader, Render::FluidShadingFragShader);
+
+  for (const auto* shader : { m_pointCloudShader.get(), m_pointCloudQuantizedShader.get(), m_box2DShader.get(), m_box3DShader.get(), m_gridShader.get(), m_targetShader.get(),
+           m_fluidDepthShader.get(), m_fluidThicknessShader.get() })
+    shader->bindUniformBlock("FrameState", FRAME_STATE_BINDING);
 }
 
 void Engine::initCamera(float sceneAspectRatio)
 {
   m_camera = std::make_unique<Camera>(sceneAspectRatio);
 
-  // Filled at each frame, for OpenCL use
-  glGenBuffers(1, &m_cameraVBO);
-  loadCameraPos();
+  // Slots bound through glBindBufferRange must respect the UBO offset alignment
+  GLint offsetAlignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+  const size_t alignment = std::max((size_t)offsetAlignment, 4 * sizeof(float));
+  m_frameStateStride = ((sizeof(FrameState) + alignment - 1) / alignment) * alignment;
+
+  // Filled at each frame, for OpenGL shaders only, OpenCL getting a copy of the camera state
+  glGenBuffers(1, &m_frameStateUBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_frameStateUBO);
+  glBufferData(GL_UNIFORM_BUFFER, NB_FRAME_STATE_SLOTS * m_frameStateStride, nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  loadFrameState();
 }
 
 void Engine::initPointCloud()
 {
-  // Filled by OpenCL
-  glGenBuffers(1, &m_pointCloudCoordVBO);
-  glBindBuffer(GL_ARRAY_BUFFER, m_pointCloudCoordVBO);
-  glBufferData(GL_ARRAY_BUFFER, 4 * m_maxNbParticles * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
-  glVertexAttribPointer(m_pointCloudPosAttribIndex, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), nullptr);
-  glEnableVertexAttribArray(m_pointCloudPosAttribIndex);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  for (auto& renderSlot : m_renderSlots)
+  {
+    // Filled by OpenCL
+    glGenBuffers(1, &renderSlot.coordVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, renderSlot.coordVBO);
+    glBufferData(GL_ARRAY_BUFFER, 4 * m_maxNbParticles * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+
+    // Filled by OpenCL if interpolation is enabled, positions before the step in the same order
+    glGenBuffers(1, &renderSlot.prevCoordVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, renderSlot.prevCoordVBO);
+    glBufferData(GL_ARRAY_BUFFER, 4 * m_maxNbParticles * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+
+    // Filled by OpenCL, 3x16 bits normalized positions inside the box, padded to 8 bytes
+    glGenBuffers(1, &renderSlot.quantizedCoordVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, renderSlot.quantizedCoordVBO);
+    glBufferData(GL_ARRAY_BUFFER, 4 * m_maxNbParticles * sizeof(GLushort), nullptr, GL_DYNAMIC_DRAW);
+
+    // Filled by OpenCL, physical quantity displayed through the colormap
+    glGenBuffers(1, &renderSlot.colorVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, renderSlot.colorVBO);
+    glBufferData(GL_ARRAY_BUFFER, m_maxNbParticles * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Filled by OpenCL, compacted indices of the particles inside camera frustum
+    glGenBuffers(1, &renderSlot.indexEBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderSlot.indexEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_maxNbParticles * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
 
-  // Filled by OpenCL
-  glGenBuffers(1, &m_pointCloudColorVBO);
-  glBindBuffer(GL_ARRAY_BUFFER, m_pointCloudColorVBO);
-  glBufferData(GL_ARRAY_BUFFER, 4 * m_maxNbParticles * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
-  glVertexAttribPointer(m_pointCloudColAttribIndex, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), nullptr);
+  // Attributes pointers are set at drawing time, depending on the drawn render slot
+  glEnableVertexAttribArray(m_pointCloudPosAttribIndex);
+  glEnableVertexAttribArray(m_pointCloudPrevPosAttribIndex);
+  glEnableVertexAttribArray(m_pointCloudQuantizedPosAttribIndex);
   glEnableVertexAttribArray(m_pointCloudColAttribIndex);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Engine::waitForRenderSlot(size_t slot)
+{
+  auto& renderSlot = m_renderSlots[slot];
+  if (!renderSlot.fence)
+    return;
+
+  const GLuint64 timeoutNs = 1000000000;
+  if (glClientWaitSync(renderSlot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeoutNs) == GL_TIMEOUT_EXPIRED)
+    LOG_ERROR("Render: Timeout while waiting for render slot {} to be drawn", slot);
+
+  glDeleteSync(renderSlot.fence);
+  renderSlot.fence = nullptr;
+}
+
+size_t Engine::acquireRenderSlot()
+{
+  const size_t slot = (m_drawnRenderSlot + 1) % NB_RENDER_SLOTS;
+
+  waitForRenderSlot(slot);
+
+  return slot;
+}
+
+void Engine::presentRenderSlot(size_t slot)
+{
+  auto& renderSlot = m_renderSlots[slot];
+  renderSlot.nbParticles = m_nbParticles;
+  renderSlot.nbVisibleParticles = m_nbVisibleParticles;
+  renderSlot.isQuantizedPosPublished = m_isQuantizedPosPublished;
+
+  m_drawnRenderSlot = slot;
+}
+
+void Engine::initColormap()
+{
+  glGenTextures(1, &m_colormapTexture);
+  glBindTexture(GL_TEXTURE_1D, m_colormapTexture);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_1D, 0);
+
+  setColormap(m_colormap);
+}
+
+void Engine::setColormap(Colormap colormap)
+{
+  m_colormap = colormap;
+
+  constexpr size_t colormapSize = 256;
+  std::array<std::array<GLubyte, 4>, colormapSize> texels;
+
+  for (size_t i = 0; i < colormapSize; ++i)
+  {
+    const float val = (float)i / (colormapSize - 1);
+
+    Math::float4 color;
+    switch (m_colormap)
+    {
+    case Colormap::FLUIDS:
+    {
+      // Blue at the middle of the range, i.e close from rest density
+      const Math::float4 lightBlue(0.7f, 0.7f, 1.0f, 0.5f);
+      const Math::float4 blue(0.0f, 0.1f, 1.0f, 0.5f);
+      const Math::float4 darkBlue(0.0f, 0.0f, 0.8f, 0.5f);
+      color = (val < 0.5f) ? lightBlue + (blue - lightBlue) * (2.0f * val) : blue + (darkBlue - blue) * (2.0f * val - 1.0f);
+      break;
+    }
+    case Colormap::BOIDS:
+    {
+      color = Math::float4(1.0f, 0.02f, 0.02f, 0.5f);
+      break;
+    }
+    case Colormap::GRAYSCALE:
+    default:
+    {
+      color = Math::float4(val, val, val, val);
+      break;
+    }
+    }
+
+    for (int c = 0; c < 4; ++c)
+      texels[i][c] = (GLubyte)(Math::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+  }
+
+  glBindTexture(GL_TEXTURE_1D, m_colormapTexture);
+  glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, (GLsizei)colormapSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+  glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+void Engine::initTimerQueries()
+{
+  for (size_t i = 0; i < NB_TIMED_FRAMES; ++i)
+  {
+    glGenQueries(NB_RENDER_PASSES, m_timerQueries[i].data());
+    m_isTimerQueryIssued[i].fill(false);
+  }
+}
+
+const char* Engine::passName(RenderPass pass)
+{
+  switch (pass)
+  {
+  case PASS_BOX:
+    return "Box";
+  case PASS_GRID:
+    return "Grid";
+  case PASS_POINT_CLOUD:
+    return "Point Cloud";
+  case PASS_VOLUME:
+    return "Volume";
+  case PASS_FLUID_SURFACE:
+    return "Fluid Surface";
+  case PASS_TARGET:
+    return "Target";
+  case PASS_UI:
+    return "UI";
+  default:
+    return "Unknown";
+  }
+}
+
+void Engine::readBackTimerQueries()
+{
+  // Moving to the oldest frame of the ring, its queries have most likely been processed by now
+  m_timedFrameIndex = (m_timedFrameIndex + 1) % NB_TIMED_FRAMES;
+
+  auto& frameQueries = m_timerQueries[m_timedFrameIndex];
+  auto& isIssued = m_isTimerQueryIssued[m_timedFrameIndex];
+
+  for (int pass = 0; pass < NB_RENDER_PASSES; ++pass)
+  {
+    if (!isIssued[pass])
+    {
+      m_passTimings[pass].gpuTime = 0.0f;
+      continue;
+    }
+
+    GLint isAvailable = GL_FALSE;
+    glGetQueryObjectiv(frameQueries[pass], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+
+    // Not ready yet, keeping previous timing instead of waiting for the GPU
+    if (isAvailable == GL_FALSE)
+      continue;
+
+    GLuint64 elapsedTime = 0;
+    glGetQueryObjectui64v(frameQueries[pass], GL_QUERY_RESULT, &elapsedTime);
+    m_passTimings[pass].gpuTime = (float)elapsedTime / 1.0e6f;
+
+    isIssued[pass] = false;
+  }
+}
+
+void Engine::beginPass(RenderPass pass)
+{
+  glBeginQuery(GL_TIME_ELAPSED, m_timerQueries[m_timedFrameIndex][pass]);
+  m_passCpuStart[pass] = std::chrono::steady_clock::now();
+}
+
+void Engine::endPass(RenderPass pass)
+{
+  glEndQuery(GL_TIME_ELAPSED);
+  m_isTimerQueryIssued[m_timedFrameIndex][pass] = true;
+
+  const auto cpuTime = std::chrono::steady_clock::now() - m_passCpuStart[pass];
+  m_passTimings[pass].cpuTime = std::chrono::duration<float, std::milli>(cpuTime).count();
 }
 
 void Engine::draw()
 {
-  loadCameraPos();
+  readBackTimerQueries();
+
+  loadFrameState();
 
+  m_passTimings[PASS_BOX].cpuTime = 0.0f;
   if (m_isBoxVisible)
+  {
+    beginPass(PASS_BOX);
     drawBox();
+    endPass(PASS_BOX);
+  }
 
+  m_passTimings[PASS_GRID].cpuTime = 0.0f;
   if (m_isGridVisible)
+  {
+    beginPass(PASS_GRID);
     drawGrid();
+    endPass(PASS_GRID);
+  }
 
-  drawPointCloud();
+  m_passTimings[PASS_POINT_CLOUD].cpuTime = 0.0f;
+  m_passTimings[PASS_VOLUME].cpuTime = 0.0f;
+  m_passTimings[PASS_FLUID_SURFACE].cpuTime = 0.0f;
+  if (m_isVolumeRenderingEnabled)
+  {
+    beginPass(PASS_VOLUME);
+    drawVolume();
+    endPass(PASS_VOLUME);
+  }
+  // Slot filled before enabling the fluid surface may only hold quantized positions, drawn as point sprites meanwhile
+  else if (m_isFluidSurfaceEnabled && !m_renderSlots[m_drawnRenderSlot].isQuantizedPosPublished)
+  {
+    beginPass(PASS_FLUID_SURFACE);
+    drawFluidSurface();
+    endPass(PASS_FLUID_SURFACE);
+  }
+  else
+  {
+    beginPass(PASS_POINT_CLOUD);
+    drawPointCloud();
+    endPass(PASS_POINT_CLOUD);
+  }
 
+  m_passTimings[PASS_TARGET].cpuTime = 0.0f;
   if (m_isTargetVisible)
+  {
+    beginPass(PASS_TARGET);
     drawTarget();
+    endPass(PASS_TARGET);
+  }
+
+  // No more glFinish, OpenCL only waits for the render slot it is about to write
+  auto& renderSlot = m_renderSlots[m_drawnRenderSlot];
+  if (renderSlot.fence)
+    glDeleteSync(renderSlot.fence);
+  renderSlot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
   glFlush();
-  glFinish();
 }
 
-void Engine::loadCameraPos()
+void Engine::loadFrameState()
 {
   if (!m_camera)
     return;
@@ -116,24 +421,92 @@ void Engine::loadCameraPos()
     m_camera->rotate(angle.y, angle.x);
   }
 
-  auto pos = m_camera->cameraPos();
-  const std::array<float, 3> cameraCoord = { pos[0], pos[1], pos[2] };
-  glBindBuffer(GL_ARRAY_BUFFER, m_cameraVBO);
-  glBufferData(GL_ARRAY_BUFFER, 3 * sizeof(float), &cameraCoord, GL_DYNAMIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  FrameState frameState;
+  // Same memory layout than the column-major mat4 of the block, row-vector convention
+  const auto projView = m_camera->getProjViewMat();
+  std::memcpy(frameState.projView, &projView[0][0], sizeof(frameState.projView));
+  const auto pos = m_camera->cameraPos();
+  frameState.cameraPos[0] = pos[0];
+  frameState.cameraPos[1] = pos[1];
+  frameState.cameraPos[2] = pos[2];
+  frameState.cameraPos[3] = 1.0f;
+  frameState.pointSize = (GLint)m_pointSize;
+
+  m_frameStateSlot = (m_frameStateSlot + 1) % NB_FRAME_STATE_SLOTS;
+  const GLintptr slotOffset = (GLintptr)(m_frameStateSlot * m_frameStateStride);
+
+  // GL 3.3 has no persistent mapping, unsynchronized mapping of the slot is the closest
+  glBindBuffer(GL_UNIFORM_BUFFER, m_frameStateUBO);
+  void* slot = glMapBufferRange(GL_UNIFORM_BUFFER, slotOffset, sizeof(FrameState), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  if (slot)
+  {
+    std::memcpy(slot, &frameState, sizeof(FrameState));
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_STATE_BINDING, m_frameStateUBO, slotOffset, sizeof(FrameState));
 }
 
 void Engine::drawPointCloud()
 {
-  m_pointCloudShader->activate();
+  // Following the content of the drawn slot rather than the option, slots filled before toggling it holding the other stream
+  const bool isPosQuantized = m_renderSlots[m_drawnRenderSlot].isQuantizedPosPublished;
+  auto& shader = isPosQuantized ? m_pointCloudQuantizedShader : m_pointCloudShader;
+
+  shader->activate();
+
+  shader->setUniform("u_colorRange", m_colorRange);
+  shader->setUniform("u_isOutOfRangeDiscarded", (int)(m_colormap == Colormap::GRAYSCALE));
+  shader->setUniform("u_colormap", 0);
 
-  m_pointCloudShader->setUniform("u_pointSize", (int)m_pointSize);
-  m_pointCloudShader->setUniform("u_projView", m_camera->getProjViewMat());
-  m_pointCloudShader->setUniform("u_cameraPos", m_camera->cameraPos());
+  if (isPosQuantized)
+    shader->setUniform("u_boxSize", Math::float3((float)m_boxSize.x, (float)m_boxSize.y, (float)m_boxSize.z));
+  else
+    shader->setUniform("u_interpFactor", interpolationFactor());
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_1D, m_colormapTexture);
+
+  bindRenderSlotAttributes();
+  drawRenderSlotParticles();
+
+  glBindTexture(GL_TEXTURE_1D, 0);
+
+  shader->deactivate();
+}
+
+void Engine::bindRenderSlotAttributes()
+{
+  // Last render slot completed by OpenCL
+  const auto& renderSlot = m_renderSlots[m_drawnRenderSlot];
+
+  glBindBuffer(GL_ARRAY_BUFFER, renderSlot.coordVBO);
+  glVertexAttribPointer(m_pointCloudPosAttribIndex, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), nullptr);
+  glBindBuffer(GL_ARRAY_BUFFER, renderSlot.prevCoordVBO);
+  glVertexAttribPointer(m_pointCloudPrevPosAttribIndex, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), nullptr);
+  glBindBuffer(GL_ARRAY_BUFFER, renderSlot.quantizedCoordVBO);
+  glVertexAttribPointer(m_pointCloudQuantizedPosAttribIndex, 4, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(GLushort), nullptr);
+  glBindBuffer(GL_ARRAY_BUFFER, renderSlot.colorVBO);
+  glVertexAttribPointer(m_pointCloudColAttribIndex, 1, GL_FLOAT, GL_FALSE, sizeof(float), nullptr);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-  glDrawArrays(GL_POINTS, 0, (GLsizei)m_nbParticles);
+void Engine::drawRenderSlotParticles()
+{
+  const auto& renderSlot = m_renderSlots[m_drawnRenderSlot];
 
-  m_pointCloudShader->deactivate();
+  if (m_isFrustumCullingEnabled)
+  {
+    // Particles outside camera frustum have been culled by OpenCL
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderSlot.indexEBO);
+    glDrawElements(GL_POINTS, (GLsizei)renderSlot.nbVisibleParticles, GL_UNSIGNED_INT, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
+  else
+  {
+    glDrawArrays(GL_POINTS, 0, (GLsizei)renderSlot.nbParticles);
+  }
 }
 
 void Engine::drawBox()
@@ -142,8 +515,6 @@ void Engine::drawBox()
   {
     m_box2DShader->activate();
 
-    m_box2DShader->setUniform("u_projView", m_camera->getProjViewMat());
-
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_box2DEBO);
     glDrawElements(GL_LINES, 8, GL_UNSIGNED_INT, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -154,8 +525,6 @@ void Engine::drawBox()
   {
     m_box3DShader->activate();
 
-    m_box3DShader->setUniform("u_projView", m_camera->getProjViewMat());
-
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_box3DEBO);
     glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -168,11 +537,22 @@ void Engine::drawGrid()
 {
   m_gridShader->activate();
 
-  m_gridShader->setUniform("u_projView", m_camera->getProjViewMat());
+  const Math::float3 cellSize((float)m_boxSize.x / m_gridRes.x, (float)m_boxSize.y / m_gridRes.y, (float)m_boxSize.z / m_gridRes.z);
+  const Math::float3 gridOrigin(-(float)m_boxSize.x / 2.0f, -(float)m_boxSize.y / 2.0f, -(float)m_boxSize.z / 2.0f);
+
+  m_gridShader->setUniform("u_gridRes", Math::int3((int)m_gridRes.x, (int)m_gridRes.y, (int)m_gridRes.z));
+  m_gridShader->setUniform("u_cellSize", cellSize);
+  m_gridShader->setUniform("u_gridOrigin", gridOrigin);
 
+  // Occupied cells flagged by OpenCL in the last render slot completed
+  glBindBuffer(GL_ARRAY_BUFFER, m_renderSlots[m_drawnRenderSlot].gridDetectorVBO);
+  glVertexAttribPointer(m_gridDetectorAttribIndex, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(GLubyte), nullptr);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // One cube instance per cell, unoccupied ones are collapsed in vertex shader
   GLsizei numGridCells = (GLsizei)(m_gridRes.x * m_gridRes.y * m_gridRes.z);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_gridEBO);
-  glDrawElements(GL_LINES, 24 * numGridCells, GL_UNSIGNED_INT, 0);
+  glDrawElementsInstanced(GL_LINES, (GLsizei)Geometry::RefCubeIndices.size(), GL_UNSIGNED_INT, 0, numGridCells);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
   m_gridShader->deactivate();
@@ -182,8 +562,6 @@ void Engine::drawTarget()
 {
   m_targetShader->activate();
 
-  m_targetShader->setUniform("u_projView", m_camera->getProjViewMat());
-
   const std::array<float, 3> targetCoord = { m_targetPos[0], m_targetPos[1], m_targetPos[2] };
   glBindBuffer(GL_ARRAY_BUFFER, m_targetVBO);
   glBufferData(GL_ARRAY_BUFFER, 3 * sizeof(float), &targetCoord, GL_DYNAMIC_DRAW);
@@ -193,6 +571,233 @@ void Engine::drawTarget()
   m_targetShader->deactivate();
 }
 
+void Engine::initVolume()
+{
+  m_densityVolumeTexture = 0;
+
+  if (!m_isVolumeRenderingSupported)
+    return;
+
+  const size_t nbCells = m_gridRes.x * m_gridRes.y * m_gridRes.z;
+
+  // Filled by OpenCL, one float per cell in texture layout, one per render slot
+  for (auto& renderSlot : m_renderSlots)
+  {
+    glGenBuffers(1, &renderSlot.densityVolumePBO);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderSlot.densityVolumePBO);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, nbCells * sizeof(float), nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  glGenTextures(1, &m_densityVolumeTexture);
+  glBindTexture(GL_TEXTURE_3D, m_densityVolumeTexture);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, (GLsizei)m_gridRes.x, (GLsizei)m_gridRes.y, (GLsizei)m_gridRes.z, 0, GL_RED, GL_FLOAT, nullptr);
+  glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void Engine::drawVolume()
+{
+  // GPU-side copy from the pixel buffer filled by OpenCL in the last render slot completed
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_renderSlots[m_drawnRenderSlot].densityVolumePBO);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_3D, m_densityVolumeTexture);
+  glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, (GLsizei)m_gridRes.x, (GLsizei)m_gridRes.y, (GLsizei)m_gridRes.z, GL_RED, GL_FLOAT, nullptr);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  m_volumeShader->activate();
+
+  m_volumeShader->setUniform("u_invProjView", m_camera->getProjViewMat().Inverse());
+  m_volumeShader->setUniform("u_boxSize", Math::float3((float)m_boxSize.x, (float)m_boxSize.y, (float)m_boxSize.z));
+  m_volumeShader->setUniform("u_densityScale", 0.05f);
+  m_volumeShader->setUniform("u_densityVolume", 0);
+
+  // Composited over the scene whatever the blending mode used for particles
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  glEnable(GL_DEPTH_TEST);
+  enableBlending(m_isBlendingEnabled);
+
+  glBindTexture(GL_TEXTURE_3D, 0);
+
+  m_volumeShader->deactivate();
+}
+
+void Engine::initFluidSurface()
+{
+  m_fluidDepthFBO = m_fluidDepthTexture = m_fluidDepthRBO = 0;
+  m_fluidBlurFBO = m_fluidBlurTexture = 0;
+  m_fluidThicknessFBO = m_fluidThicknessTexture = 0;
+
+  if (!m_isFluidSurfaceSupported)
+    return;
+
+  glGenFramebuffers(1, &m_fluidDepthFBO);
+  glGenFramebuffers(1, &m_fluidBlurFBO);
+  glGenFramebuffers(1, &m_fluidThicknessFBO);
+  glGenTextures(1, &m_fluidDepthTexture);
+  glGenTextures(1, &m_fluidBlurTexture);
+  glGenTextures(1, &m_fluidThicknessTexture);
+  glGenRenderbuffers(1, &m_fluidDepthRBO);
+
+  // Storage allocated at first draw, once viewport size is known
+  for (const GLuint texture : { m_fluidDepthTexture, m_fluidBlurTexture, m_fluidThicknessTexture })
+  {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Engine::resizeFluidSurface(GLsizei width, GLsizei height)
+{
+  if (m_fluidSurfaceSize.x == width && m_fluidSurfaceSize.y == height)
+    return;
+
+  m_fluidSurfaceSize = Math::int2(width, height);
+
+  // Linear eye depth of closest spheres, 0 meaning no fluid
+  glBindTexture(GL_TEXTURE_2D, m_fluidDepthTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, nullptr);
+  glBindTexture(GL_TEXTURE_2D, m_fluidBlurTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, nullptr);
+  // Accumulated thickness, half precision is enough for attenuation
+  glBindTexture(GL_TEXTURE_2D, m_fluidThicknessTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_FLOAT, nullptr);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindRenderbuffer(GL_RENDERBUFFER, m_fluidDepthRBO);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fluidDepthFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_fluidDepthTexture, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_fluidDepthRBO);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    LOG_ERROR("Render: Fluid depth framebuffer incomplete");
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fluidBlurFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_fluidBlurTexture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    LOG_ERROR("Render: Fluid blur framebuffer incomplete");
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fluidThicknessFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_fluidThicknessTexture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    LOG_ERROR("Render: Fluid thickness framebuffer incomplete");
+}
+
+void Engine::drawFluidSurface()
+{
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  GLint prevFramebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFramebuffer);
+
+  resizeFluidSurface(viewport[2], viewport[3]);
+  glViewport(0, 0, viewport[2], viewport[3]);
+
+  const auto proj = m_camera->getProjMat();
+  const auto view = m_camera->getViewMat();
+  // Spheres slightly overlapping at rest spacing, a third of a grid cell
+  const float particleRadius = 0.3f * (float)m_boxSize.x / m_gridRes.x;
+  const float pointScale = proj[1][1] * (float)viewport[3];
+
+  const GLfloat noFluid[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  const GLfloat farDepth = 1.0f;
+
+  bindRenderSlotAttributes();
+
+  // Closest sphere surfaces, no depth sort needed thanks to depth test
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fluidDepthFBO);
+  glClearBufferfv(GL_COLOR, 0, noFluid);
+  glClearBufferfv(GL_DEPTH, 0, &farDepth);
+  glDisable(GL_BLEND);
+
+  m_fluidDepthShader->activate();
+  m_fluidDepthShader->setUniform("u_view", view);
+  m_fluidDepthShader->setUniform("u_proj", proj);
+  m_fluidDepthShader->setUniform("u_particleRadius", particleRadius);
+  m_fluidDepthShader->setUniform("u_pointScale", pointScale);
+  m_fluidDepthShader->setUniform("u_interpFactor", interpolationFactor());
+  drawRenderSlotParticles();
+  m_fluidDepthShader->deactivate();
+
+  // Thickness along view rays, accumulated over all spheres
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fluidThicknessFBO);
+  glClearBufferfv(GL_COLOR, 0, noFluid);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+
+  m_fluidThicknessShader->activate();
+  m_fluidThicknessShader->setUniform("u_view", view);
+  m_fluidThicknessShader->setUniform("u_particleRadius", particleRadius);
+  m_fluidThicknessShader->setUniform("u_pointScale", pointScale);
+  m_fluidThicknessShader->setUniform("u_interpFactor", interpolationFactor());
+  drawRenderSlotParticles();
+  m_fluidThicknessShader->deactivate();
+
+  // Separable bilateral blur, horizontal pass into blur target then vertical pass back into depth target
+  glDisable(GL_BLEND);
+  glActiveTexture(GL_TEXTURE0);
+
+  m_fluidBlurShader->activate();
+  m_fluidBlurShader->setUniform("u_eyeDepth", 0);
+  m_fluidBlurShader->setUniform("u_blurScale", m_fluidBlurScale);
+  m_fluidBlurShader->setUniform("u_blurDepthFalloff", 1.0f / particleRadius);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fluidBlurFBO);
+  glBindTexture(GL_TEXTURE_2D, m_fluidDepthTexture);
+  m_fluidBlurShader->setUniform("u_blurDir", Math::float2(1.0f, 0.0f));
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fluidDepthFBO);
+  glBindTexture(GL_TEXTURE_2D, m_fluidBlurTexture);
+  m_fluidBlurShader->setUniform("u_blurDir", Math::float2(0.0f, 1.0f));
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  m_fluidBlurShader->deactivate();
+
+  // Shading composited over the scene, depth-tested against box and grid already drawn
+  glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)prevFramebuffer);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, m_fluidDepthTexture);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, m_fluidThicknessTexture);
+
+  m_fluidShadingShader->activate();
+  m_fluidShadingShader->setUniform("u_eyeDepth", 0);
+  m_fluidShadingShader->setUniform("u_thickness", 1);
+  m_fluidShadingShader->setUniform("u_proj", proj);
+  m_fluidShadingShader->setUniform("u_projScale", Math::float2(proj[0][0], proj[1][1]));
+  m_fluidShadingShader->setUniform("u_fluidColor", m_fluidColor);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  m_fluidShadingShader->deactivate();
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  enableBlending(m_isBlendingEnabled);
+}
+
 void Engine::initBox()
 {
   // 2D
@@ -246,6 +851,7 @@ void Engine::initGrid()
   cellDims[1] = (float)m_boxSize.y / m_gridRes.y;
   cellDims[2] = (float)m_boxSize.z / m_gridRes.z;
 
+  // Single cell centered on origin, instanced for each cell of the grid
   auto localCellCoords = Geometry::RefCubeVertices;
   for (auto& vertex : localCellCoords)
   {
@@ -255,71 +861,30 @@ void Engine::initGrid()
     vertex = { x, y, z };
   }
 
-  size_t centerIndex = 0;
   size_t numCells = m_gridRes.x * m_gridRes.y * m_gridRes.z;
-  Geometry::Vertex3D firstPos;
-  firstPos[0] = -(float)m_boxSize.x / 2.0f + 0.5f * cellDims[0];
-  firstPos[1] = -(float)m_boxSize.y / 2.0f + 0.5f * cellDims[1];
-  firstPos[2] = -(float)m_boxSize.z / 2.0f + 0.5f * cellDims[2];
-  std::vector<Geometry::Vertex3D> globalCellCenterCoords(numCells);
-  for (int x = 0; x < m_gridRes.x; ++x)
-  {
-    float xCoord = firstPos[0] + x * cellDims[0];
-    for (int y = 0; y < m_gridRes.y; ++y)
-    {
-      float yCoord = firstPos[1] + y * cellDims[1];
-      for (int z = 0; z < m_gridRes.z; ++z)
-      {
-        float zCoord = firstPos[2] + z * cellDims[2];
-        globalCellCenterCoords.at(centerIndex++) = { xCoord, yCoord, zCoord };
-      }
-    }
-  }
-
-  size_t cornerIndex = 0;
-  std::vector<Geometry::Vertex3D> globalCellCoords(numCells * 8);
-  for (const auto& centerCoords : globalCellCenterCoords)
-  {
-    for (const auto& cornerCoords : localCellCoords)
-    {
-      globalCellCoords.at(cornerIndex)[0] = cornerCoords[0] + centerCoords[0];
-      globalCellCoords.at(cornerIndex)[1] = cornerCoords[1] + centerCoords[1];
-      globalCellCoords.at(cornerIndex)[2] = cornerCoords[2] + centerCoords[2];
-      ++cornerIndex;
-    }
-  }
 
   glGenBuffers(1, &m_gridPosVBO);
   glBindBuffer(GL_ARRAY_BUFFER, m_gridPosVBO);
   glVertexAttribPointer(m_gridPosAttribIndex, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
   glEnableVertexAttribArray(m_gridPosAttribIndex);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(globalCellCoords.front()) * globalCellCoords.size(), globalCellCoords.data(), GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  // Filled by OpenCL
-  glGenBuffers(1, &m_gridDetectorVBO);
-  glBindBuffer(GL_ARRAY_BUFFER, m_gridDetectorVBO);
-  glVertexAttribPointer(m_gridDetectorAttribIndex, 1, GL_FLOAT, GL_FALSE, sizeof(float), nullptr);
-  glEnableVertexAttribArray(m_gridDetectorAttribIndex);
-  glBufferData(GL_ARRAY_BUFFER, 8 * numCells * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(localCellCoords.front()) * localCellCoords.size(), localCellCoords.data(), GL_STATIC_DRAW);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-  size_t index = 0;
-  GLuint globalOffset = 0;
-  std::vector<GLuint> globalCellIndices(numCells * 24);
-  for (const auto& centerCoords : globalCellCenterCoords)
+  // Filled by OpenCL, one byte per cell flagging cells occupied by particles, one per render slot
+  for (auto& renderSlot : m_renderSlots)
   {
-    for (const auto& localIndex : Geometry::RefCubeIndices)
-    {
-      globalCellIndices.at(index++) = (GLuint)localIndex + globalOffset;
-    }
-    globalOffset += 8;
+    glGenBuffers(1, &renderSlot.gridDetectorVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, renderSlot.gridDetectorVBO);
+    glBufferData(GL_ARRAY_BUFFER, numCells * sizeof(GLubyte), nullptr, GL_DYNAMIC_DRAW);
   }
+  glVertexAttribPointer(m_gridDetectorAttribIndex, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(GLubyte), nullptr);
+  glVertexAttribDivisor(m_gridDetectorAttribIndex, 1);
+  glEnableVertexAttribArray(m_gridDetectorAttribIndex);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-  size_t gridIndexSize = sizeof(globalCellIndices.front()) * globalCellIndices.size();
   glGenBuffers(1, &m_gridEBO);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_gridEBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, gridIndexSize, globalCellIndices.data(), GL_STATIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Geometry::RefCubeIndices), Geometry::RefCubeIndices.data(), GL_STATIC_DRAW);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
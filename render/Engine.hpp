@@ -5,8 +5,10 @@
 #include "Shader.hpp"
 
 #include <array>
+#include <chrono>
 #include <glad/glad.h>
 #include <memory>
+#include <utility>
 #include <vector>
 
 namespace Render
@@ -18,6 +20,37 @@ enum class UserAction
   ZOOM
 };
 
+// Colormaps applied on the physical quantity stored per particle in the color buffer
+enum class Colormap
+{
+  // Intensity and opacity growing with the quantity, particles out of range are discarded
+  GRAYSCALE,
+  // Light blue for low density, dark blue for high density
+  FLUIDS,
+  // Uniform red
+  BOIDS
+};
+
+// Draw passes timed on CPU and GPU side, UI pass being triggered by the application
+enum RenderPass
+{
+  PASS_BOX,
+  PASS_GRID,
+  PASS_POINT_CLOUD,
+  PASS_VOLUME,
+  PASS_FLUID_SURFACE,
+  PASS_TARGET,
+  PASS_UI,
+  NB_RENDER_PASSES
+};
+
+// Timings in milliseconds, GPU ones being read back a few frames late to avoid stalling
+struct PassTimings
+{
+  float cpuTime = 0.0f;
+  float gpuTime = 0.0f;
+};
+
 struct EngineParams
 {
   size_t currNbParticles = 0;
@@ -27,6 +60,11 @@ struct EngineParams
   size_t pointSize = 10;
   float aspectRatio = 0.0f;
   Geometry::Dimension dimension = Geometry::Dimension::dim3D;
+  Colormap colormap = Colormap::GRAYSCALE;
+  // Density volume filled by the physics model on the grid, ray-marched instead of drawing particles
+  bool isVolumeRenderingSupported = false;
+  // Particles rendered as a smoothed liquid surface in screen space instead of point sprites
+  bool isFluidSurfaceSupported = false;
 };
 
 class Engine
@@ -38,7 +76,16 @@ class Engine
   void checkMouseEvents(UserAction action, Math::float2 mouseDisplacement);
   void draw();
 
+  // Wrapping a draw pass with a GL_TIME_ELAPSED query, passes must not be nested
+  void beginPass(RenderPass pass);
+  void endPass(RenderPass pass);
+
+  static const char* passName(RenderPass pass);
+  inline const PassTimings& passTimings(RenderPass pass) const { return m_passTimings[pass]; }
+
   inline const Math::float3 cameraPos() const { return m_camera ? m_camera->cameraPos() : Math::float3(0.0f, 0.0f, 0.0f); }
+  // Camera state of the last frame, copied by value to the simulation thread for culling and sorting
+  inline const Math::float4x4 cameraProjViewMat() const { return m_camera ? m_camera->getProjViewMat() : Math::float4x4(); }
   inline const Math::float3 focusPos() const { return m_camera ? m_camera->focusPos() : Math::float3(0.0f, 0.0f, 0.0f); }
 
   inline bool isCameraAutoRotating() const { return m_camera ? m_camera->isAutoRotating() : false; }
@@ -59,6 +106,40 @@ class Engine
   }
 
   inline void setNbParticles(int nbParticles) { m_nbParticles = nbParticles; }
+  inline void setNbVisibleParticles(int nbVisibleParticles) { m_nbVisibleParticles = nbVisibleParticles; }
+
+  // Only particles inside camera frustum are drawn, their indices being compacted by OpenCL
+  inline bool isFrustumCullingEnabled() const { return m_isFrustumCullingEnabled; }
+  inline void enableFrustumCulling(bool enable) { m_isFrustumCullingEnabled = enable; }
+
+  // Particles positions drawn from a render-side copy quantized on 3x16 bits inside the box, filled by OpenCL
+  inline bool isPosQuantizationEnabled() const { return m_isPosQuantizationEnabled; }
+  inline void enablePosQuantization(bool enable) { m_isPosQuantizationEnabled = enable; }
+  // Quantized positions filled by OpenCL in the next presented slot, drawn from only once a slot holds them
+  inline void setQuantizedPosPublished(bool isPublished) { m_isQuantizedPosPublished = isPublished; }
+
+  inline bool isVolumeRenderingSupported() const { return m_isVolumeRenderingSupported; }
+  inline bool isVolumeRenderingEnabled() const { return m_isVolumeRenderingEnabled; }
+  inline void enableVolumeRendering(bool enable) { m_isVolumeRenderingEnabled = enable && m_isVolumeRenderingSupported; }
+
+  inline bool isFluidSurfaceSupported() const { return m_isFluidSurfaceSupported; }
+  inline bool isFluidSurfaceEnabled() const { return m_isFluidSurfaceEnabled; }
+  inline void enableFluidSurface(bool enable) { m_isFluidSurfaceEnabled = enable && m_isFluidSurfaceSupported; }
+  inline Math::float3 fluidColor() const { return m_fluidColor; }
+  inline void setFluidColor(const Math::float3& color) { m_fluidColor = color; }
+  // Falloff of the bilateral blur along screen texels, smaller values smoothing spheres over a wider area
+  inline float fluidBlurScale() const { return m_fluidBlurScale; }
+  inline void setFluidBlurScale(float scale) { m_fluidBlurScale = scale; }
+
+  // Particles drawn between previous and current physics states, factor being the elapsed fraction of a step
+  inline bool isInterpolationEnabled() const { return m_isInterpolationEnabled; }
+  inline void enableInterpolation(bool enable) { m_isInterpolationEnabled = enable; }
+  inline void setInterpolationFactor(float factor) { m_interpolationFactor = factor; }
+
+  // Back-to-front order of particles only matters for blended point sprites
+  inline bool isCameraSortNeeded() const { return !m_isFluidSurfaceEnabled; }
+  // Quantized positions replacing float ones in render slots, only drawn by point sprites
+  inline bool isPosQuantizationNeeded() const { return m_isPosQuantizationEnabled && !m_isFluidSurfaceEnabled; }
 
   inline size_t getPointSize() { return m_pointSize; }
   inline void setPointSize(size_t pointSize) { m_pointSize = pointSize; }
@@ -77,19 +158,42 @@ class Engine
 
   inline void setTargetPos(const Math::float3& pos) { m_targetPos = pos; }
 
+  // Range of the physical quantity mapped onto the colormap
+  inline void setColorRange(const std::pair<float, float>& range) { m_colorRange = Math::float2(range.first, range.second); }
+  void setColormap(Colormap colormap);
+
   void setDimension(Geometry::Dimension dim) { m_dimension = dim; }
   Geometry::Dimension dimension() const { return m_dimension; }
 
-  inline GLuint pointCloudCoordVBO() const { return m_pointCloudCoordVBO; }
-  inline GLuint pointCloudColorVBO() const { return m_pointCloudColorVBO; }
-  inline GLuint cameraCoordVBO() const { return m_cameraVBO; }
-  inline GLuint gridDetectorVBO() const { return m_gridDetectorVBO; }
+  // Particles, grid detector and density volume buffers are a ring of render slots, OpenCL filling one while the last completed one is drawn
+  static constexpr size_t NB_RENDER_SLOTS = 3;
+  // Next slot to be written by OpenCL, waiting on its fence for OpenGL to be done drawing it
+  size_t acquireRenderSlot();
+  // Slot completed by OpenCL, drawn from now on with current number of (visible) particles
+  void presentRenderSlot(size_t slot);
+  // Waiting for OpenGL to be done drawing a slot before OpenCL writes it from another thread
+  void releaseRenderSlot(size_t slot) { waitForRenderSlot(slot); }
+
+  inline GLuint pointCloudCoordVBO(size_t slot) const { return m_renderSlots[slot].coordVBO; }
+  inline GLuint pointCloudPrevCoordVBO(size_t slot) const { return m_renderSlots[slot].prevCoordVBO; }
+  inline GLuint pointCloudColorVBO(size_t slot) const { return m_renderSlots[slot].colorVBO; }
+  inline GLuint pointCloudQuantizedCoordVBO(size_t slot) const { return m_renderSlots[slot].quantizedCoordVBO; }
+  inline GLuint pointCloudIndexEBO(size_t slot) const { return m_renderSlots[slot].indexEBO; }
+  inline GLuint gridDetectorVBO(size_t slot) const { return m_renderSlots[slot].gridDetectorVBO; }
+  inline GLuint densityVolumePBO(size_t slot) const { return m_renderSlots[slot].densityVolumePBO; }
 
   private:
   void buildShaders();
 
   void initPointCloud();
   void drawPointCloud();
+  void bindRenderSlotAttributes();
+  // Current positions only if interpolation is disabled
+  float interpolationFactor() const { return m_isInterpolationEnabled ? m_interpolationFactor : 1.0f; }
+  void drawRenderSlotParticles();
+  void waitForRenderSlot(size_t slot);
+
+  void initColormap();
 
   void initBox();
   void drawBox();
@@ -100,7 +204,17 @@ class Engine
   void initTarget();
   void drawTarget();
 
-  void loadCameraPos();
+  void initVolume();
+  void drawVolume();
+
+  void initFluidSurface();
+  void resizeFluidSurface(GLsizei width, GLsizei height);
+  void drawFluidSurface();
+
+  void loadFrameState();
+
+  void initTimerQueries();
+  void readBackTimerQueries();
 
   void initCamera(float sceneAspectRatio);
 
@@ -111,24 +225,58 @@ class Engine
   const GLuint m_gridPosAttribIndex { 4 };
   const GLuint m_gridDetectorAttribIndex { 5 };
   const GLuint m_targetPosAttribIndex { 6 };
+  const GLuint m_pointCloudQuantizedPosAttribIndex { 7 };
+  const GLuint m_pointCloudPrevPosAttribIndex { 8 };
 
   GLuint m_VAO;
-  GLuint m_pointCloudCoordVBO, m_pointCloudColorVBO;
   GLuint m_box2DVBO, m_box2DEBO;
   GLuint m_box3DVBO, m_box3DEBO;
-  GLuint m_gridPosVBO, m_gridDetectorVBO, m_gridEBO;
+  GLuint m_gridPosVBO, m_gridEBO;
   GLuint m_targetVBO;
-  GLuint m_cameraVBO;
+  GLuint m_colormapTexture;
+  GLuint m_densityVolumeTexture;
+  GLuint m_frameStateUBO;
+
+  // Screen-space fluid surface targets, resized along with the viewport
+  GLuint m_fluidDepthFBO, m_fluidDepthTexture, m_fluidDepthRBO;
+  GLuint m_fluidBlurFBO, m_fluidBlurTexture;
+  GLuint m_fluidThicknessFBO, m_fluidThicknessTexture;
+  Math::int2 m_fluidSurfaceSize;
+
+  struct RenderSlot
+  {
+    GLuint coordVBO = 0;
+    GLuint prevCoordVBO = 0;
+    GLuint quantizedCoordVBO = 0;
+    GLuint colorVBO = 0;
+    GLuint indexEBO = 0;
+    GLuint gridDetectorVBO = 0;
+    GLuint densityVolumePBO = 0;
+    // Signaled once OpenGL is done drawing the slot
+    GLsync fence = nullptr;
+    size_t nbParticles = 0;
+    size_t nbVisibleParticles = 0;
+    bool isQuantizedPosPublished = false;
+  };
+  std::array<RenderSlot, NB_RENDER_SLOTS> m_renderSlots;
+  size_t m_drawnRenderSlot;
 
   std::unique_ptr<Shader> m_pointCloudShader;
+  std::unique_ptr<Shader> m_pointCloudQuantizedShader;
   std::unique_ptr<Shader> m_box2DShader;
   std::unique_ptr<Shader> m_box3DShader;
   std::unique_ptr<Shader> m_gridShader;
   std::unique_ptr<Shader> m_targetShader;
+  std::unique_ptr<Shader> m_volumeShader;
+  std::unique_ptr<Shader> m_fluidDepthShader;
+  std::unique_ptr<Shader> m_fluidThicknessShader;
+  std::unique_ptr<Shader> m_fluidBlurShader;
+  std::unique_ptr<Shader> m_fluidShadingShader;
 
   Geometry::BoxSize3D m_boxSize;
   Geometry::BoxSize3D m_gridRes;
   size_t m_nbParticles;
+  size_t m_nbVisibleParticles;
   size_t m_maxNbParticles;
   size_t m_pointSize;
 
@@ -136,9 +284,48 @@ class Engine
   bool m_isGridVisible;
   bool m_isTargetVisible;
   bool m_isBlendingEnabled;
+  bool m_isFrustumCullingEnabled;
+  bool m_isPosQuantizationEnabled;
+  bool m_isQuantizedPosPublished;
+  bool m_isVolumeRenderingSupported;
+  bool m_isVolumeRenderingEnabled;
+  bool m_isFluidSurfaceSupported;
+  bool m_isFluidSurfaceEnabled;
+  Math::float3 m_fluidColor;
+  float m_fluidBlurScale;
+  bool m_isInterpolationEnabled;
+  float m_interpolationFactor;
 
   Math::float3 m_targetPos;
 
+  Colormap m_colormap;
+  Math::float2 m_colorRange;
+
+  // std140 layout of the FrameState uniform block
+  struct FrameState
+  {
+    float projView[16];
+    float cameraPos[4];
+    GLint pointSize;
+    GLint padding[3];
+  };
+  static_assert(sizeof(FrameState) == 96, "FrameState must match std140 layout");
+
+  // Ring of FrameState slots, written unsynchronized since a slot is only reused NB_FRAME_STATE_SLOTS frames later
+  static constexpr size_t NB_FRAME_STATE_SLOTS = 3;
+  static constexpr GLuint FRAME_STATE_BINDING = 0;
+  size_t m_frameStateSlot;
+  size_t m_frameStateStride;
+
+  // Ring of timer queries per pass, a slot being read back when reused NB_TIMED_FRAMES frames later
+  static constexpr size_t NB_TIMED_FRAMES = 4;
+  std::array<std::array<GLuint, NB_RENDER_PASSES>, NB_TIMED_FRAMES> m_timerQueries;
+  std::array<std::array<bool, NB_RENDER_PASSES>, NB_TIMED_FRAMES> m_isTimerQueryIssued;
+  size_t m_timedFrameIndex;
+
+  std::array<std::chrono::steady_clock::time_point, NB_RENDER_PASSES> m_passCpuStart;
+  std::array<PassTimings, NB_RENDER_PASSES> m_passTimings;
+
   std::unique_ptr<Camera> m_camera;
 
   Geometry::Dimension m_dimension;
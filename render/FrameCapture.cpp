@@ -0,0 +1,230 @@
+#include "FrameCapture.hpp"
+#include "Logging.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Render;
+
+FrameCapture::FrameCapture(FrameCaptureParams params)
+    : m_size(params.size)
+    , m_format(params.format)
+    , m_fps(params.fps)
+    , m_currSlot(0)
+    , m_prevFramebuffer(0)
+    , m_isWriterStopped(false)
+    , m_nbWrittenFrames(0)
+    , m_init(false)
+{
+  m_file.open(params.filePath, std::ios::binary);
+  if (!m_file.is_open())
+  {
+    LOG_ERROR("Render: Cannot open capture file {}", params.filePath);
+    return;
+  }
+
+  if (m_format == CaptureFormat::Y4M)
+    m_file << "YUV4MPEG2 W" << m_size.x << " H" << m_size.y << " F" << m_fps << ":1 Ip A1:1 C444\n";
+
+  initFramebuffer();
+
+  initPixelBuffers();
+
+  m_writerThread = std::thread(&FrameCapture::writeFrames, this);
+
+  LOG_INFO("Capturing {}x{} frames into {}", m_size.x, m_size.y, params.filePath);
+
+  m_init = true;
+}
+
+FrameCapture::~FrameCapture()
+{
+  finish();
+
+  for (auto& slot : m_readbackSlots)
+  {
+    glDeleteBuffers(1, &slot.PBO);
+    if (slot.fence)
+      glDeleteSync(slot.fence);
+  }
+
+  glDeleteFramebuffers(1, &m_FBO);
+  glDeleteRenderbuffers(1, &m_colorRBO);
+  glDeleteRenderbuffers(1, &m_depthRBO);
+}
+
+void FrameCapture::initFramebuffer()
+{
+  glGenRenderbuffers(1, &m_colorRBO);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_colorRBO);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_size.x, m_size.y);
+
+  glGenRenderbuffers(1, &m_depthRBO);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_depthRBO);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_size.x, m_size.y);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &m_FBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRBO);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRBO);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    LOG_ERROR("Render: Capture framebuffer incomplete");
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void FrameCapture::initPixelBuffers()
+{
+  const size_t frameSize = 4 * (size_t)m_size.x * m_size.y;
+
+  for (auto& slot : m_readbackSlots)
+  {
+    glGenBuffers(1, &slot.PBO);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+    glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameCapture::beginFrame()
+{
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_prevFramebuffer);
+  glGetIntegerv(GL_VIEWPORT, m_prevViewport);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+  glViewport(0, 0, m_size.x, m_size.y);
+}
+
+void FrameCapture::endFrame()
+{
+  auto& slot = m_readbackSlots[m_currSlot];
+
+  // Slot being reused, its frame was queued NB_READBACK_SLOTS frames ago and is most likely ready
+  if (slot.fence)
+    readBackSlot(m_currSlot);
+
+  // Asynchronous copy into the pixel buffer, glReadPixels returns immediately
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_FBO);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+  glReadPixels(0, 0, m_size.x, m_size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)m_prevFramebuffer);
+  glViewport(m_prevViewport[0], m_prevViewport[1], m_prevViewport[2], m_prevViewport[3]);
+
+  m_currSlot = (m_currSlot + 1) % NB_READBACK_SLOTS;
+}
+
+void FrameCapture::readBackSlot(size_t slotIndex)
+{
+  auto& slot = m_readbackSlots[slotIndex];
+
+  const GLuint64 timeoutNs = 1000000000;
+  if (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeoutNs) == GL_TIMEOUT_EXPIRED)
+    LOG_ERROR("Render: Timeout while waiting for captured frame readback");
+
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+
+  const size_t rowSize = 4 * (size_t)m_size.x;
+  std::vector<uint8_t> frame(rowSize * m_size.y);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+  const auto* pixels = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame.size(), GL_MAP_READ_BIT);
+  if (pixels)
+  {
+    // OpenGL rows start from the bottom, video frames from the top
+    for (int row = 0; row < m_size.y; ++row)
+      std::memcpy(frame.data() + row * rowSize, pixels + (m_size.y - 1 - row) * rowSize, rowSize);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (pixels)
+    pushFrame(std::move(frame));
+}
+
+void FrameCapture::pushFrame(std::vector<uint8_t>&& frame)
+{
+  std::unique_lock<std::mutex> lock(m_queueMutex);
+  m_queueCondition.wait(lock, [this] { return m_queuedFrames.size() < MAX_QUEUED_FRAMES; });
+
+  m_queuedFrames.push_back(std::move(frame));
+
+  lock.unlock();
+  m_queueCondition.notify_all();
+}
+
+void FrameCapture::finish()
+{
+  if (!m_writerThread.joinable())
+    return;
+
+  // Oldest frames first
+  for (size_t i = 0; i < NB_READBACK_SLOTS; ++i)
+  {
+    const size_t slotIndex = (m_currSlot + i) % NB_READBACK_SLOTS;
+    if (m_readbackSlots[slotIndex].fence)
+      readBackSlot(slotIndex);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_isWriterStopped = true;
+  }
+  m_queueCondition.notify_all();
+
+  m_writerThread.join();
+  m_file.close();
+
+  LOG_INFO("Captured {} frames", m_nbWrittenFrames.load());
+}
+
+void FrameCapture::writeFrames()
+{
+  while (true)
+  {
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    m_queueCondition.wait(lock, [this] { return !m_queuedFrames.empty() || m_isWriterStopped; });
+
+    if (m_queuedFrames.empty())
+      break;
+
+    std::vector<uint8_t> frame = std::move(m_queuedFrames.front());
+    m_queuedFrames.pop_front();
+
+    lock.unlock();
+    m_queueCondition.notify_all();
+
+    if (m_format == CaptureFormat::Y4M)
+      writeY4MFrame(frame);
+    else
+      m_file.write((const char*)frame.data(), frame.size());
+
+    ++m_nbWrittenFrames;
+  }
+}
+
+void FrameCapture::writeY4MFrame(const std::vector<uint8_t>& frame)
+{
+  const size_t nbPixels = (size_t)m_size.x * m_size.y;
+  std::vector<uint8_t> planes(3 * nbPixels);
+
+  // BT.601 limited range, one plane per component
+  for (size_t i = 0; i < nbPixels; ++i)
+  {
+    const int r = frame[4 * i];
+    const int g = frame[4 * i + 1];
+    const int b = frame[4 * i + 2];
+
+    planes[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    planes[nbPixels + i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    planes[2 * nbPixels + i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+  }
+
+  m_file << "FRAME\n";
+  m_file.write((const char*)planes.data(), planes.size());
+}
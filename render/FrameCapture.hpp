@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Math.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <glad/glad.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Render
+{
+enum class CaptureFormat
+{
+  // Concatenated RGBA8 frames, top row first, e.g for ffmpeg -f rawvideo -pix_fmt rgba
+  RAW,
+  // YUV4MPEG2 stream in 4:4:4, readable by most video tools
+  Y4M
+};
+
+struct FrameCaptureParams
+{
+  Math::int2 size = { 1280, 720 };
+  std::string filePath = "capture.y4m";
+  CaptureFormat format = CaptureFormat::Y4M;
+  int fps = 60;
+};
+
+// Offscreen framebuffer whose frames are read back asynchronously through a ring of pixel buffers
+// then written to disk by a dedicated thread, the render loop never waiting on the file system
+class FrameCapture
+{
+  public:
+  FrameCapture(FrameCaptureParams params);
+  ~FrameCapture();
+
+  bool isInit() const { return m_init; }
+
+  // Binding the offscreen framebuffer and its viewport for the next draws
+  void beginFrame();
+  // Queuing readback of the drawn frame, handing the oldest completed one to the writer thread
+  void endFrame();
+  // Reading back remaining frames and waiting for the writer thread to be done
+  void finish();
+
+  Math::int2 size() const { return m_size; }
+  size_t nbWrittenFrames() const { return m_nbWrittenFrames; }
+
+  private:
+  void initFramebuffer();
+  void initPixelBuffers();
+
+  void readBackSlot(size_t slot);
+  void pushFrame(std::vector<uint8_t>&& frame);
+  void writeFrames();
+  void writeY4MFrame(const std::vector<uint8_t>& frame);
+
+  // Frames in flight between glReadPixels and CPU mapping
+  static constexpr size_t NB_READBACK_SLOTS = 3;
+  // Frames waiting for the writer thread, the render loop waits beyond that instead of growing memory
+  static constexpr size_t MAX_QUEUED_FRAMES = 8;
+
+  struct ReadbackSlot
+  {
+    GLuint PBO = 0;
+    // Signaled once the frame has been copied into the pixel buffer
+    GLsync fence = nullptr;
+  };
+  std::array<ReadbackSlot, NB_READBACK_SLOTS> m_readbackSlots;
+  size_t m_currSlot;
+
+  GLuint m_FBO, m_colorRBO, m_depthRBO;
+  GLint m_prevFramebuffer;
+  GLint m_prevViewport[4];
+
+  Math::int2 m_size;
+  CaptureFormat m_format;
+  int m_fps;
+
+  std::ofstream m_file;
+  std::thread m_writerThread;
+  std::mutex m_queueMutex;
+  std::condition_variable m_queueCondition;
+  std::deque<std::vector<uint8_t>> m_queuedFrames;
+  bool m_isWriterStopped;
+  std::atomic<size_t> m_nbWrittenFrames;
+
+  bool m_init;
+};
+}
@@ -5,59 +5,96 @@ namespace Render
 {
 constexpr char PointCloudVertShader[] = R"(#version 330 core
     layout(location = 0) in vec4 aPos;
-    layout(location = 1) in vec4 aCol;
+    layout(location = 1) in float aQuantity;
+    layout(location = 8) in vec4 aPrevPos;
 
-    uniform int u_pointSize;
-    uniform mat4 u_projView;
+    layout(std140) uniform FrameState
+    {
+        mat4 u_projView;
+        vec4 u_cameraPos;
+        int u_pointSize;
+    };
+
+    // Fraction of the physics step elapsed since last state, previous positions unused if 1
+    uniform float u_interpFactor;
 
     out vec4 vertexPos;
-    out vec4 vertexCol;
+    out float vertexQuantity;
 
     void main()
     {
-        vertexPos = vec4(aPos.xyz, 1.0);
+        vertexPos = vec4(u_interpFactor < 1.0 ? mix(aPrevPos.xyz, aPos.xyz, u_interpFactor) : aPos.xyz, 1.0);
         gl_Position = u_projView * vertexPos;
 
         vec4 eye = u_projView * vertexPos; 
         float d = length(eye);
         gl_PointSize = u_pointSize * max(8.0 * 1.0/(0.04 + 0.8*d + 0.0002*d*d), 0.5); 		
 
-        vertexCol = aCol;
+        vertexQuantity = aQuantity;
+    }
+    )";
+
+// Same than PointCloudVertShader but decoding positions quantized on 16 bits within the box
+constexpr char PointCloudQuantizedVertShader[] = R"(#version 330 core
+    layout(location = 7) in vec4 aQuantizedPos;
+    layout(location = 1) in float aQuantity;
+
+    layout(std140) uniform FrameState
+    {
+        mat4 u_projView;
+        vec4 u_cameraPos;
+        int u_pointSize;
+    };
+    uniform vec3 u_boxSize;
+
+    out vec4 vertexPos;
+    out float vertexQuantity;
+
+    void main()
+    {
+        // Normalized unsigned shorts are fetched in [0, 1]
+        vertexPos = vec4((aQuantizedPos.xyz - 0.5) * u_boxSize, 1.0);
+        gl_Position = u_projView * vertexPos;
+
+        vec4 eye = u_projView * vertexPos; 
+        float d = length(eye);
+        gl_PointSize = u_pointSize * max(8.0 * 1.0/(0.04 + 0.8*d + 0.0002*d*d), 0.5); 		
+
+        vertexQuantity = aQuantity;
     }
     )";
 
 constexpr char PointCloudFragShader[] = R"(#version 330 core
     in vec4 vertexPos;
-    in vec4 vertexCol;
+    in float vertexQuantity;
 
-    uniform vec3 u_cameraPos;
+    uniform sampler1D u_colormap;
+    // Physical quantity range mapped onto the colormap
+    uniform vec2 u_colorRange;
+    uniform int u_isOutOfRangeDiscarded;
 
     out vec4 fragColor;
 
     void main()
     {
-      // Additive alpha blending
-      //vec3 xyz = u_cameraPos.xyz - vertexPos.xyz;
-      // WIP not working well
-      // Alpha tending to 1 close from the camera
-      // to see non translucent close neighbor particles
-      // And down to 0.75 away from the camera to allow additive blending
-      //float r2 = dot(xyz, xyz);
-      //fragColor.a = 1.0;
-      //fragColor.a = 2.5* exp(-r2 / 100000)+0.75;
-      //fragColor.rgb = vertexCol.rgb * fragColor.a;
+      float val = (vertexQuantity - u_colorRange.x) / (u_colorRange.y - u_colorRange.x);
 
       // We discard particles whose physical quantity is out of range
-      if(vertexCol.a <= 0.0f || vertexCol.a >= 1.0f) discard;
+      if(u_isOutOfRangeDiscarded != 0 && (val <= 0.0f || val >= 1.0f)) discard;
 
-      fragColor = vec4(vertexCol.rgba);
+      fragColor = texture(u_colormap, clamp(val, 0.0f, 1.0f));
     }
     )";
 
 constexpr char Box2DVertShader[] = R"(#version 330 core
     layout(location = 2) in vec2 aPos;
 
-    uniform mat4 u_projView;
+    layout(std140) uniform FrameState
+    {
+        mat4 u_projView;
+        vec4 u_cameraPos;
+        int u_pointSize;
+    };
     out vec4 vertexColor;
 
     void main()
@@ -71,7 +108,12 @@ constexpr char Box2DVertShader[] = R"(#version 330 core
 constexpr char Box3DVertShader[] = R"(#version 330 core
     layout(location = 3) in vec3 aPos;
 
-    uniform mat4 u_projView;
+    layout(std140) uniform FrameState
+    {
+        mat4 u_projView;
+        vec4 u_cameraPos;
+        int u_pointSize;
+    };
     out vec4 vertexColor;
 
     void main()
@@ -84,17 +126,31 @@ constexpr char Box3DVertShader[] = R"(#version 330 core
 
 constexpr char GridVertShader[] = R"(#version 330 core
     layout(location = 4) in vec3 aPos;
-    layout(location = 5) in float vertexDetector;
+    layout(location = 5) in float cellDetector;
 
-    uniform mat4 u_projView;
+    layout(std140) uniform FrameState
+    {
+        mat4 u_projView;
+        vec4 u_cameraPos;
+        int u_pointSize;
+    };
+    uniform ivec3 u_gridRes;
+    uniform vec3 u_cellSize;
+    uniform vec3 u_gridOrigin;
     out vec4 vertexColor;
 
     void main()
     {
       vertexColor = vec4(0.6, 0.6, 0.2, 0.6);
-      
-      if(vertexDetector > 0.0f)
-        gl_Position = u_projView * vec4(aPos, 1.0);
+
+      // One instance per cell, same cell ordering than on OpenCL side
+      int x = gl_InstanceID / (u_gridRes.y * u_gridRes.z);
+      int y = (gl_InstanceID / u_gridRes.z) % u_gridRes.y;
+      int z = gl_InstanceID % u_gridRes.z;
+      vec3 cellCenter = u_gridOrigin + (vec3(x, y, z) + 0.5) * u_cellSize;
+
+      if(cellDetector > 0.0f)
+        gl_Position = u_projView * vec4(aPos + cellCenter, 1.0);
       else
         gl_Position =  vec4(0.0, 0.0, 0.0, 1.0);
 
@@ -105,7 +161,12 @@ constexpr char GridVertShader[] = R"(#version 330 core
 constexpr char TargetVertShader[] = R"(#version 330 core
     layout(location = 6) in vec3 aPos;
 
-    uniform mat4 u_projView;
+    layout(std140) uniform FrameState
+    {
+        mat4 u_projView;
+        vec4 u_cameraPos;
+        int u_pointSize;
+    };
     out vec4 vertexColor;
 
     void main()
@@ -119,6 +180,241 @@ constexpr char TargetVertShader[] = R"(#version 330 core
     }
     )";
 
+// Fullscreen triangle generated from vertex ID, no vertex buffer needed
+constexpr char FullscreenVertShader[] = R"(#version 330 core
+    out vec2 ndcPos;
+
+    void main()
+    {
+        ndcPos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+        gl_Position = vec4(ndcPos, 0.0, 1.0);
+    }
+    )";
+
+// Ray-marching through the density volume filled by OpenCL, aligned with the box
+constexpr char VolumeFragShader[] = R"(#version 330 core
+    in vec2 ndcPos;
+
+    uniform mat4 u_invProjView;
+    uniform vec3 u_boxSize;
+    uniform float u_densityScale;
+    uniform sampler3D u_densityVolume;
+
+    out vec4 fragColor;
+
+    const int NB_STEPS = 128;
+
+    void main()
+    {
+      vec4 nearPos = u_invProjView * vec4(ndcPos, -1.0, 1.0);
+      vec4 farPos = u_invProjView * vec4(ndcPos, 1.0, 1.0);
+      vec3 rayOrigin = nearPos.xyz / nearPos.w;
+      vec3 rayDir = normalize(farPos.xyz / farPos.w - rayOrigin);
+
+      // Ray-box intersection using slabs
+      vec3 t0 = (-0.5 * u_boxSize - rayOrigin) / rayDir;
+      vec3 t1 = ( 0.5 * u_boxSize - rayOrigin) / rayDir;
+      vec3 tMin = min(t0, t1);
+      vec3 tMax = max(t0, t1);
+      float tEnter = max(max(max(tMin.x, tMin.y), tMin.z), 0.0);
+      float tExit = min(min(tMax.x, tMax.y), tMax.z);
+
+      if(tExit <= tEnter) discard;
+
+      float stepSize = (tExit - tEnter) / float(NB_STEPS);
+      float transmittance = 1.0;
+
+      for(int i = 0; i < NB_STEPS && transmittance > 0.01; ++i)
+      {
+        vec3 pos = rayOrigin + rayDir * (tEnter + (float(i) + 0.5) * stepSize);
+        float density = texture(u_densityVolume, pos / u_boxSize + 0.5).r;
+        transmittance *= exp(-density * u_densityScale * stepSize);
+      }
+
+      fragColor = vec4(1.0, 1.0, 1.0, 1.0 - transmittance);
+    }
+    )";
+
+// Screen-space fluid rendering, particles drawn as spheres facing the camera
+// Eye space is looking toward +z, see Camera
+constexpr char FluidSpriteVertShader[] = R"(#version 330 core
+    layout(location = 0) in vec4 aPos;
+    layout(location = 8) in vec4 aPrevPos;
+
+    layout(std140) uniform FrameState
+    {
+        mat4 u_projView;
+        vec4 u_cameraPos;
+        int u_pointSize;
+    };
+
+    uniform mat4 u_view;
+    uniform float u_particleRadius;
+    // Viewport height times vertical focal length of the projection
+    uniform float u_pointScale;
+    uniform float u_interpFactor;
+
+    out vec3 eyePos;
+
+    void main()
+    {
+        vec3 pos = u_interpFactor < 1.0 ? mix(aPrevPos.xyz, aPos.xyz, u_interpFactor) : aPos.xyz;
+        vec4 eye = u_view * vec4(pos, 1.0);
+        eyePos = eye.xyz;
+
+        gl_Position = u_projView * vec4(pos, 1.0);
+        gl_PointSize = u_particleRadius * u_pointScale / max(eye.z, 0.001);
+    }
+    )";
+
+// Linear eye depth of the sphere surface, closest one kept by depth test
+constexpr char FluidDepthFragShader[] = R"(#version 330 core
+    in vec3 eyePos;
+
+    uniform mat4 u_proj;
+    uniform float u_particleRadius;
+
+    out float fragEyeDepth;
+
+    void main()
+    {
+      vec2 coord = vec2(gl_PointCoord.x, 1.0 - gl_PointCoord.y) * 2.0 - 1.0;
+      float r2 = dot(coord, coord);
+      if(r2 > 1.0) discard;
+
+      vec3 sphereEyePos = eyePos - vec3(0.0, 0.0, sqrt(1.0 - r2) * u_particleRadius);
+
+      vec4 clipPos = u_proj * vec4(sphereEyePos, 1.0);
+      gl_FragDepth = gl_DepthRange.diff * (clipPos.z / clipPos.w * 0.5 + 0.5) + gl_DepthRange.near;
+
+      fragEyeDepth = sphereEyePos.z;
+    }
+    )";
+
+// Fluid thickness along the view ray, accumulated with additive blending
+constexpr char FluidThicknessFragShader[] = R"(#version 330 core
+    in vec3 eyePos;
+
+    uniform float u_particleRadius;
+
+    out float fragThickness;
+
+    void main()
+    {
+      vec2 coord = vec2(gl_PointCoord.x, 1.0 - gl_PointCoord.y) * 2.0 - 1.0;
+      float r2 = dot(coord, coord);
+      if(r2 > 1.0) discard;
+
+      fragThickness = 2.0 * sqrt(1.0 - r2) * u_particleRadius;
+    }
+    )";
+
+// Separable bilateral filter on eye depth, smoothing spheres into a surface while preserving silhouettes
+constexpr char FluidBlurFragShader[] = R"(#version 330 core
+    uniform sampler2D u_eyeDepth;
+    uniform vec2 u_blurDir;
+    uniform float u_blurScale;
+    uniform float u_blurDepthFalloff;
+
+    out float fragEyeDepth;
+
+    const int BLUR_RADIUS = 10;
+
+    void main()
+    {
+      ivec2 texelPos = ivec2(gl_FragCoord.xy);
+      float depth = texelFetch(u_eyeDepth, texelPos, 0).r;
+
+      // Background, no fluid
+      if(depth <= 0.0)
+      {
+        fragEyeDepth = 0.0;
+        return;
+      }
+
+      float sum = 0.0;
+      float weightSum = 0.0;
+      for(int i = -BLUR_RADIUS; i <= BLUR_RADIUS; ++i)
+      {
+        ivec2 samplePos = clamp(texelPos + i * ivec2(u_blurDir), ivec2(0), textureSize(u_eyeDepth, 0) - 1);
+        float sampleDepth = texelFetch(u_eyeDepth, samplePos, 0).r;
+        if(sampleDepth <= 0.0) continue;
+
+        float r = float(i) * u_blurScale;
+        float d = (sampleDepth - depth) * u_blurDepthFalloff;
+        float weight = exp(-r * r) * exp(-d * d);
+
+        sum += sampleDepth * weight;
+        weightSum += weight;
+      }
+
+      fragEyeDepth = sum / weightSum;
+    }
+    )";
+
+// Normals reconstructed from smoothed eye depth, shaded and attenuated by thickness
+// Depth of the smoothed surface written too, for the surface to be depth-tested against the rest of the scene
+constexpr char FluidShadingFragShader[] = R"(#version 330 core
+    in vec2 ndcPos;
+
+    uniform sampler2D u_eyeDepth;
+    uniform sampler2D u_thickness;
+    uniform mat4 u_proj;
+    // Proj[0][0] and Proj[1][1]
+    uniform vec2 u_projScale;
+    uniform vec3 u_fluidColor;
+
+    out vec4 fragColor;
+
+    vec3 eyePosFromDepth(vec2 ndc, float depth)
+    {
+      return vec3(ndc * depth / u_projScale, depth);
+    }
+
+    void main()
+    {
+      ivec2 texelPos = ivec2(gl_FragCoord.xy);
+      vec2 texelSize = 2.0 / vec2(textureSize(u_eyeDepth, 0));
+
+      float depth = texelFetch(u_eyeDepth, texelPos, 0).r;
+      if(depth <= 0.0) discard;
+
+      vec3 eyePos = eyePosFromDepth(ndcPos, depth);
+
+      vec4 clipPos = u_proj * vec4(eyePos, 1.0);
+      gl_FragDepth = gl_DepthRange.diff * (clipPos.z / clipPos.w * 0.5 + 0.5) + gl_DepthRange.near;
+
+      // Smallest finite difference on each axis to avoid artifacts on silhouettes
+      float depthRight = texelFetch(u_eyeDepth, texelPos + ivec2(1, 0), 0).r;
+      float depthLeft = texelFetch(u_eyeDepth, texelPos - ivec2(1, 0), 0).r;
+      float depthUp = texelFetch(u_eyeDepth, texelPos + ivec2(0, 1), 0).r;
+      float depthDown = texelFetch(u_eyeDepth, texelPos - ivec2(0, 1), 0).r;
+
+      vec3 ddx = eyePosFromDepth(ndcPos + vec2(texelSize.x, 0.0), depthRight) - eyePos;
+      vec3 ddx2 = eyePos - eyePosFromDepth(ndcPos - vec2(texelSize.x, 0.0), depthLeft);
+      if(depthRight <= 0.0 || (depthLeft > 0.0 && abs(ddx.z) > abs(ddx2.z))) ddx = ddx2;
+
+      vec3 ddy = eyePosFromDepth(ndcPos + vec2(0.0, texelSize.y), depthUp) - eyePos;
+      vec3 ddy2 = eyePos - eyePosFromDepth(ndcPos - vec2(0.0, texelSize.y), depthDown);
+      if(depthUp <= 0.0 || (depthDown > 0.0 && abs(ddy.z) > abs(ddy2.z))) ddy = ddy2;
+
+      vec3 normal = normalize(cross(ddy, ddx));
+
+      vec3 lightDir = normalize(vec3(0.4, 0.8, -0.5));
+      vec3 viewDir = normalize(-eyePos);
+      float diffuse = 0.4 + 0.6 * max(dot(normal, lightDir), 0.0);
+      float specular = pow(max(dot(normal, normalize(lightDir + viewDir)), 0.0), 60.0);
+      float fresnel = 0.1 + 0.9 * pow(1.0 - max(dot(normal, viewDir), 0.0), 5.0);
+
+      // Beer-Lambert attenuation through the fluid
+      float thickness = texelFetch(u_thickness, texelPos, 0).r;
+      float transmittance = exp(-0.6 * thickness);
+
+      vec3 color = u_fluidColor * diffuse + vec3(specular + 0.3 * fresnel);
+      fragColor = vec4(color, clamp(1.0 - transmittance + fresnel, 0.3, 1.0));
+    }
+    )";
+
 constexpr char FragShader[] = R"(#version 330 core
     in vec4 vertexColor;
 
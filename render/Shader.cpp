@@ -81,7 +81,29 @@ void Shader::setUniform(const std::string& name, const Math::float4x4& mat) cons
   glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 }
 
+void Shader::setUniform(const std::string& name, const Math::float2& vec) const
+{
+  glUniform2f(getUniformLocation(name), vec[0], vec[1]);
+}
+
 void Shader::setUniform(const std::string& name, const Math::float3& vec) const
 {
   glUniform3f(getUniformLocation(name), vec[0], vec[1], vec[2]);
 }
+
+void Shader::setUniform(const std::string& name, const Math::int3& vec) const
+{
+  glUniform3i(getUniformLocation(name), vec[0], vec[1], vec[2]);
+}
+
+void Shader::bindUniformBlock(const std::string& name, GLuint binding) const
+{
+  GLuint blockIndex = glGetUniformBlockIndex(m_programID, name.c_str());
+  if (blockIndex == GL_INVALID_INDEX)
+  {
+    LOG_ERROR("Render: Uniform block {} not found in shader", name);
+    return;
+  }
+
+  glUniformBlockBinding(m_programID, blockIndex, binding);
+}
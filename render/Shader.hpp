@@ -20,7 +20,12 @@ class Shader
   void setUniform(const std::string& name, int value) const;
   void setUniform(const std::string& name, float value) const;
   void setUniform(const std::string& name, const Math::float4x4& mat) const;
+  void setUniform(const std::string& name, const Math::float2& vec) const;
   void setUniform(const std::string& name, const Math::float3& vec) const;
+  void setUniform(const std::string& name, const Math::int3& vec) const;
+
+  // Uniform blocks are shared between programs through binding points
+  void bindUniformBlock(const std::string& name, GLuint binding) const;
 
   const GLuint getProgramID() const { return m_programID; }
 
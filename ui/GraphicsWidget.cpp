@@ -35,6 +35,58 @@ void UI::GraphicsWidget::display()
     m_graphicsEngine->enableBlending(isBlendingEnabled);
   }
 
+  bool isFrustumCullingEnabled = m_graphicsEngine->isFrustumCullingEnabled();
+  if (ImGui::Checkbox(" Frustum Culling ", &isFrustumCullingEnabled))
+  {
+    m_graphicsEngine->enableFrustumCulling(isFrustumCullingEnabled);
+  }
+
+  bool isPosQuantizationEnabled = m_graphicsEngine->isPosQuantizationEnabled();
+  if (ImGui::Checkbox(" Quantized Positions ", &isPosQuantizationEnabled))
+  {
+    m_graphicsEngine->enablePosQuantization(isPosQuantizationEnabled);
+  }
+
+  if (m_graphicsEngine->isVolumeRenderingSupported())
+  {
+    bool isVolumeRenderingEnabled = m_graphicsEngine->isVolumeRenderingEnabled();
+    if (ImGui::Checkbox(" Volume Rendering ", &isVolumeRenderingEnabled))
+    {
+      m_graphicsEngine->enableVolumeRendering(isVolumeRenderingEnabled);
+    }
+  }
+
+  if (m_graphicsEngine->isFluidSurfaceSupported())
+  {
+    bool isFluidSurfaceEnabled = m_graphicsEngine->isFluidSurfaceEnabled();
+    if (ImGui::Checkbox(" Fluid Surface ", &isFluidSurfaceEnabled))
+    {
+      m_graphicsEngine->enableFluidSurface(isFluidSurfaceEnabled);
+    }
+
+    if (isFluidSurfaceEnabled)
+    {
+      const auto color = m_graphicsEngine->fluidColor();
+      float fluidColor[3] = { color.x, color.y, color.z };
+      if (ImGui::ColorEdit3("Fluid color", fluidColor))
+      {
+        m_graphicsEngine->setFluidColor(Math::float3(fluidColor[0], fluidColor[1], fluidColor[2]));
+      }
+
+      float fluidBlurScale = m_graphicsEngine->fluidBlurScale();
+      if (ImGui::SliderFloat("Surface blur scale", &fluidBlurScale, 0.05f, 1.0f, "%.2f"))
+      {
+        m_graphicsEngine->setFluidBlurScale(fluidBlurScale);
+      }
+    }
+  }
+
+  bool isInterpolationEnabled = m_graphicsEngine->isInterpolationEnabled();
+  if (ImGui::Checkbox(" Interpolation ", &isInterpolationEnabled))
+  {
+    m_graphicsEngine->enableInterpolation(isInterpolationEnabled);
+  }
+
   if (ImGui::Button(" Reset Camera "))
   {
     m_graphicsEngine->resetCamera();
@@ -4,7 +4,7 @@
 #include <imgui.h>
 #include <vector>
 
-void displayBoundaryConditions(Physics::Model* engine)
+void displayBoundaryConditions(Physics::Model* engine, const std::function<void(Physics::ModelCommand)>& pushCommand)
 {
   if (!engine)
     return;
@@ -18,10 +18,8 @@ void displayBoundaryConditions(Physics::Model* engine)
   bool isBouncingWall = (engine->boundary() == Physics::Boundary::BouncingWall);
   if (ImGui::Checkbox("Bouncing Wall", &isBouncingWall))
   {
-    if (isBouncingWall)
-      engine->setBoundary(Physics::Boundary::BouncingWall);
-    else
-      engine->setBoundary(Physics::Boundary::CyclicWall);
+    const auto boundary = isBouncingWall ? Physics::Boundary::BouncingWall : Physics::Boundary::CyclicWall;
+    pushCommand([boundary](Physics::Model& model) { model.setBoundary(boundary); });
   }
 
   ImGui::SameLine();
@@ -29,38 +27,39 @@ void displayBoundaryConditions(Physics::Model* engine)
   bool isCyclicWall = (engine->boundary() == Physics::Boundary::CyclicWall);
   if (ImGui::Checkbox("Cyclic Wall", &isCyclicWall))
   {
-    if (isCyclicWall)
-      engine->setBoundary(Physics::Boundary::CyclicWall);
-    else
-      engine->setBoundary(Physics::Boundary::BouncingWall);
+    const auto boundary = isCyclicWall ? Physics::Boundary::CyclicWall : Physics::Boundary::BouncingWall;
+    pushCommand([boundary](Physics::Model& model) { model.setBoundary(boundary); });
   }
 }
 
-void drawImguiCheckBoxFromJson(const std::string& name, bool& enable)
+void drawImguiCheckBox(Physics::ParameterStore& store, size_t index)
 {
-  ImGui::Checkbox(name.c_str(), &enable);
+  const auto& param = store.at(index);
+  bool boolVal = param.boolValue;
+  if (ImGui::Checkbox(param.name.c_str(), &boolVal))
+  {
+    store.setBool(index, boolVal);
+  }
 }
 
-void drawImguiSliderInt(const std::string& name, json& js)
+void drawImguiSliderInt(Physics::ParameterStore& store, size_t index)
 {
-  int intVal = js.at(0);
-  int minVal = js.at(1);
-  int maxVal = js.at(2);
-  if (ImGui::SliderInt(name.c_str(), &intVal, minVal, maxVal))
+  const auto& param = store.at(index);
+  int intVal = param.intValue;
+  if (ImGui::SliderInt(param.name.c_str(), &intVal, param.intMin, param.intMax))
   {
-    js.at(0) = intVal;
+    store.setInt(index, intVal);
   }
 }
 
-void drawImguiSliderFloat(const std::string& name, json& js)
+void drawImguiSliderFloat(Physics::ParameterStore& store, size_t index)
 {
-  float floatVal = js.at(0);
-  float minVal = js.at(1);
-  float maxVal = js.at(2);
+  const auto& param = store.at(index);
+  float floatVal = param.floatValue;
   std::string precision = floatVal <= 0.1f ? "%.4f" : "%.2f";
-  if (ImGui::SliderFloat(name.c_str(), &floatVal, minVal, maxVal, precision.c_str()))
+  if (ImGui::SliderFloat(param.name.c_str(), &floatVal, param.floatMin, param.floatMax, precision.c_str()))
   {
-    js.at(0) = floatVal;
+    store.setFloat(index, floatVal);
   }
 }
 
@@ -89,51 +88,81 @@ void drawImguiEnumCombo(const std::string& name, json& js)
   }
 }
 
-void drawImguiObjectFromJson(json& js)
+void drawImguiParameters(Physics::ParameterStore& store)
 {
-  for (auto& pair : js.items())
+  const auto& params = store.parameters();
+
+  size_t currDepth = 0;
+  // Depth of a group whose rest of the items is skipped
+  bool isSkipping = false;
+  size_t skippedDepth = 0;
+
+  for (size_t index = 0; index < params.size(); ++index)
   {
-    const auto& name = pair.key();
-    auto& val = pair.value();
+    const auto& param = params[index];
 
-    if (val.is_object())
+    if (isSkipping && param.depth >= skippedDepth)
+      continue;
+    isSkipping = false;
+
+    // Closing groups left
+    for (; currDepth > param.depth; --currDepth)
     {
-      ImGui::Spacing();
-      ImGui::Text(name.c_str());
-      ImGui::Indent(15.0f);
-      // Recursive call
-      drawImguiObjectFromJson(val);
       ImGui::Unindent(15.0f);
       ImGui::Spacing();
     }
-    else if (val.is_boolean())
-    {
-      // accessing json bool value by reference, directly modifying the value within the json
-      drawImguiCheckBoxFromJson(name, val.get_ref<bool&>());
 
-      // special case where we skip the rest of the items if "Enable" param is false
-      bool skipRestOfItems = name.find("Enable##") != std::string::npos && val == false;
-
-      if (skipRestOfItems)
-        return;
+    switch (param.type)
+    {
+    case Physics::ParameterType::GROUP:
+    {
+      ImGui::Spacing();
+      ImGui::Text(param.name.c_str());
+      ImGui::Indent(15.0f);
+      ++currDepth;
+      break;
     }
-    else if (val.is_array() && val.size() == 3)
+    case Physics::ParameterType::BOOL:
     {
-      if (val[0].is_number_integer())
-      {
-        // cannot directly access json array items by reference, one copy needed
-        drawImguiSliderInt(name, val);
-      }
-      else if (val[0].is_number_float())
+      drawImguiCheckBox(store, index);
+
+      // special case where we skip the rest of the items if "Enable" param is false
+      if (param.name.find("Enable##") != std::string::npos && !param.boolValue)
       {
-        // cannot directly access json array items by reference, one copy needed
-        drawImguiSliderFloat(name, val);
+        isSkipping = true;
+        skippedDepth = param.depth;
       }
+      break;
+    }
+    case Physics::ParameterType::INT:
+    {
+      drawImguiSliderInt(store, index);
+      break;
     }
-    else
+    case Physics::ParameterType::FLOAT:
     {
-      LOG_ERROR("{} type is not supported by PhysicsWidget drawer", name);
+      drawImguiSliderFloat(store, index);
+      break;
     }
+    }
+  }
+
+  for (; currDepth > 0; --currDepth)
+  {
+    ImGui::Unindent(15.0f);
+    ImGui::Spacing();
+  }
+}
+
+void UI::PhysicsWidget::pushCommand(Physics::ModelCommand command)
+{
+  if (m_pushCommand)
+  {
+    m_pushCommand(std::move(command));
+  }
+  else if (auto physicsEngine = m_physicsEngine.lock())
+  {
+    command(*physicsEngine);
   }
 }
 
@@ -149,12 +178,11 @@ void UI::PhysicsWidget::display()
 
   ImGui::Value("Particles", (int)physicsEngine->nbParticles());
 
-  displayBoundaryConditions(physicsEngine.get());
+  displayBoundaryConditions(physicsEngine.get(), [this](Physics::ModelCommand command) { pushCommand(std::move(command)); });
 
-  // Retrieve input json from the physics engine with all available parameters
-  json js = physicsEngine->getInputJson();
-  // Draw all items from input json
-  drawImguiObjectFromJson(js);
-  // Update physics engine with new parameters values if any
-  physicsEngine->updateInputJson(js);
+  // Draw all parameters, modified ones being written directly into the model parameter store
+  drawImguiParameters(physicsEngine->parameters());
+  // Transferred to the model kernels only if some have been modified
+  if (physicsEngine->parameters().isDirty())
+    pushCommand([](Physics::Model& model) { model.applyParameterChanges(); });
 }
\ No newline at end of file
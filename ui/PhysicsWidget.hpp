@@ -3,6 +3,7 @@
 
 #include "Model.hpp"
 
+#include <functional>
 #include <memory>
 
 namespace UI
@@ -10,13 +11,18 @@ namespace UI
 class PhysicsWidget
 {
   public:
-  explicit PhysicsWidget(std::shared_ptr<Physics::Model> physicsEngine)
-      : m_physicsEngine(physicsEngine) {};
+  // Modifications sent as commands to the thread stepping the model, applied right away if none given
+  explicit PhysicsWidget(std::shared_ptr<Physics::Model> physicsEngine, std::function<void(Physics::ModelCommand)> pushCommand = {})
+      : m_physicsEngine(physicsEngine)
+      , m_pushCommand(pushCommand) {};
   virtual ~PhysicsWidget() = default;
 
   void display();
 
   private:
+  void pushCommand(Physics::ModelCommand command);
+
   std::weak_ptr<Physics::Model> m_physicsEngine;
+  std::function<void(Physics::ModelCommand)> m_pushCommand;
 };
 }
\ No newline at end of file